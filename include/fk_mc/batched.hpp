@@ -0,0 +1,290 @@
+#ifndef __FK_MC_BATCHED_HPP_
+#define __FK_MC_BATCHED_HPP_
+
+#include "common.hpp"
+#include "fk_mc.hpp"
+#include <alps/mc/stop_callback.hpp>
+#include <numeric>
+
+namespace fk {
+
+/** Eigenvalues of a batch of real symmetric n x n matrices.
+ * The matrices are stored as structure of arrays, a[(i*n + j)*nbatch + b] is the element (i,j) of the matrix b, so that
+ * the Householder tridiagonalization does the same operations for all matrices in the innermost loop over the batch, 
+ * that the compiler vectorizes. The eigenvalues of the tridiagonal matrices are found with the implicit QL method,
+ * also in lockstep for the whole batch.
+ * a is destroyed, evals[i*nbatch + b] are the eigenvalues of the matrix b in ascending order. */
+void batched_eigenvalues(std::vector<double>& a, int n, int nbatch, std::vector<double>& evals);
+
+/** Batched mode for small lattices : nchains independent add/remove and flip chains, which are advanced together.
+ * For small N a single ED is too short to be threaded, and the overheads of a chain (sparse assembly, move dispatch, allocations)
+ * dominate. Here the f-configurations are stored as structure of arrays, every step proposes one move in every chain and
+ * the Hamiltonians of all valid proposals are diagonalized at once with batched_eigenvalues.
+ * Chain b draws its random numbers from the stream first_stream + b, so that a chain with a given stream is the same in any batch.
+ * With first_stream = rank*nchains the ranks use the streams 0..nranks*nchains-1, and a run depends on the total number of chains only.
+ * The observables are kept per chain. */
+template <typename lattice_t>
+class batched_chains {
+public:
+    batched_chains(lattice_t const& lattice, config_params const& p, int nchains, uint64_t seed, uint64_t first_stream,
+                   double flip_weight, double add_remove_weight, bool measure_history);
+
+    /// Start every chain from a random configuration with nf f-electrons
+    void randomize(int nf);
+    /// One Metropolis step of every chain
+    void step();
+    /// Thermalization and measurement sweeps of sweep_len steps, a measurement after every sweep. Stops after max_time seconds (0 - no limit).
+    void run(int ntherm_sweeps, int nsweeps, int sweep_len, size_t max_time);
+    /// Measure all chains
+    void measure();
+
+    int nchains() const { return nchains_; }
+    /// f-configuration of chain b
+    configuration_t::int_array_t f_config(int b) const;
+    std::vector<observables_t> const& observables() const { return obs_; }
+    /// Acceptance rate of the valid proposals (flips of full or empty configurations are not counted)
+    double acceptance_rate() const { return nattempt_ ? double(naccept_) / nattempt_ : 0.0; }
+
+protected:
+    /// f-f energy of chain b
+    double ff_energy_(std::vector<int> const& f, int b) const;
+    /// Change of the f-f energy of chain b, if the occupation of site i flips
+    double ff_diff_(std::vector<int> const& f, int b, int i) const;
+    /// Diagonalize the Hamiltonians of the configurations f of the given chains, evals[i*chains.size() + k] for the chain chains[k]
+    void diagonalize_(std::vector<int> const& f, std::vector<int> const& chains, std::vector<double>& evals);
+    /// logZ of the c-electrons from the spectrum evals[i*stride + k]
+    double logz_(std::vector<double> const& evals, int k, int stride) const;
+
+    lattice_t const& lattice_;
+    config_params p_;
+    int n_;
+    int nchains_;
+    double flip_prob_;
+    bool measure_history_;
+    std::vector<random_generator> rng_;
+    /// Dense hopping matrix
+    Eigen::MatrixXd hopping_;
+    lattice_base::neighbor_shells_t shells_;
+
+    /// f_[i*nchains + b] - occupation of site i in chain b, the same for the proposals. f_new_ equals f_ between the steps.
+    std::vector<int> f_, f_new_;
+    /// Spectra of the current configurations, evals_[i*nchains + b], and of the valid proposals, evals_new_[i*proposed_.size() + k]
+    std::vector<double> evals_, evals_new_;
+    /// Batch of the Hamiltonians
+    std::vector<double> a_;
+    std::vector<double> logz_cur_, ff_cur_;
+    std::vector<int> nf_;
+    /// Buffers of a step : the changes of the f-f energy and of nf, the random numbers of the Metropolis test
+    std::vector<double> dff_, u_accept_;
+    std::vector<int> dnf_;
+    /// Sites, changed by the proposal of chain b, changed_[2*b] and changed_[2*b + 1] (-1 if unused)
+    std::vector<int> changed_;
+    /// Chains with a valid proposal
+    std::vector<int> proposed_;
+    std::vector<observables_t> obs_;
+    long nattempt_ = 0, naccept_ = 0;
+};
+
+template <typename lattice_t>
+batched_chains<lattice_t>::batched_chains(lattice_t const& lattice, config_params const& p, int nchains, uint64_t seed, uint64_t first_stream,
+                                          double flip_weight, double add_remove_weight, bool measure_history):
+    lattice_(lattice), p_(p), n_(lattice.get_msize()), nchains_(std::max(nchains, 1)),
+    flip_prob_(flip_weight + add_remove_weight > 0 ? flip_weight / (flip_weight + add_remove_weight) : 0.0),
+    measure_history_(measure_history), hopping_(lattice.hopping_m()),
+    shells_(p.W.size() > 1 ? lattice.neighbor_shells(p.W.size() - 1) : lattice_base::neighbor_shells_t()),
+    f_(n_*nchains_, 0), f_new_(n_*nchains_, 0), evals_(n_*nchains_), evals_new_(n_*nchains_),
+    logz_cur_(nchains_), ff_cur_(nchains_), nf_(nchains_, 0), dff_(nchains_), u_accept_(nchains_), dnf_(nchains_), 
+    changed_(2*nchains_, -1), obs_(nchains_)
+{
+    proposed_.reserve(nchains_);
+    for (int b=0; b<nchains_; ++b) rng_.emplace_back(seed, first_stream + b);
+    randomize(0);
+}
+
+template <typename lattice_t>
+void batched_chains<lattice_t>::randomize(int nf)
+{
+    std::fill(f_.begin(), f_.end(), 0);
+    nf = std::min(std::max(nf, 0), n_);
+    std::uniform_int_distribution<> distr(0, n_ - 1);
+    for (int b=0; b<nchains_; ++b) {
+        for (int k=0; k<nf; ++k) {
+            int i = distr(rng_[b]); while (f_[i*nchains_ + b]) i = distr(rng_[b]);
+            f_[i*nchains_ + b] = 1;
+            }
+        nf_[b] = nf;
+        ff_cur_[b] = ff_energy_(f_, b);
+        }
+    f_new_ = f_;
+    std::vector<int> all(nchains_);
+    std::iota(all.begin(), all.end(), 0);
+    diagonalize_(f_, all, evals_);
+    for (int b=0; b<nchains_; ++b) logz_cur_[b] = logz_(evals_, b, nchains_);
+}
+
+template <typename lattice_t>
+configuration_t::int_array_t batched_chains<lattice_t>::f_config(int b) const
+{
+    configuration_t::int_array_t out(n_);
+    for (int i=0; i<n_; ++i) out(i) = f_[i*nchains_ + b];
+    return out;
+}
+
+template <typename lattice_t>
+double batched_chains<lattice_t>::ff_energy_(std::vector<int> const& f, int b) const
+{
+    if (p_.W.empty()) return 0.0;
+    double e = 0.0;
+    for (int i=0; i<n_; ++i) {
+        if (!f[i*nchains_ + b]) continue;
+        e += p_.W[0];
+        for (size_t l=1; l<p_.W.size(); ++l)
+            for (size_t j : shells_[l-1][i]) e += p_.W[l] * f[j*nchains_ + b];
+        }
+    return e;
+}
+
+template <typename lattice_t>
+double batched_chains<lattice_t>::ff_diff_(std::vector<int> const& f, int b, int i) const
+{
+    if (p_.W.empty()) return 0.0;
+    double de = p_.W[0];
+    for (size_t l=1; l<p_.W.size(); ++l)
+        for (size_t j : shells_[l-1][i]) de += 2. * p_.W[l] * f[j*nchains_ + b];
+    return f[i*nchains_ + b] ? -de : de;
+}
+
+template <typename lattice_t>
+void batched_chains<lattice_t>::diagonalize_(std::vector<int> const& f, std::vector<int> const& chains, std::vector<double>& evals)
+{
+    int nb = chains.size();
+    if (!nb) return;
+    a_.resize(n_*n_*nb);
+    for (int i=0; i<n_; ++i)
+        for (int j=0; j<n_; ++j) {
+            double* a = &a_[(i*n_ + j)*nb];
+            std::fill(a, a + nb, hopping_(i,j));
+            if (i == j) for (int k=0; k<nb; ++k) a[k] += -p_.mu_c + p_.U*f[i*nchains_ + chains[k]];
+            }
+    batched_eigenvalues(a_, n_, nb, evals);
+}
+
+template <typename lattice_t>
+double batched_chains<lattice_t>::logz_(std::vector<double> const& evals, int k, int stride) const
+{
+    double beta = p_.beta, logz = 0.0;
+    for (int i=0; i<n_; ++i) {
+        double e = evals[i*stride + k];
+        logz += std::max(-beta*e, 0.0) + std::log1p(std::exp(-beta*std::abs(e)));
+        }
+    return logz;
+}
+
+template <typename lattice_t>
+void batched_chains<lattice_t>::step()
+{
+    std::uniform_int_distribution<> distr(0, n_ - 1);
+    std::uniform_real_distribution<> u(0, 1);
+    proposed_.clear();
+    for (int b=0; b<nchains_; ++b) {
+        auto& rnd = rng_[b];
+        bool flip = u(rnd) < flip_prob_;
+        int* changed = &changed_[2*b];
+        changed[0] = changed[1] = -1;
+        if (!flip) {
+            int to = distr(rnd);
+            dff_[b] = ff_diff_(f_, b, to);
+            f_new_[to*nchains_ + b] = 1 - f_[to*nchains_ + b];
+            dnf_[b] = f_new_[to*nchains_ + b] ? 1 : -1;
+            changed[0] = to;
+            }
+        else if (nf_[b] > 0 && nf_[b] < n_) { // no flips for a completely full or empty configuration
+            int from = distr(rnd); while (!f_[from*nchains_ + b]) from = distr(rnd);
+            int to = distr(rnd); while (f_[to*nchains_ + b]) to = distr(rnd);
+            dff_[b] = ff_diff_(f_, b, from);
+            f_new_[from*nchains_ + b] = 0;
+            dff_[b] += ff_diff_(f_new_, b, to);
+            f_new_[to*nchains_ + b] = 1;
+            dnf_[b] = 0;
+            changed[0] = from;
+            changed[1] = to;
+            }
+        u_accept_[b] = u(rnd);
+        if (changed[0] >= 0) proposed_.push_back(b);
+        }
+
+    diagonalize_(f_new_, proposed_, evals_new_);
+
+    int nproposed = proposed_.size();
+    for (int k=0; k<nproposed; ++k) {
+        int b = proposed_[k];
+        int const* changed = &changed_[2*b];
+        nattempt_++;
+        double logz_new = logz_(evals_new_, k, nproposed);
+        double log_ratio = logz_new - logz_cur_[b] + p_.beta*(p_.mu_f*dnf_[b] - dff_[b]);
+        bool accept = log_ratio >= 0 || u_accept_[b] < std::exp(log_ratio);
+        // only the changed sites are copied, so that f_new_ equals f_ again
+        for (int c=0; c<2 && changed[c] >= 0; ++c) {
+            int i = changed[c]*nchains_ + b;
+            if (accept) f_[i] = f_new_[i]; else f_new_[i] = f_[i];
+            }
+        if (!accept) continue;
+        naccept_++;
+        for (int i=0; i<n_; ++i) evals_[i*nchains_ + b] = evals_new_[i*nproposed + k];
+        logz_cur_[b] = logz_new;
+        ff_cur_[b] += dff_[b];
+        nf_[b] += dnf_[b];
+        }
+}
+
+template <typename lattice_t>
+void batched_chains<lattice_t>::measure()
+{
+    double beta = p_.beta;
+    for (int b=0; b<nchains_; ++b) {
+        observables_t& obs = obs_[b];
+        double e_c = 0.0, d2e = 0.0;
+        for (int i=0; i<n_; ++i) {
+            double e = evals_[i*nchains_ + b], exp_e = std::exp(beta*e);
+            e_c += e / (1.0 + exp_e);
+            d2e += e*e / (1.0 + 0.5*(exp_e + 1./exp_e));
+            }
+        obs.energies.push_back(e_c - p_.mu_f*nf_[b] + ff_cur_[b]);
+        obs.d2energies.push_back(d2e / 2.0);
+        obs.c_energies.push_back(e_c);
+
+        configuration_t::int_array_t f = f_config(b);
+        obs.nf0.push_back(f.sum());
+        obs.nfpi.push_back(std::abs(lattice_.FFT_pi(f)));
+
+        // running average of the spectrum, as in measure_spectrum
+        size_t z = obs.nf0.size() - 1;
+        obs.spectrum.resize(n_, 0.0);
+        for (int i=0; i<n_; ++i) obs.spectrum[i] = (obs.spectrum[i]*z + evals_[i*nchains_ + b])/(z+1);
+
+        if (measure_history_) {
+            obs.spectrum_history.resize(n_);
+            obs.focc_history.resize(n_);
+            for (int i=0; i<n_; ++i) {
+                obs.spectrum_history[i].push_back(evals_[i*nchains_ + b]);
+                obs.focc_history[i].push_back(f(i));
+                }
+            }
+        }
+}
+
+template <typename lattice_t>
+void batched_chains<lattice_t>::run(int ntherm_sweeps, int nsweeps, int sweep_len, size_t max_time)
+{
+    alps::stop_callback stop(max_time);
+    for (int s=0; s<ntherm_sweeps && !stop(); ++s)
+        for (int k=0; k<sweep_len; ++k) step();
+    for (int s=0; s<nsweeps && !stop(); ++s) {
+        for (int k=0; k<sweep_len; ++k) step();
+        measure();
+        }
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_BATCHED_HPP_
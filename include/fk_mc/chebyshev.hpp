@@ -33,13 +33,20 @@ struct chebyshev_eval
             }
     }
 
+    /// Values of a function on the Lobatto grid, to be reused by moment() for all orders
     template <typename F>
-    inline auto moment_f(const F& op, int order) const -> 
-        typename std::remove_reference<typename std::result_of<F(double)>::type>::type { // trapezoidal
+    inline auto grid_values(const F& op) const -> 
+        std::vector<typename std::remove_reference<typename std::result_of<F(double)>::type>::type> {
             typedef typename std::remove_reference<typename std::result_of<F(double)>::type>::type value_type;
             std::vector<value_type> vals(angle_grid.size());
             for (size_t i =0; i<angle_grid.size(); ++i) vals[i] = op(lobatto_grid[i]);
-            return moment(vals, order); 
+            return vals;
+            }
+
+    template <typename F>
+    inline auto moment_f(const F& op, int order) const -> 
+        typename std::remove_reference<typename std::result_of<F(double)>::type>::type { // trapezoidal
+            return moment(grid_values(op), order); 
             }
 
     template <class F>// decltype (std::declval<F>()[0])>
@@ -62,5 +69,15 @@ protected:
     Eigen::MatrixXd chebt_cache;
 };
 
+/// Expansion of sum_i f(x_i) over the spectrum of x from its normalized Chebyshev moments (moments[0] = 1)
+template <typename F>
+inline double trace_f(const chebyshev_eval& cheb, const std::vector<double>& moments, const F& f)
+{
+    std::vector<double> vals = cheb.grid_values(f);
+    double s = cheb.moment(vals, 0);
+    for (int m=1; m<int(moments.size()); m++) s+=2.*cheb.moment(vals, m)*moments[m];
+    return s;
+}
+
 } // end of namespace chebyshev
 } // end of namespace fk
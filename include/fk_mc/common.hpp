@@ -14,10 +14,12 @@
 #include <numeric>
 #include <random>
 #include <alps/params.hpp>
+#include <boost/mpi/collectives.hpp>
+#include "philox.hpp"
 
 namespace fk {
 
-typedef std::mt19937 random_generator;
+typedef alps::philox4x32 random_generator;
 
 //namespace tqa = triqs::arrays;
 
@@ -113,6 +115,21 @@ struct function_traits<std::function<R(Args...)>>
     struct arg { typedef typename std::tuple_element<i, std::tuple<Args...>>::type type; };
 };
 
+/** Gather the history of a measure from all processes on the root, one after another.
+ *  The processes can have different numbers of samples (e.g. the intervals of the expensive measures
+ *  are adapted to the autocorrelation times of each chain). The history is left unchanged on the other processes. */
+template <typename T>
+inline void gather_history(boost::mpi::communicator const& c, std::vector<T>& history, int root = 0)
+{
+    int n = history.size();
+    std::vector<int> sizes;
+    boost::mpi::gather(c, n, sizes, root);
+    if (c.rank() != root) { boost::mpi::gatherv(c, history.data(), n, root); return; }
+    std::vector<T> all(std::accumulate(sizes.begin(), sizes.end(), 0));
+    boost::mpi::gatherv(c, history.data(), n, all.data(), sizes, root);
+    history.swap(all);
+}
+
 }; // end of namespace FK
 
 #endif // endif :: #ifndef __FK_MC_COMMON_H
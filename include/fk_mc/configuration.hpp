@@ -2,6 +2,7 @@
 #define __FK_MC_CONFIGURATION_HPP_
 
 #include <numeric>
+#include <memory>
 
 #include <Eigen/Eigenvalues>
 
@@ -66,22 +67,48 @@ struct configuration_t {
     size_t get_nf() const;
     void randomize_f(random_generator &rnd, size_t nf = 0);
     const sparse_m& calc_hamiltonian();
+    /** Update the diagonal of the hamiltonian on the sites, where f_config_ has changed. Cheaper than calc_hamiltonian for local moves.
+     *  The hamiltonian should be built with calc_hamiltonian before. */
+    const sparse_m& update_hamiltonian(std::vector<size_t> const& sites);
     void reset_cache(){ed_data_.status =  ed_cache::empty; cheb_data_.status = chebyshev_cache::empty;}
 
     void calc_ed(bool calc_evecs = false);
+    /// Recalculate the Boltzmann weights and logZ from the cached spectrum
+    void calc_ed_weights();
     void calc_chebyshev(const chebyshev::chebyshev_eval& cheb);
+    /// Evaluate and return logZ of c-electrons - with Chebyshev moments if cheb is given, otherwise with ED
+    double calc_logz(const chebyshev::chebyshev_eval* cheb = nullptr);
+    /// logZ of c-electrons at a different inverse temperature, reusing the spectrum (or the Chebyshev moments)
+    double logz_at(double beta, const chebyshev::chebyshev_eval* cheb = nullptr);
+    /// Change the parameters. Only the quantities, that depend on the changed parameters, are recalculated.
+    void set_params(config_params const& p);
+    /** Energy of the f-f interaction, E_ff = W_0 nf + sum_{l>0} W_l sum_i n_i sum_{j in shell l of i} n_j,
+     *  with the neighbor shells of the lattice. Cached - recalculated after calc_hamiltonian, updated by update_hamiltonian. */
     double calc_ff_energy() const;
+    /// Change of calc_ff_energy(), if the occupation of site i is flipped. Costs the size of the neighbor shells.
+    double calc_ff_energy_diff(size_t i) const;
+    /// Change of calc_ff_energy(), if the occupations of all (distinct) sites are flipped
+    double calc_ff_energy_diff(std::vector<size_t> const& sites) const;
 
     const config_params& params() const {return params_;}
     const ed_cache& ed_data() const {return ed_data_;}
     const chebyshev_cache& cheb_data() const {return cheb_data_;}
 ///
     const lattice_base& lattice_;
-    const config_params params_;
+    config_params params_;
     int_array_t f_config_;
     sparse_m hamilt_;
     ed_cache ed_data_;
     chebyshev_cache cheb_data_;
+    /// Neighbor shells for the f-f interaction, shared between the copies
+    std::shared_ptr<const lattice_base::neighbor_shells_t> ff_shells_;
+    /// Cached f-f energy, valid if ff_valid_
+    mutable double ff_energy_ = 0.0;
+    mutable bool ff_valid_ = false;
+
+protected:
+    /// Build the neighbor shells, needed for the interactions W
+    void init_ff_shells_();
 };
 
 } // end of namespace fk
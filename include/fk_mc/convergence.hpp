@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/string.hpp>
+
+namespace alps {
+
+/** Online binning analysis of a series : the values are averaged in bins of 2^k for all levels k at once,
+ * keeping only the sums of the bin means and their squares. Memory is O(log n). */
+class online_binning {
+public:
+    void add(double x);
+    long count() const { return levels_.empty() ? 0 : levels_[0].n; }
+    double mean() const { return count() ? levels_[0].sum / levels_[0].n : 0.0; }
+    /// Error of the mean from the bins of level k (bins of 2^k values)
+    double level_error(size_t k) const;
+    /** Error of the mean : the largest error over the levels with at least min_bins bins.
+     *  Grows with k until the bins are longer than the autocorrelation time, so the largest one is the plateau value. */
+    double error(long min_bins = 64) const;
+    /// Integrated autocorrelation time from the ratio of the binned and the naive errors, tau = (err^2 / err_0^2 - 1) / 2
+    double tau(long min_bins = 64) const;
+    void clear() { levels_.clear(); }
+    template <class Archive> void serialize(Archive &ar, const unsigned int version) { ar & levels_; }
+
+protected:
+    struct level {
+        long n = 0;
+        double sum = 0.0;
+        double sum2 = 0.0;
+        /// The first value of the next bin, if it has one
+        double pending = 0.0;
+        bool has_pending = false;
+        template <class Archive> void serialize(Archive &ar, const unsigned int version) { ar & n & sum & sum2 & pending & has_pending; }
+    };
+    std::vector<level> levels_;
+};
+
+/** MSER-5 truncation point of a series (White, Simulation 69, 323 (1997)) : the series is averaged in batches of 5,
+ * and the number of initial values d (a multiple of 5) is chosen in the first half to minimize the squared error of the mean
+ * of the rest, sum_{j>=d} (y_j - mean_d)^2 / (n-d)^2. Returns x.size() if the series is too short (less than 20 batches)
+ * or the minimum is at the end of the first half, i.e. the series has not equilibrated yet. */
+size_t mser_truncation(std::vector<double> const &x, size_t batch = 5);
+
+/** Integrated autocorrelation time tau = 1/2 + sum_t rho(t) of a series, in units of its spacing.
+ * The sum is cut at the smallest window W >= c tau(W) (Sokal's automatic windowing), and at most at a quarter of the series. */
+double integrated_autocorrelation(std::vector<double> const &x, double c = 5.0);
+
+/** A scalar, evaluated after every sweep to decide, when the thermalization is over (MSER on the series since the start)
+ * and when the mean is precise enough (online binning of the measurements). */
+struct convergence_monitor {
+    std::string name;
+    std::function<double()> value;
+    /// Values during the thermalization, cleared, when it ends
+    std::vector<double> therm_series;
+    /// Binning of the values during the measurements
+    online_binning binning;
+    /// Autocorrelation time in sweeps at the end of the thermalization (with the sweep length at that time), 0 if not estimated
+    double tau_therm = 0.0;
+
+    /// Relative error of the mean
+    double rel_error() const;
+    /// Serialization of the state for the checkpoints (the value function is set, when the monitor is registered)
+    template <class Archive> void serialize(Archive &ar, const unsigned int version) { ar & name & therm_series & binning & tau_therm; }
+};
+
+} // end of namespace alps
@@ -6,6 +6,8 @@
 #include "configuration.hpp"
 
 #include <boost/mpi/communicator.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/complex.hpp>
 #include "fk_mc/mc_metropolis.hpp"
 
 namespace fk {
@@ -26,13 +28,38 @@ struct observables_t {
     std::vector<std::vector<std::complex<double>>> nq_history;       // nqpts x n_measures size
     std::vector<std::vector<double>> fsuscq_history;    // nqpts x n_measures size
     std::vector<dense_m> eigenfunctions_history;
+    std::vector<std::vector<double>> kpm_moments_history; // kpm_moments x n_measures size
+    std::vector<std::vector<double>> ldos_log_history;    // dos_npts x n_measures size
+    std::vector<std::vector<double>> ldos_history;        // dos_npts x n_measures size
+    std::vector<std::vector<double>> spectral_moments_history; // (nkpoints * kpm_moments) x n_measures size
+    std::vector<std::vector<double>> recycled_history;  // measure_recycled::nvalues x n_measures size
+    std::vector<double> recycled_spectrum;               // L^D, waste-recycling average
+    std::vector<double> recycled_fcorrel;                // L^D, waste-recycling average of 1/N sum_i n_i n_{i+r}
 
     void merge(observables_t& rhs);
+    /// Swap the contents, keeping the addresses of the members (the measures hold references to them)
+    void swap(observables_t& rhs);
+    /// Serialization for MPI transfers. The eigenfunctions are not transferred.
+    template <class Archive> void serialize(Archive &ar, const unsigned int version);
 
     void reserve(int n); 
     observables_t() = default;
 };
 
+/// Merge the observables of all ranks on rank 0 (collective call)
+observables_t gather_observables(boost::mpi::communicator const& comm, observables_t const& local);
+/// Merge the observables of all ranks on rank 0, averaging the running averages (spectrum, recycled estimators) 
+/// with the number of measurements on each rank - all ranks should have the same parameters (collective call)
+observables_t gather_observables_averaged(boost::mpi::communicator const& comm, observables_t const& local);
+
+template <class Archive> 
+void observables_t::serialize(Archive &ar, const unsigned int version)
+{
+    ar & energies & c_energies & d2energies & nf0 & nfpi & spectrum & spectrum_history & ipr_history & stiffness & cond_history & focc_history
+       & nq_history & fsuscq_history & kpm_moments_history & ldos_log_history & ldos_history & spectral_moments_history
+       & recycled_history & recycled_spectrum & recycled_fcorrel;
+}
+
 template <typename LatticeType>
 class fk_mc : public alps::mc_metropolis //triqs::mc_tools::mc_generic<double> 
 {
@@ -45,6 +72,8 @@ public:
     parameters_t p;
     std::shared_ptr<lattice_type> lattice_ptr;
     std::shared_ptr<configuration_t> config_ptr;
+    /// Chebyshev evaluator, shared by the Chebyshev moves and measures
+    std::shared_ptr<chebyshev::chebyshev_eval> cheb_ptr;
 
     lattice_type const& lattice() const { return *lattice_ptr; }
     configuration_t const& config() const { return *config_ptr; }
@@ -54,14 +83,32 @@ public:
     //template <typename MeasureType> void add_measure(MeasureType&& in, std::string name);
 
     static parameters_t& define_parameters(parameters_t &p);
+    /// Real frequency grid for the dos, defined by dos_width and dos_npts parameters
+    static std::vector<double> dos_grid(parameters_t const& p);
 
     //fk_mc(lattice_type l, parameters_t p, bool randomize_config = true);
     fk_mc(parameters_t const& p, int rank = 0);
     void initialize(lattice_type l, bool randomize_config = true, std::vector<double> wgrid_conductivity = {0.0});//
+    /** Initialize with a lattice and a Chebyshev evaluator, that are shared with other chains - both are only read during the run.
+     *  A new evaluator is made, if cheb is empty and the Chebyshev moves are on. */
+    void initialize(std::shared_ptr<lattice_type> lattice, std::shared_ptr<chebyshev::chebyshev_eval> cheb, bool randomize_config = true, 
+                    std::vector<double> wgrid_conductivity = {0.0});
+    /// Change beta, U, mu_c, mu_f of the configuration (and the parameters) during the run
+    void set_params(config_params const& cp);
+    /// Log of the weight of the current configuration with given parameters, logZ + beta*mu_f*nf - beta*E_ff
+    double log_weight_at(config_params const& cp);
+    /// Replace the f-electron configuration
+    void set_f_config(configuration_t::int_array_t const& f);
 
 
     //void solve(std::vector<double> wgrid_conductivity = {0.0});
     parameters_t& parameters() { return p; } 
+
+protected:
+    /// Save the model parameters, the f-electron configuration and the observables to a checkpoint
+    virtual void save_state(boost::archive::binary_oarchive &ar);
+    /// Restore the f-electron configuration and the observables from a checkpoint, written with the same model parameters
+    virtual void load_state(boost::archive::binary_iarchive &ar);
 };
 
 
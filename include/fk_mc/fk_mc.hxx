@@ -3,14 +3,24 @@
 #include "fk_mc.hpp"
 #include "moves.hpp"
 #include "moves_chebyshev.hpp"
+#include "moves_mtm.hpp"
+#include "moves_delayed.hpp"
+#include "moves_slmc.hpp"
+#include "moves_nfold.hpp"
 #include "measures/energy.hpp"
+#include "measures/energy_cheb.hpp"
 #include "measures/spectrum.hpp"
 #include "measures/spectrum_history.hpp"
 #include "measures/focc_history.hpp"
 #include "measures/fsusc0pi.hpp"
 #include "measures/ipr.hpp"
 #include "measures/stiffness.hpp"
+#include "measures/stiffness_kpm.hpp"
 #include "measures/eigenfunctions.hpp"
+#include "measures/kpm_dos.hpp"
+#include "measures/typical_dos.hpp"
+#include "measures/spectral_function.hpp"
+#include "measures/recycled.hpp"
 
 //#include <triqs/utility/callbacks.hpp>
 
@@ -32,14 +42,17 @@ template <typename L>
 void fk_mc<L>::initialize(lattice_type l, bool randomize_config, std::vector<double> wgrid_conductivity)
     //mc(p) 
 {
-    lattice_ptr = std::make_shared<lattice_type>(l);
-    if (lattice_ptr->ndim() != 1) {
-         config_ptr = std::make_shared<configuration_t> (configuration_t(*lattice_ptr,p["beta"],p["U"],p["mu_c"],p["mu_f"]));
-        }
-    else { 
-         config_ptr = std::make_shared<configuration_t> (configuration_t(*lattice_ptr,p["beta"],p["U"],p["mu_c"],p["mu_f"],p["W"]));
-        }
-    std::cout << "\tRandom seed for proc " << comm.rank() << " : " << p["seed"] << std::endl;
+    initialize(std::make_shared<lattice_type>(l), nullptr, randomize_config, wgrid_conductivity);
+}
+
+template <typename L>
+void fk_mc<L>::initialize(std::shared_ptr<lattice_type> lattice_in, std::shared_ptr<chebyshev::chebyshev_eval> cheb, 
+                          bool randomize_config, std::vector<double> wgrid_conductivity)
+{
+    lattice_ptr = lattice_in;
+    std::vector<double> W = p.exists("W") ? p["W"].as<std::vector<double>>() : std::vector<double>();
+    config_ptr = std::make_shared<configuration_t> (configuration_t(*lattice_ptr,p["beta"],p["U"],p["mu_c"],p["mu_f"],W));
+    std::cout << "\tRandom seed for proc " << comm.rank() << " : " << p["seed"] << ", stream " << this->rng().stream() << std::endl;
     if (randomize_config) config_ptr->randomize_f(this->rng(),p["Nf_start"]);
 
     configuration_t& config = *config_ptr;
@@ -49,10 +62,9 @@ void fk_mc<L>::initialize(lattice_type l, bool randomize_config, std::vector<dou
     double beta = p["beta"];
     config.calc_hamiltonian();
 
-    std::unique_ptr<chebyshev::chebyshev_eval> cheb_ptr;
-
     bool cheb_move = p["cheb_moves"];
-    if (cheb_move) {
+    if (cheb_move && cheb) cheb_ptr = cheb;
+    else if (cheb_move) {
         int cheb_size = int(std::log(lattice.get_msize()) * double(p["cheb_prefactor"]));
         cheb_size+=cheb_size%2;
         size_t ngrid_points = std::max(cheb_size*2,10);
@@ -72,6 +84,31 @@ void fk_mc<L>::initialize(lattice_type l, bool randomize_config, std::vector<dou
         if (!cheb_move) this->add_move(move_randomize(beta, config, this->rng()),  "reshuffle", p["mc_reshuffle"]);
                    else this->add_move(chebyshev::move_randomize(beta, config, *cheb_ptr, this->rng()), "reshuffle", p["mc_reshuffle"]);
         };
+    if (double(p["mc_hop"])>std::numeric_limits<double>::epsilon()) { 
+        if (!cheb_move) this->add_move(move_hop(beta, config, this->rng()), "hop", p["mc_hop"]);
+                   else this->add_move(chebyshev::move_hop(beta, config, *cheb_ptr, this->rng()), "hop", p["mc_hop"]);
+        };
+    if (double(p["mc_mtm_add_remove"])>std::numeric_limits<double>::epsilon()) { 
+        this->add_move(move_mtm(beta, config, cheb_ptr.get(), this->rng(), this->pool(), move_mtm::add_remove, p["mtm_ntries"]), 
+                       "mtm_add_remove", p["mc_mtm_add_remove"]);
+        };
+    if (double(p["mc_mtm_flip"])>std::numeric_limits<double>::epsilon()) { 
+        this->add_move(move_mtm(beta, config, cheb_ptr.get(), this->rng(), this->pool(), move_mtm::flip, p["mtm_ntries"]), 
+                       "mtm_flip", p["mc_mtm_flip"]);
+        };
+    if (double(p["mc_delayed_add_remove"])>std::numeric_limits<double>::epsilon()) { 
+        this->add_move(move_delayed(config, cheb_ptr.get(), this->rng(), move_delayed::add_remove, p["delayed_radius"]), 
+                       "delayed_add_remove", p["mc_delayed_add_remove"]);
+        };
+    if (double(p["mc_delayed_flip"])>std::numeric_limits<double>::epsilon()) { 
+        this->add_move(move_delayed(config, cheb_ptr.get(), this->rng(), move_delayed::flip, p["delayed_radius"]), 
+                       "delayed_flip", p["mc_delayed_flip"]);
+        };
+    if (double(p["mc_slmc"])>std::numeric_limits<double>::epsilon()) { 
+        this->add_move(move_slmc(config, cheb_ptr.get(), this->rng(), p["slmc_nshells"], p["slmc_ntrain"]), 
+                       "slmc", p["mc_slmc"]);
+        };
+    if (bool(p["rejection_free"])) this->set_rejection_free(nfold_addremove(config, this->rng(), this->pool()));
 
     size_t max_bins = p["nsweeps"];
     observables.reserve(max_bins);
@@ -85,7 +122,11 @@ void fk_mc<L>::initialize(lattice_type l, bool randomize_config, std::vector<dou
         }
     if (p["measure_stiffness"]) {
         if (!comm.rank()) std::cout << "Measuring stiffness" << std::endl;
-        this->add_measure(measure_stiffness<lattice_type>(config, lattice, observables.stiffness, observables.cond_history, wgrid_conductivity, p["cond_offset"]),"stiffness");
+        if (!bool(p["kpm_stiffness"])) 
+            this->add_measure(measure_stiffness<lattice_type>(config, lattice, observables.stiffness, observables.cond_history, wgrid_conductivity, p["cond_offset"]),"stiffness", true);
+        else 
+            this->add_measure(measure_stiffness_kpm<lattice_type>(config, lattice, this->rng(), p["kpm_moments"], p["kpm_nrandom"], 
+                              observables.stiffness, observables.cond_history, wgrid_conductivity, p["cond_offset"]),"stiffness", true);
         };
 
     if (p["measure_eigenfunctions"]) {
@@ -93,17 +134,113 @@ void fk_mc<L>::initialize(lattice_type l, bool randomize_config, std::vector<dou
         this->add_measure(measure_eigenfunctions(config,observables.eigenfunctions_history), "eigenfunctions");
         };
 
+    if (p["measure_kpm_dos"]) {
+        if (!comm.rank()) std::cout << "Measuring KPM dos" << std::endl;
+        this->add_measure(measure_kpm_dos(config, this->rng(), p["kpm_moments"], p["kpm_nrandom"], observables.kpm_moments_history), "kpm_dos", true);
+        };
+    if (p["measure_typical_dos"]) {
+        if (!comm.rank()) std::cout << "Measuring typical dos" << std::endl;
+        this->add_measure(measure_typical_dos(config, this->rng(), p["kpm_moments"], p["kpm_nsites"], dos_grid(p), 
+                                              observables.ldos_log_history, observables.ldos_history), "typical_dos", true);
+        };
+    if (p["measure_spectral_function"]) {
+        if (!comm.rank()) std::cout << "Measuring spectral function" << std::endl;
+        auto kpoints = p["spectral_all_k"] ? lattice.get_all_bzpoints() : lattice.get_high_symmetry_path();
+        this->add_measure(measure_spectral_function<lattice_type>(config, lattice, kpoints, p["kpm_moments"], observables.spectral_moments_history), 
+                          "spectral_function", true);
+        };
+
     calc_spectrum = calc_spectrum || p["measure_ipr"];
+    // the dos is obtained from the kpm moments, unless the spectrum history is needed by ipr or eigenfunctions 
+    bool save_spectrum_history = bool(p["measure_history"]) && (!bool(p["measure_kpm_dos"]) || bool(p["measure_ipr"]) || bool(p["measure_eigenfunctions"]));
 
     if (!cheb_move || calc_spectrum) {
         this->add_measure(measure_energy(beta,config,observables.energies, observables.d2energies, observables.c_energies), "energy");
         this->add_measure(measure_spectrum(config,observables.spectrum), "spectrum");
-        if (p["measure_history"]) 
+        if (save_spectrum_history) 
             this->add_measure(measure_spectrum_history(config,observables.spectrum_history), "spectrum_history");
+        }
+    else { 
+        this->add_measure(measure_energy_cheb(beta,config,*cheb_ptr,observables.energies, observables.d2energies, observables.c_energies), "energy");
         };
     if (p["measure_history"]) {
         this->add_measure(measure_focc(config,observables.focc_history), "focc_history");
         };
+    if (p["measure_recycled"]) {
+        if (!comm.rank()) std::cout << "Measuring waste-recycling estimators" << std::endl;
+        this->add_measure(measure_recycled<lattice_type>(config, lattice, !cheb_move, observables.recycled_history, 
+                                                         observables.recycled_spectrum, observables.recycled_fcorrel), "recycled");
+        };
+
+    // the series, that decide on the end of the thermalization and on the error target
+    if (this->monitoring()) {
+        configuration_t* c = config_ptr.get();
+        lattice_type const* l = lattice_ptr.get();
+        this->add_monitor("nf0", [c]() { return double(c->f_config_.sum()); });
+        this->add_monitor("nfpi", [c, l]() { return double(std::abs(l->FFT_pi(c->f_config_))); });
+        if (!cheb_move) this->add_monitor("energy", [c]() { 
+            c->calc_ed(false);
+            auto const& spectrum = c->ed_data().cached_spectrum;
+            auto const& exp_e = c->ed_data().cached_exp;
+            double e = 0.0;
+            for (int i=0; i<spectrum.size(); ++i) e += spectrum(i) / (1.0 + exp_e[i]);
+            return e - c->params().mu_f*c->get_nf() + c->calc_ff_energy();
+            });
+        }
+}
+
+template <typename L>
+void fk_mc<L>::set_params(config_params const& cp)
+{
+    config_ptr->set_params(cp);
+    p["beta"] = cp.beta;
+    p["U"] = cp.U;
+    p["mu_c"] = cp.mu_c;
+    p["mu_f"] = cp.mu_f;
+    this->reset_residence_time();
+}
+
+template <typename L>
+double fk_mc<L>::log_weight_at(config_params const& cp)
+{
+    configuration_t& config = *config_ptr;
+    return config.logz_at(cp.beta, cheb_ptr.get()) + cp.beta*(cp.mu_f*config.get_nf() - config.calc_ff_energy());
+}
+
+template <typename L>
+void fk_mc<L>::set_f_config(configuration_t::int_array_t const& f)
+{
+    if (size_t(f.size()) != lattice_ptr->get_msize()) throw std::logic_error("fk_mc : the f-configuration doesn't match the lattice size");
+    config_ptr->f_config_ = f;
+    config_ptr->calc_hamiltonian();
+    this->reset_residence_time();
+}
+
+template <typename L>
+void fk_mc<L>::save_state(boost::archive::binary_oarchive &ar)
+{
+    config_params const& cp = config_ptr->params();
+    size_t msize = lattice_ptr->get_msize();
+    ar << msize << cp.beta << cp.U << cp.mu_c << cp.mu_f << cp.W;
+    std::vector<int> f(config_ptr->f_config_.data(), config_ptr->f_config_.data() + config_ptr->f_config_.size());
+    ar << f << observables;
+}
+
+template <typename L>
+void fk_mc<L>::load_state(boost::archive::binary_iarchive &ar)
+{
+    size_t msize;
+    config_params cp;
+    ar >> msize >> cp.beta >> cp.U >> cp.mu_c >> cp.mu_f >> cp.W;
+    if (msize != lattice_ptr->get_msize() || !(cp == config_ptr->params()) || cp.W != config_ptr->params().W) 
+        throw std::logic_error("fk_mc : the lattice size or the model parameters differ from the ones in the checkpoint");
+    std::vector<int> f;
+    ar >> f;
+    set_f_config(Eigen::Map<configuration_t::int_array_t>(f.data(), f.size()));
+    // the measures hold references to the members of the observables
+    observables_t obs;
+    ar >> obs;
+    observables.swap(obs);
 }
 
 /*
@@ -155,6 +292,16 @@ void fk_mc<L>::solve(std::vector<double> wgrid_conductivity)
  }
 */
 
+template <typename L>
+std::vector<double> fk_mc<L>::dos_grid(parameters_t const& p) 
+{
+    size_t dos_npts = p["dos_npts"];
+    double dos_width = p["dos_width"];
+    std::vector<double> grid_real(dos_npts); 
+    for (size_t i=0; i<dos_npts; i++) grid_real[i] = -dos_width+2.*dos_width*i/(1.*dos_npts);
+    return grid_real;
+}
+
 template <typename L>
 parameters_t &fk_mc<L>::define_parameters(parameters_type &p) {
    base::define_parameters(p);
@@ -169,9 +316,21 @@ parameters_t &fk_mc<L>::define_parameters(parameters_type &p) {
    p.define<double>("mc_flip", double(0.0), "Make flip moves")
    .define<double>("mc_add_remove", double(1.0), "Make add/remove moves")
    .define<double>("mc_reshuffle", double(0.0), "Make reshuffle moves")
+   .define<double>("mc_hop", double(0.0), "Make moves of f-electrons to nearest neighbors")
+   .define<double>("mc_mtm_add_remove", double(0.0), "Make multiple-try add/remove moves")
+   .define<double>("mc_mtm_flip", double(0.0), "Make multiple-try flip moves")
+   .define<int>("mtm_ntries", int(4), "Number of trials of multiple-try moves (evaluated in parallel with nthreads threads)")
+   .define<double>("mc_delayed_add_remove", double(0.0), "Make add/remove moves with delayed acceptance")
+   .define<double>("mc_delayed_flip", double(0.0), "Make flip moves with delayed acceptance")
+   .define<int>("delayed_radius", int(2), "Radius (in hoppings) of the patch for the surrogate weight of delayed acceptance moves")
+   .define<double>("mc_slmc", double(0.0), "Make self-learning cluster moves")
+   .define<int>("slmc_nshells", int(2), "Number of neighbor shells with pair couplings in the effective model of self-learning moves")
+   .define<int>("slmc_ntrain", int(1000), "Number of configurations to train the effective model of self-learning moves on")
+   .define<bool>("rejection_free", bool(false), "Replace the moves by rejection-free (n-fold way) add/remove updates with ED")
    .define<bool>("cheb_moves", bool(false), "Allow moves using Chebyshev sampling")
    .define<double>("cheb_prefactor", double(2.2), "Prefactor for number of Chebyshev polynomials = #ln(Volume)")
    .define<bool>("measure_history", bool(true), "Measure the history")
+   .define<bool>("measure_recycled", bool(false), "Measure waste-recycling estimators, that include the rejected proposals of the moves")
    //.optional("random_name", std::string(""), "Name of random number generator")
    .define<int>("Nf_start", size_t(5), "Starting number of f-electrons")
    //.define<int>("length_cycle", int(50), "Length of a single QMC cycle")
@@ -181,6 +340,31 @@ parameters_t &fk_mc<L>::define_parameters(parameters_type &p) {
    .define<bool>("measure_eigenfunctions", bool(false), "Measure eigenfunctions")
    .define<double>("cond_offset", double(0.05), "dos offset from the real axis")
    .define<bool>("measure_stiffness", bool(false), "Measure stiffness/conductivity")
+   .define<bool>("kpm_stiffness", bool(false), "Measure stiffness/conductivity with the kernel polynomial method")
+   .define<bool>("measure_kpm_dos", bool(false), "Measure the dos with the kernel polynomial method")
+   .define<int>("kpm_moments", int(256), "Number of Chebyshev moments for kpm measures")
+   .define<int>("kpm_nrandom", int(4), "Number of random vectors for kpm traces (0 = exact trace)")
+   .define<bool>("measure_typical_dos", bool(false), "Measure the typical (geometric average) dos with local kpm moments")
+   .define<int>("kpm_nsites", int(16), "Number of random sites for the local kpm moments")
+   .define<bool>("measure_spectral_function", bool(false), "Measure A(k,w) with the kernel polynomial method")
+   .define<bool>("spectral_all_k", bool(false), "Measure A(k,w) in the whole BZ (otherwise along the high-symmetry path)")
+   .define<bool>("parallel_tempering", bool(false), "Exchange the parameters between the chains of the MPI ranks")
+   .define<std::string>("pt_parameter", "beta", "Parameter of the tempering ladder : beta (geometric ladder) or mu_f (linear ladder)")
+   .define<double>("pt_min", double(1.0), "Smallest value of the tempering ladder")
+   .define<double>("pt_max", double(10.0), "Largest value of the tempering ladder")
+   .define<int>("pt_interval", int(1), "Number of sweeps between the parameter exchanges")
+   .define<bool>("population_annealing", bool(false), "Anneal a population of replicas from pa_beta_start to beta")
+   .define<double>("pa_beta_start", double(0.0), "Starting inverse temperature of population annealing")
+   .define<int>("pa_nsteps", int(16), "Number of temperature steps of population annealing")
+   .define<int>("pa_replicas", int(8), "Number of population annealing replicas per rank")
+   .define<int>("pa_sweeps", int(4), "Number of sweeps of each replica at each temperature step")
+   .define<bool>("shared_therm", bool(false), "Thermalize on shared_therm_ranks ranks only, the other ranks start from their configurations")
+   .define<int>("shared_therm_ranks", int(1), "Number of ranks, that thermalize with shared_therm")
+   .define<int>("shared_decorrelation", int(16), "Number of sweeps, that decorrelate the configuration of a rank from the shared one")
+   .define<int>("chains_per_rank", int(1), "Number of independent chains per rank, run in threads and sharing the lattice")
+   .define<int>("batch_chains", int(0), "Number of add/remove and flip chains per rank, advanced together with batched ED (0 = a single chain)")
+   .define<double>("dos_width", 6.0, "Width of DOS")
+   .define<int>("dos_npts", 240, "Number of points for DOS sampling")
    ;
 
   p["SEED"] = p["seed"];
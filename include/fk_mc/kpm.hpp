@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/SparseCore>
+
+#include "common.hpp"
+#include "lattice.hpp"
+
+namespace fk {
+namespace chebyshev {
+
+/** Kernel polynomial method (KPM) tools.
+ *  Moments are normalized traces mu_m = Tr T_m(x) / N of a hamiltonian x, rescaled to (-1;1) by x = (H - b)/a. */
+
+typedef lattice_base::sparse_m sparse_m;
+
+/// Bounds of the spectrum : e = a*x + b, x in (-1;1)
+struct kpm_bounds {
+    double a; // (e_max - e_min)/2.
+    double b; // (e_max + e_min)/2.
+};
+
+/// Jackson kernel coefficients g_m for m = 0..nmoments-1
+inline std::vector<double> jackson_kernel(int nmoments)
+{
+    std::vector<double> g(nmoments);
+    double q = M_PI / (nmoments + 1);
+    for (int m=0; m<nmoments; ++m)
+        g[m] = ((nmoments - m + 1)*cos(q*m) + sin(q*m)*cos(q)/sin(q)) / (nmoments + 1);
+    return g;
+}
+
+/** Gershgorin bounds for all matrices hopping + diag(d), d_i in [diag_min;diag_max].
+ *  The bounds are fixed for all configurations, so that moments from different measurements can be averaged. */
+inline kpm_bounds gershgorin_bounds(const sparse_m& hopping, double diag_min, double diag_max, double padding = 0.01)
+{
+    double e_min = std::numeric_limits<double>::max(), e_max = -std::numeric_limits<double>::max();
+    Eigen::VectorXd center = Eigen::VectorXd::Zero(hopping.rows()), radius = Eigen::VectorXd::Zero(hopping.rows());
+    for (int k=0; k<hopping.outerSize(); ++k)
+        for (sparse_m::InnerIterator it(hopping,k); it; ++it) {
+            if (it.row() == it.col()) center(it.row()) += it.value();
+            else radius(it.row()) += std::abs(it.value());
+            }
+    for (int i=0; i<hopping.rows(); ++i) {
+        e_min = std::min(e_min, center(i) + diag_min - radius(i));
+        e_max = std::max(e_max, center(i) + diag_max + radius(i));
+        }
+    double a = (e_max - e_min) / 2. * (1. + padding);
+    double b = (e_max + e_min) / 2.;
+    return {a, b};
+}
+
+/// Rescale a hamiltonian to x = (H - b)/a
+inline sparse_m rescale(const sparse_m& h, kpm_bounds const& bounds)
+{
+    sparse_m x = h;
+    for (int i=0; i<x.rows(); ++i) x.coeffRef(i,i)+= -bounds.b; // unoptimized
+    x/=bounds.a;
+    return x;
+}
+
+/** Moments <r_j|T_m(x)|r_j> for each column r_j of r, stored as a (nmoments x ncols) matrix.
+ *  Uses mu_{2n} = 2<a_n|a_n> - mu_0, mu_{2n+1} = 2<a_{n+1}|a_n> - mu_1 to halve the number of matrix-vector products. */
+inline Eigen::MatrixXd kpm_local_moments(const sparse_m& x, int nmoments, const Eigen::MatrixXd& r)
+{
+    Eigen::MatrixXd mu(nmoments, r.cols());
+    Eigen::MatrixXd a0 = r, a1 = x*r, a2;
+    Eigen::RowVectorXd mu0 = r.colwise().squaredNorm(), mu1 = r.cwiseProduct(a1).colwise().sum();
+    mu.row(0) = mu0;
+    if (nmoments > 1) mu.row(1) = mu1;
+    for (int n=1; 2*n<nmoments; ++n) {
+        // a0 = a_{n-1}, a1 = a_n
+        mu.row(2*n) = 2.*a1.colwise().squaredNorm() - mu0;
+        if (2*n+1 < nmoments) {
+            a2 = 2.*(x*a1) - a0;
+            mu.row(2*n+1) = 2.*a2.cwiseProduct(a1).colwise().sum() - mu1;
+            a0.swap(a1); a1.swap(a2);
+            }
+        }
+    return mu;
+}
+
+/// Vectors T_m(x)|v> for m = 0..nmoments-1, stored as columns of a (size x nmoments) matrix
+inline Eigen::MatrixXd chebyshev_vectors(const sparse_m& x, int nmoments, const Eigen::VectorXd& v)
+{
+    Eigen::MatrixXd out(v.size(), nmoments);
+    out.col(0) = v;
+    if (nmoments > 1) out.col(1) = x*v;
+    for (int m=2; m<nmoments; ++m) out.col(m) = 2.*(x*out.col(m-1)) - out.col(m-2);
+    return out;
+}
+
+/// Normalized moments <r|T_m(x)|r> summed over the columns of r and divided by their norm.
+inline std::vector<double> kpm_moments(const sparse_m& x, int nmoments, const Eigen::MatrixXd& r)
+{
+    Eigen::VectorXd mu = kpm_local_moments(x, nmoments, r).rowwise().sum() / r.squaredNorm();
+    return std::vector<double>(mu.data(), mu.data() + mu.size());
+}
+
+/// Random vectors with +-1 entries (Tr A = E <r|A|r>), or the identity if nrandom <= 0 (exact trace)
+template <typename RNG>
+inline Eigen::MatrixXd kpm_random_vectors(int size, int nrandom, RNG& rnd)
+{
+    if (nrandom <= 0) return Eigen::MatrixXd::Identity(size, size);
+    std::bernoulli_distribution coin(0.5);
+    Eigen::MatrixXd r(size, nrandom);
+    for (int j=0; j<nrandom; ++j) for (int i=0; i<size; ++i) r(i,j) = coin(rnd)?1.0:-1.0;
+    return r;
+}
+
+/// Normalized trace moments Tr T_m(x) / N, evaluated stochastically with nrandom vectors (exactly, if nrandom <= 0)
+template <typename RNG>
+inline std::vector<double> kpm_moments(const sparse_m& x, int nmoments, int nrandom, RNG& rnd)
+{
+    return kpm_moments(x, nmoments, kpm_random_vectors(x.rows(), nrandom, rnd));
+}
+
+/// Density of states on a given energy grid from the (kernel-damped) moments.
+inline std::vector<double> kpm_dos(const std::vector<double>& moments, kpm_bounds const& bounds, const std::vector<double>& grid)
+{
+    std::vector<double> dos(grid.size(), 0.0);
+    for (size_t i=0; i<grid.size(); ++i) {
+        double x = (grid[i] - bounds.b) / bounds.a;
+        if (std::abs(x) >= 1.0) continue;
+        // T_m(x) from the recursion
+        double t0 = 1.0, t1 = x, t2;
+        double s = moments[0];
+        for (size_t m=1; m<moments.size(); ++m) {
+            s += 2.*moments[m]*t1;
+            t2 = 2.*x*t1 - t0; t0 = t1; t1 = t2;
+            }
+        dos[i] = s / (M_PI * bounds.a * std::sqrt(1. - x*x));
+        }
+    return dos;
+}
+
+} // end of namespace chebyshev
+} // end of namespace fk
@@ -1,17 +1,24 @@
 #pragma once 
 
 #include "common.hpp"
+#include <algorithm>
 #include <Eigen/SparseCore>
 #include <fftw3.h>
+#include <mutex>
 
 namespace fk {
 
+/// The FFTW planner is not thread-safe : plans are created and destroyed under this lock, fftw_execute needs none
+inline std::mutex& fftw_planner_mutex() { static std::mutex m; return m; }
+
 /** A class to represent a lattice of a finite volume. 
  *  It defines and provides the tight-binding "hopping" matrix in real space.
  */
 struct lattice_base {
     typedef Eigen::MatrixXd dense_m;
     typedef Eigen::SparseMatrix<double> sparse_m;
+    /// shells[l][i] - sites at the distance l+1 from site i
+    typedef std::vector<std::vector<std::vector<size_t>>> neighbor_shells_t;
 
     /// get hopping matrix dimension
     int get_msize() const {return m_size_;}; 
@@ -29,6 +36,10 @@ struct lattice_base {
 
     virtual size_t ndim() const = 0;
 
+    /** Neighbor shells up to a given distance. The distance is the number of hoppings on the graph of the hopping matrix,
+     *  so that it is defined for any lattice (for hypercubic lattices the first shell is given by neighbor_index). */
+    neighbor_shells_t neighbor_shells(int nshells) const;
+
 protected:
     /// Hopping matrix
     sparse_m hopping_m_;
@@ -43,6 +54,29 @@ inline lattice_base::lattice_base(sparse_m in):
     if (hopping_m_.rows() != hopping_m_.cols() || hopping_m_.rows() == 0) FKMC_ERROR << "Failed to initalize lattice. ";
 }
 
+inline lattice_base::neighbor_shells_t lattice_base::neighbor_shells(int nshells) const
+{
+    neighbor_shells_t shells(nshells, std::vector<std::vector<size_t>>(m_size_));
+    // breadth-first search from each site, only the visited sites are reset afterwards
+    std::vector<char> visited(m_size_, 0);
+    for (size_t i=0; i<m_size_; ++i) {
+        std::vector<size_t> front = {i}, all = {i};
+        visited[i] = 1;
+        for (int l=0; l<nshells && !front.empty(); ++l) {
+            std::vector<size_t> next;
+            for (size_t j : front) 
+                for (sparse_m::InnerIterator it(hopping_m_, j); it; ++it) 
+                    if (!visited[it.row()]) { visited[it.row()] = 1; next.push_back(it.row()); }
+            std::sort(next.begin(), next.end());
+            shells[l][i] = next;
+            all.insert(all.end(), next.begin(), next.end());
+            front.swap(next);
+            }
+        for (size_t j : all) visited[j] = 0;
+        }
+    return shells;
+}
+
 }; // end of namespace FK
 
 //#include "lattice/hypercubic.hpp"
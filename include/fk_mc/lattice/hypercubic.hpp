@@ -50,6 +50,10 @@ struct hypercubic_lattice : lattice_base
     BZPoint get_bzpoint(std::array<double, D> in) const;
     BZPoint get_bzpoint(size_t in) const;
     std::vector<BZPoint> get_all_bzpoints() const;
+    /// Points of the discrete BZ along straight lines, connecting the given corners.
+    std::vector<BZPoint> get_bzpath(std::vector<BZPoint> corners) const;
+    /// Path (0,0,..) -> (pi,0,..) -> (pi,pi,..) -> ... -> (pi,pi,...,pi) -> (0,0,..).
+    std::vector<BZPoint> get_high_symmetry_path() const;
 
     static constexpr size_t Ndim = D;
     std::array<int, D> dims;
@@ -77,11 +81,18 @@ M hypercubic_lattice<D>::FFT(M in, int direction) const
     out.setZero();
 
     fftw_plan p;
-    p = fftw_plan_dft(D, dims.data(),
-                         reinterpret_cast<fftw_complex*>( in.data()), 
-                         reinterpret_cast<fftw_complex*>( out.data()), 
-                         direction, FFTW_ESTIMATE); 
+    {
+        std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+        p = fftw_plan_dft(D, dims.data(),
+                             reinterpret_cast<fftw_complex*>( in.data()), 
+                             reinterpret_cast<fftw_complex*>( out.data()), 
+                             direction, FFTW_ESTIMATE); 
+    }
     fftw_execute(p);
+    {
+        std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+        fftw_destroy_plan(p);
+    }
 
     double norm=1.0;
     for (auto x:dims) norm*=x;
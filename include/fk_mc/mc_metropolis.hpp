@@ -4,9 +4,17 @@
 #include <map>
 #include <random>
 #include <memory>
+#include <algorithm>
+#include <chrono>
 
 #include <boost/mpi.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/serialization/map.hpp>
 #include "percent_output.hpp"
+#include "thread_pool.hpp"
+#include "philox.hpp"
+#include "convergence.hpp"
 #include <alps/mc/mcbase.hpp>
 
 namespace alps {
@@ -21,6 +29,12 @@ struct move_wrap {
         attempt_.swap(r.attempt_);
         accept_.swap(r.accept_);
         reject_.swap(r.reject_);
+        propose_.swap(r.propose_);
+        evaluate_.swap(r.evaluate_);
+        clone_.swap(r.clone_);
+        proposed_.swap(r.proposed_);
+        save_state_.swap(r.save_state_);
+        load_state_.swap(r.load_state_);
     };
     move_wrap &operator=(move_wrap &&r);
     move_wrap(move_wrap const &r) = default;
@@ -31,22 +45,68 @@ struct move_wrap {
     mc_weight_t accept() { return accept_(); };
     void reject() { reject_(); };
 
+    /** Moves, that split attempt() into propose() (uses random numbers) and evaluate() (thread-safe, no random numbers), 
+     * can be evaluated speculatively. */
+    bool splittable() const { return bool(propose_); }
+    void propose() { propose_(); }
+    mc_weight_t evaluate() { return evaluate_(); }
+    /// A copy of the move, acting on the same configuration
+    move_wrap clone() const { return clone_(); }
+    template<typename MoveType>
+    MoveType const &cast() const { return *(static_cast<MoveType *>(ptr_.get())); }
+    /** The last proposed state, for the moves that expose it with a proposed() method (nullptr otherwise).
+     * Valid between attempt() and accept()/reject(). */
+    template<typename State>
+    State const *proposed() const { return proposed_ ? static_cast<State const *>(proposed_()) : nullptr; }
+    /// Moves with a serialize(archive, version) method have an internal state, that is saved in the checkpoints
+    bool has_state() const { return bool(save_state_); }
+    void save_state(boost::archive::binary_oarchive &ar) const { save_state_(ar); }
+    void load_state(boost::archive::binary_iarchive &ar) { load_state_(ar); }
+
     std::shared_ptr<void> ptr_;
     std::function<mc_weight_t(void)> attempt_;
     std::function<mc_weight_t(void)> accept_;
     std::function<void(void)> reject_;
+    std::function<void(void)> propose_;
+    std::function<mc_weight_t(void)> evaluate_;
+    std::function<move_wrap(void)> clone_;
+    std::function<void const *(void)> proposed_;
+    std::function<void(boost::archive::binary_oarchive &)> save_state_;
+    std::function<void(boost::archive::binary_iarchive &)> load_state_;
+};
+
+/// Statistics of a move : attempts, accepted attempts and wall time spent in it
+struct move_statistics {
+    long nattempt = 0;
+    long naccept = 0;
+    /// Time in seconds
+    double time = 0.0;
+
+    double acceptance_rate() const { return nattempt ? double(naccept) / nattempt : 0.0; }
+    /// Accepted moves per second
+    double efficiency() const { return time > 0 ? naccept / time : 0.0; }
+    template <class Archive> void serialize(Archive &ar, const unsigned int version) { ar & nattempt & naccept & time; }
 };
 
-/// A wrap structure to make measures in MC. Wraps any class with measure(sign) method.
+/** A wrap structure to make measures in MC. Wraps any class with measure(sign) method.
+ * Measures with a recycle(move, acceptance) method also see every proposal of the moves (waste recycling). */
 struct measure_wrap {
     /// Perform a measurement with a given phase.
     void accumulate(mc_weight_t phase) { accumulate_(phase); };
+    /// Pass a proposal of a move, made from the current configuration, with its acceptance probability
+    void recycle(move_wrap const &move, double acceptance) { recycle_(move, acceptance); }
+    bool recycles() const { return bool(recycle_); }
     //measure_wrap(){};
     measure_wrap(measure_wrap &&r) noexcept {
         ptr_.swap(r.ptr_);
         accumulate_.swap(r.accumulate_);
+        collect_results_.swap(r.collect_results_);
+        recycle_.swap(r.recycle_);
+        save_state_.swap(r.save_state_);
+        load_state_.swap(r.load_state_);
     }
-    measure_wrap(const measure_wrap &r) : ptr_(r.ptr_), accumulate_(r.accumulate_) { };
+    measure_wrap(const measure_wrap &r) : ptr_(r.ptr_), accumulate_(r.accumulate_), collect_results_(r.collect_results_), recycle_(r.recycle_), 
+                                          save_state_(r.save_state_), load_state_(r.load_state_) { };
     template<typename MeasureType, typename = typename std::enable_if<!std::is_convertible<MeasureType, measure_wrap>::value, move_wrap>::type>
     measure_wrap(MeasureType &&in);
     template<typename MeasureType>
@@ -54,11 +114,39 @@ struct measure_wrap {
     template<typename MeasureType>
     MeasureType &cast() { return *(static_cast<MeasureType *>(ptr_.get())); }
 
-    void collect_results(boost::mpi::communicator const &c) { collect_results_(c); } 
+    /// Collect the results over the processes, for the measures with a collect_results(communicator) method
+    void collect_results(boost::mpi::communicator const &c) { if (collect_results_) collect_results_(c); } 
+    /** Measures with a serialize(archive, version) method keep a state besides the observables (e.g. running averages),
+     *  that is saved in the checkpoints */
+    bool has_state() const { return bool(save_state_); }
+    void save_state(boost::archive::binary_oarchive &ar) const { save_state_(ar); }
+    void load_state(boost::archive::binary_iarchive &ar) { load_state_(ar); }
 
     std::shared_ptr<void> ptr_;
     std::function<void(mc_weight_t)> accumulate_;
     std::function<void(boost::mpi::communicator const&)> collect_results_;
+    std::function<void(move_wrap const&, double)> recycle_;
+    std::function<void(boost::archive::binary_oarchive &)> save_state_;
+    std::function<void(boost::archive::binary_iarchive &)> load_state_;
+};
+
+/** A wrap structure for a rejection-free (n-fold way) update scheme. Wraps any class with residence_time() and advance() methods :
+ * residence_time() evaluates the rates of all transitions from the current configuration and returns the expected number of 
+ * Metropolis steps spent in it, advance() makes one of these transitions with the probability proportional to its rate. */
+struct rejection_free_wrap {
+    rejection_free_wrap() = default;
+    template<typename SchemeType, typename = typename std::enable_if<!std::is_convertible<SchemeType, rejection_free_wrap>::value, std::true_type>::type>
+    rejection_free_wrap(SchemeType &&in);
+
+    double residence_time() { return residence_time_(); }
+    void advance() { advance_(); }
+    explicit operator bool() const { return bool(ptr_); }
+    template<typename SchemeType>
+    SchemeType const &cast() const { return *(static_cast<SchemeType *>(ptr_.get())); }
+
+    std::shared_ptr<void> ptr_;
+    std::function<double(void)> residence_time_;
+    std::function<void(void)> advance_;
 };
 
 /** mc_metropolis is a TRIQS-inspired MC adapter for ALPSCore. 
@@ -67,31 +155,88 @@ struct measure_wrap {
 struct mc_metropolis : public alps::mcbase {
 
     typedef alps::mcbase::observable_collection_type observable_collection_type;
-    typedef std::mt19937 random_generator;
+    typedef philox4x32 random_generator;
     /// Register a move.
     template<typename Move_t>
     bool add_move(Move_t &&move, std::string name, double move_prob = 1.0);
-    /// Register a measure.
+    /** Register a measure. The expensive measures are done every expensive_skip sweeps 
+     *  (or about once per autocorrelation time, see set_skip_from_tau()). */
     template<typename Measure_t>
-    bool add_measure(Measure_t &&measure, std::string name);
+    bool add_measure(Measure_t &&measure, std::string name, bool expensive = false);
+    /// Register a rejection-free update scheme. It replaces the moves in update().
+    template<typename Scheme_t>
+    void set_rejection_free(Scheme_t &&scheme);
+
+    /** Register a scalar, evaluated after every sweep, if the automatic thermalization (auto_therm) 
+     *  or the error target (target_rel_error) are on. All monitors have to converge. */
+    void add_monitor(std::string name, std::function<double()> value);
+    /// True if the monitors are evaluated
+    bool monitoring() const { return auto_therm_ || target_rel_error_ > 0 || adapt_sweep_len_ || expensive_skip_ == 0; }
+    std::vector<convergence_monitor> const &monitors() const { return monitors_; }
+    /// Number of the thermalization sweeps - shorter than ntherm_sweeps, if the thermalization was ended automatically
+    long thermalization_sweeps() const { return thermalization_sweeps_; }
+    /// Change the number of the thermalization sweeps (before the run)
+    void set_thermalization_sweeps(long n) { thermalization_sweeps_ = n; }
+    /// True, when the thermalization sweeps are done
+    bool thermalized() const { return measure_count_ >= thermalization_sweeps_; }
+    /// Number of moves in a sweep - changed after the thermalization by adapt_sweep_len
+    long sweep_len() const { return sweep_len_; }
+    /// The measures, that are done every few sweeps, and their intervals in sweeps
+    std::map<std::string, long> const &measure_skips() const { return measure_skip_; }
+
+    /** Write the state of the chain to a file : the random generator, the counters, the move weights and statistics, 
+     *  the monitors, the states of the moves and the measures, and the state of the derived class (see save_state). 
+     *  The file is written next to the target and renamed, so that an interrupted write keeps the previous checkpoint. */
+    void save_checkpoint(std::string const &file);
+    /** Continue the chain from a checkpoint. The moves, the measures and the monitors have to be registered 
+     *  in the same way, as in the chain, that wrote it. */
+    void load_checkpoint(std::string const &file);
+    /// Checkpoint file of this chain (checkpoint parameter + "." + rank), empty if the checkpoints are off
+    std::string const &checkpoint_file() const { return checkpoint_file_; }
+    /// Write the checkpoint of this chain, if the checkpoints are on
+    void checkpoint() { if (!checkpoint_file_.empty()) save_checkpoint(checkpoint_file_); }
 
     /// Define used parameters
     static parameters_type &define_parameters(parameters_type &p);
-    /// Constructor from alps::params and random seed offset (typically an MPI rank). Rank = 0 outputs the progress.
+    /// Constructor from alps::params and the random stream (typically an MPI rank). Rank = 0 outputs the progress.
     mc_metropolis(parameters_type const &p, int rank = 0);
 
     /// Perform an update - do sweep_len_ moves.
     virtual void update();
-    /// Perform all measures. 
+    /** Do sweep_len_ moves, evaluating up to nspeculative_ subsequent proposals in parallel, assuming that the previous ones are rejected. 
+     * The results are committed in order, so the chain is identical to the one from update(). */
+    void update_speculative();
+    /// Update with one move at a time
+    void update_sequential();
+    /** Rejection-free update. The time is counted in Metropolis steps : every transition takes the residence time
+     *  of the configuration, and a sweep ends in the configuration, that is occupied after sweep_len steps. 
+     *  The measurements are thus done at equal time intervals and need no extra weights. */
+    void update_rejection_free();
+    /// Perform all measures. Writes the checkpoint, if checkpoint_interval seconds passed since the last one.
     void measure();
     /// Return an estimate for a completed number of sweeps. Output progress
     double fraction_completed() const;
+    /// True, when the thermalization and the measurement sweeps are done
+    bool sweeps_done() const { return sweep_count_ >= measure_sweeps_ + thermalization_sweeps_; }
+    /// Number of sweeps between the convergence checks
+    long convergence_interval() const { return convergence_interval_; }
+    /** Decide, whether the chains of all ranks of c are completed (collective call, the same number of times on every rank) : 
+     *  the sweeps of all chains are done, or stop is true on rank 0, or the error of the combined mean of every monitor 
+     *  is below target_rel_error. The inverse squared errors of independent chains add up as their numbers of measurements, 
+     *  so the progress (target / error)^2 of the combined mean is the sum of the ones of the chains. */
+    static bool completed_together(boost::mpi::communicator const &c, std::vector<mc_metropolis *> const &chains, bool stop);
+    using alps::mcbase::run;
+    /** Run the chain of this rank, until the chains of all ranks of c are completed together (see completed_together), 
+     *  which is checked every convergence_interval sweeps. stop is evaluated on rank 0. A rank, that has done its sweeps, waits for the others. */
+    void run(std::function<bool()> const &stop, boost::mpi::communicator const &c);
     /// Return acceptance rate. 
-    double acceptance_rate() const { return double(naccept_) / double(sweep_count_ * sweep_len_); }
+    double acceptance_rate() const { return nsteps_ ? double(naccept_) / double(nsteps_) : 0.0; }
     /// Return observables
     observable_collection_type &observables() { return measurements; };
     /// Return random generator
     random_generator &rng() { return random; }
+    /// Return the thread pool, shared by the moves that evaluate several configurations at once
+    thread_pool &pool() { return *pool_; }
 
     void collect_results(boost::mpi::communicator const &c);
 
@@ -100,6 +245,22 @@ struct mc_metropolis : public alps::mcbase {
             out << "move : " << move_names_[i] << ", weight = " << move_probs_[i] << std::endl;
         };
     }
+    /// Print the weights and the statistics of the moves, e.g. the ones from collect_move_stats
+    void print_move_stats(std::vector<move_statistics> const &stats, std::ostream &out = std::cout) const {
+        for (int i = 0; i < moves_.size(); i++) {
+            out << "move : " << move_names_[i] << ", weight = " << move_probs_[i] << ", attempts = " << stats[i].nattempt 
+                << ", acceptance = " << stats[i].acceptance_rate() << ", accepted per second = " << stats[i].efficiency() << std::endl;
+        };
+    }
+
+    std::vector<std::string> const &move_names() const { return move_names_; }
+    std::vector<double> const &move_weights() const { return move_probs_; }
+    /// Statistics of the moves of this process
+    std::vector<move_statistics> const &move_stats() const { return move_stats_; }
+    /// Statistics of the moves, summed over all processes on rank 0 (collective call)
+    std::vector<move_statistics> collect_move_stats(boost::mpi::communicator const &c) const { return reduce_move_stats(c, move_stats_); }
+    /// Given statistics of the moves, summed over all processes on rank 0 (collective call)
+    static std::vector<move_statistics> reduce_move_stats(boost::mpi::communicator const &c, std::vector<move_statistics> const &local);
 
     template<typename MeasureType>
     MeasureType const &extract_measurement(std::string name) const {
@@ -108,22 +269,98 @@ struct mc_metropolis : public alps::mcbase {
         return it->second.cast<MeasureType>();
     }
 
+    template<typename SchemeType>
+    SchemeType const &extract_rejection_free() const { return rejection_free_.cast<SchemeType>(); }
+
+    template<typename MoveType>
+    MoveType const &extract_move(std::string name) const {
+        auto it = std::find(move_names_.begin(), move_names_.end(), name);
+        if (it == move_names_.end()) throw std::logic_error("mc_metropolis : can not extract nonexistent move " + name);
+        return moves_[it - move_names_.begin()].cast<MoveType>();
+    }
+
 protected:
+    /// Save the state of the derived class to a checkpoint
+    virtual void save_state(boost::archive::binary_oarchive &ar) {}
+    /// Restore the state of the derived class from a checkpoint
+    virtual void load_state(boost::archive::binary_iarchive &ar) {}
+    /// Checkpoint file, empty if the checkpoints are off
+    std::string checkpoint_file_;
+    /// Interval between the checkpoints, written during the run
+    std::chrono::seconds checkpoint_interval_;
+    /// Time of the next checkpoint
+    std::chrono::steady_clock::time_point next_checkpoint_;
+
     /// Vector of moves.
     std::vector<move_wrap> moves_;
     /// Vector of names of moves.
     std::vector<std::string> move_names_;
     /// Vector of move probability
     std::vector<double> move_probs_;
+    /// Vector of move statistics
+    std::vector<move_statistics> move_stats_;
+    /// Retune the move weights during the thermalization (adapt_moves parameter)
+    bool adapt_moves_ = false;
+    /// Number of sweeps between the adaptations of the move weights
+    long adapt_interval_ = 16;
+    /// Minimal fraction of each move after the adaptation
+    double adapt_min_weight_ = 0.05;
+    /// End the thermalization, when all monitors pass the MSER test (auto_therm parameter)
+    bool auto_therm_ = false;
+    /// Stop, when the relative errors of all monitors are below it (0 = off)
+    double target_rel_error_ = 0.0;
+    /// Number of sweeps between the convergence checks
+    long convergence_interval_ = 64;
+    std::vector<convergence_monitor> monitors_;
+    /// Fraction of the error target reached, (target / error)^2 for the worst monitor
+    double error_progress_ = 0.0;
+    /// The same for the combined means of the chains of all ranks, set by completed_together
+    double combined_progress_ = 0.0;
+    /// (target / error)^2 for a monitor, 0 before 2 convergence intervals of measurements
+    double error_progress(convergence_monitor const &m) const;
+    /** Set sweep_len_ after the thermalization from the autocorrelation times of the monitors (in sweeps), 
+     *  so that the fastest one decorrelates in about one sweep */
+    bool adapt_sweep_len_ = false;
+    /// Interval of the expensive measures in sweeps (0 = from the autocorrelation time of the slowest monitor)
+    long expensive_skip_ = 1;
+    /// Names of the expensive measures
+    std::vector<std::string> expensive_measures_;
+    /// Intervals of the measures, that are not done every sweep
+    std::map<std::string, long> measure_skip_;
+    /// Evaluate the monitors after a sweep and check the convergence
+    void monitor_convergence();
+    /// Estimate the autocorrelation times from the thermalization series, adapt the sweep and the measure intervals
+    void end_thermalization();
+    /** Set the move weights proportional to the accepted moves per second. The moves without statistics keep their share,
+     *  every move keeps at least adapt_min_weight_ of the total, so that the update stays ergodic. */
+    void adapt_move_weights();
     /// Map between the name of the measure and the measure
     std::map<std::string, measure_wrap> measures_;
+    /// True if any measure recycles the proposals
+    bool recycling_ = false;
+    /** Pass a proposal with its weight to the recycling measures. Called before the proposal is accepted or rejected,
+     *  except during the thermalization. The rejection-free update does not recycle. */
+    void recycle_proposal(move_wrap const &move, mc_weight_t weight);
 
-    /** Random generator - superseeds alps::random01. Should be removed as soon as alps adopts standard generator. */
+    /** Random generator - superseeds alps::random01. Should be removed as soon as alps adopts standard generator.
+     *  The stream is given by the rank, so that every chain has an independent sequence for the same seed. */
     // has to overwrite name of alps random generator, so name 'random' is used.
     random_generator random;
 
     /// Rank of the process - taken from the constructor
     int rank_;
+    /// Worker threads of this process (nthreads parameter)
+    std::shared_ptr<thread_pool> pool_;
+    /// Number of proposals, evaluated speculatively at once (0 or 1 = sequential update)
+    long nspeculative_ = 0;
+    /// Copies of the moves for each speculative slot
+    std::vector<std::vector<move_wrap>> spec_moves_;
+    /// Rejection-free update scheme, if registered
+    rejection_free_wrap rejection_free_;
+    /// Time left in the current configuration (negative, if it has to be recalculated)
+    double residence_left_ = -1.0;
+    /// Recalculate the residence time - to be called, if the configuration is changed outside of the update
+    void reset_residence_time() { residence_left_ = -1.0; }
 
     /// Total number of sweeps to make
     long measure_sweeps_ = 1000;
@@ -137,6 +374,8 @@ protected:
     long measure_count_ = 0;
     /// Count accepted moves
     long naccept_ = 0;
+    /// Count all steps (sweep_len_ can change during the run)
+    long nsteps_ = 0;
     /// Distribution to choose the move, based on it's weight assigned when adding a move
     std::discrete_distribution<> move_distrib_;
     /// Metropolis distribution
@@ -149,6 +388,31 @@ protected:
 };
 
 
+namespace detail {
+/// Bind the state serialization of the moves and the measures, that have a serialize method
+template <typename T, typename Wrap>
+auto bind_state(T *m, Wrap &w, int) -> decltype(m->serialize(std::declval<boost::archive::binary_oarchive&>(), 0u), void()) {
+    w.save_state_ = [m](boost::archive::binary_oarchive &ar) { m->serialize(ar, 0u); };
+    w.load_state_ = [m](boost::archive::binary_iarchive &ar) { m->serialize(ar, 0u); };
+}
+template <typename T, typename Wrap>
+void bind_state(T *, Wrap &, long) {}
+/// Bind recycle of the measures, that have it
+template <typename MeasureType>
+auto bind_recycle(MeasureType *m, measure_wrap &w, int) -> decltype(m->recycle(std::declval<move_wrap const&>(), 1.0), void()) {
+    w.recycle_ = [m](move_wrap const &move, double a) { m->recycle(move, a); };
+}
+template <typename MeasureType>
+void bind_recycle(MeasureType *, measure_wrap &, long) {}
+/// Bind collect_results of the measures, that have it
+template <typename MeasureType>
+auto bind_collect_results(MeasureType *m, measure_wrap &w, int) -> decltype(m->collect_results(std::declval<boost::mpi::communicator const&>()), void()) {
+    w.collect_results_ = [m](boost::mpi::communicator const &c) { m->collect_results(c); };
+}
+template <typename MeasureType>
+void bind_collect_results(MeasureType *, measure_wrap &, long) {}
+}
+
 template<typename MeasureType, typename>
 //measure_wrap::measure_wrap(typename std::remove_reference<MeasureType>::type &&in) {
 measure_wrap::measure_wrap(MeasureType &&in) {
@@ -156,6 +420,37 @@ measure_wrap::measure_wrap(MeasureType &&in) {
     m_type *m = new m_type(std::forward<MeasureType>(in));
     ptr_.reset(m);
     accumulate_ = [m](mc_weight_t p) { m->accumulate(p); };
+    detail::bind_recycle(m, *this, 0);
+    detail::bind_collect_results(m, *this, 0);
+    detail::bind_state(m, *this, 0);
+}
+
+template<typename SchemeType, typename>
+rejection_free_wrap::rejection_free_wrap(SchemeType &&in) {
+    typedef typename std::remove_reference<SchemeType>::type s_type;
+    s_type *s = new s_type(std::forward<SchemeType>(in));
+    ptr_.reset(s);
+    residence_time_ = [s]() { return s->residence_time(); };
+    advance_ = [s]() { s->advance(); };
+}
+
+namespace detail {
+/// Bind propose/evaluate/clone of the moves, that have them
+template <typename MoveType>
+auto bind_split_move(MoveType *m, move_wrap &w, int) -> decltype(m->propose(), m->evaluate(), void()) {
+    w.propose_ = [m]() { m->propose(); };
+    w.evaluate_ = [m]() { return m->evaluate(); };
+    w.clone_ = [m]() { return move_wrap(MoveType(*m)); };
+}
+template <typename MoveType>
+void bind_split_move(MoveType *, move_wrap &, long) {}
+/// Bind proposed() of the moves, that have it
+template <typename MoveType>
+auto bind_proposed(MoveType *m, move_wrap &w, int) -> decltype(m->proposed(), void()) {
+    w.proposed_ = [m]() { return static_cast<void const *>(&m->proposed()); };
+}
+template <typename MoveType>
+void bind_proposed(MoveType *, move_wrap &, long) {}
 }
 
 template<typename MoveType, typename>
@@ -171,6 +466,9 @@ move_wrap::move_wrap(MoveType &&in) {
     attempt_ = [m, this]() { return m->attempt(); };
     accept_ = [m, this]() { return m->accept(); };
     reject_ = [m, this]() { m->reject(); };
+    detail::bind_split_move(m, *this, 0);
+    detail::bind_proposed(m, *this, 0);
+    detail::bind_state(m, *this, 0);
 }
 
 template<typename Move_t>
@@ -178,16 +476,25 @@ bool mc_metropolis::add_move(Move_t &&move, std::string name, double move_prob)
     moves_.emplace_back(std::forward<Move_t>(move));
     move_names_.emplace_back(name);
     move_probs_.emplace_back(move_prob);
+    move_stats_.emplace_back();
     move_distrib_ = std::discrete_distribution<>(move_probs_.begin(), move_probs_.end());
     return true;
 };
 
+template<typename Scheme_t>
+void mc_metropolis::set_rejection_free(Scheme_t &&scheme) {
+    rejection_free_ = rejection_free_wrap(std::forward<Scheme_t>(scheme));
+    reset_residence_time();
+};
+
 template<typename Measure_t>
-bool mc_metropolis::add_measure(Measure_t &&measure, std::string name) {
+bool mc_metropolis::add_measure(Measure_t &&measure, std::string name, bool expensive) {
+    if (expensive) expensive_measures_.push_back(name);
 //#ifdef BOLD_HYB_INTEL_BUGFIX
 //    measures_.insert(std::make_pair(name, measure_wrap(std::forward<Measure_t>(measure))));
 //#else
-    measures_.emplace(std::forward<std::string>(name), std::forward<Measure_t>(measure));
+    auto it = measures_.emplace(std::forward<std::string>(name), std::forward<Measure_t>(measure)).first;
+    recycling_ = recycling_ || it->second.recycles();
 //#endif
     return true;
 };
@@ -25,7 +25,8 @@ struct measure_energy {
  
     void accumulate(double sign);
     void collect_results(boost::mpi::communicator const &c);
-
+    /// The sums for the totals are kept in the checkpoints
+    template <class Archive> void serialize(Archive &ar, const unsigned int version) { ar & _Z & _average_energy & _average_d2energy; }
 };
 
 } // end of namespace fk
@@ -0,0 +1,21 @@
+#ifndef __FK_MC_MEASURE_ENERGY_CHEB_HPP_
+#define __FK_MC_MEASURE_ENERGY_CHEB_HPP_
+
+#include "energy.hpp"
+
+namespace fk {
+
+/// Energy and d2energy evaluated by projecting on the Chebyshev moments of the configuration - no diagonalization required.
+struct measure_energy_cheb : measure_energy {
+    const chebyshev::chebyshev_eval& cheb_;
+
+    measure_energy_cheb(double beta, configuration_t& in, const chebyshev::chebyshev_eval& cheb, 
+                        std::vector<double>& energies, std::vector<double>& d2energies, std::vector<double>& c_energies):
+        measure_energy(beta, in, energies, d2energies, c_energies), cheb_(cheb){};
+ 
+    void accumulate(double sign);
+};
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_MEASURE_ENERGY_CHEB_HPP_
@@ -51,17 +51,8 @@ void measure_nf0pi<lattice_t>::collect_results(boost::mpi::communicator const &c
     boost::mpi::reduce(c, average_nf0_, nf0_aver, std::plus<double>(), 0);
     boost::mpi::reduce(c, average_nfpi_, nfpi_aver, std::plus<double>(), 0);
 
-    size_t datasize = n0_.size()*c.size();
-    std::vector<double> tmp(datasize);
-
-    boost::mpi::gather(c, n0_.data(), n0_.size(), tmp, 0);
-    n0_.swap(tmp);
-    c.barrier();
-
-    tmp.resize(datasize);
-    boost::mpi::gather(c, npi_.data(), npi_.size(), tmp, 0);
-    npi_.swap(tmp);
-    c.barrier();
+    gather_history(c, n0_);
+    gather_history(c, npi_);
     
     if (c.rank() == 0) {
         std::cout << "Average nf(q=0): " << nf0_aver / sum_Z << std::endl;
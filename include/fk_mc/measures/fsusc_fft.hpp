@@ -67,15 +67,9 @@ void measure_fsusc<lattice_t>::collect_results(boost::mpi::communicator const &c
     int sum_Z;
     boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
     INFO("F-electron susc and occ number : " << sum_Z << " measures.");
-    std::vector<std::complex<double>> nq_history;
-    std::vector<double> fsuscq_history;
     for (size_t i=0; i<fsuscq_history_.size(); ++i) {
-        fsuscq_history.resize(fsuscq_history_[i].size()*c.size());
-        nq_history.resize(nq_history_[i].size()*c.size());
-        boost::mpi::gather(c, fsuscq_history_[i].data(), fsuscq_history_[i].size(), fsuscq_history, 0);
-        boost::mpi::gather(c, nq_history_[i].data(), nq_history_[i].size(), nq_history, 0);
-        fsuscq_history_[i].swap(fsuscq_history);
-        nq_history_[i].swap(nq_history);
+        gather_history(c, fsuscq_history_[i]);
+        gather_history(c, nq_history_[i]);
         };
 }
 
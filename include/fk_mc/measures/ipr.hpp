@@ -59,12 +59,7 @@ void measure_ipr<lattice_t>::collect_results(boost::mpi::communicator const &c)
 {
     int sum_Z;
     boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
-    std::vector<double> current_ipr;
-    for (size_t i=0; i<ipr_vals_.size(); ++i) {
-        current_ipr.resize(ipr_vals_[i].size()*c.size());
-        boost::mpi::gather(c, ipr_vals_[i].data(), ipr_vals_[i].size(), current_ipr, 0);
-        ipr_vals_[i].swap(current_ipr);
-        };
+    for (size_t i=0; i<ipr_vals_.size(); ++i) gather_history(c, ipr_vals_[i]);
 }
 
 } // end of namespace fk
@@ -0,0 +1,38 @@
+#ifndef __FK_MC_MEASURE_KPM_DOS_HPP_
+#define __FK_MC_MEASURE_KPM_DOS_HPP_
+
+#include "../common.hpp"
+#include "../configuration.hpp"
+#include "../kpm.hpp"
+#include <boost/mpi/collectives.hpp>
+
+namespace fk {
+
+/** Kernel-damped Chebyshev moments of the density of states for each measurement. 
+ *  The dos is reconstructed from the moments at save time, see chebyshev::kpm_dos. */
+struct measure_kpm_dos {
+    configuration_t& config;
+    random_generator& rnd_;
+    int nmoments_;
+    int nrandom_;
+    /// Spectrum bounds, common for all configurations
+    chebyshev::kpm_bounds bounds_;
+    /// Jackson kernel
+    std::vector<double> kernel_;
+
+    int _Z = 0.0;
+    std::vector<std::vector<double>>& _moments_history; // nmoments x n_measures size
+
+    measure_kpm_dos(configuration_t& in, random_generator& rnd, int nmoments, int nrandom, std::vector<std::vector<double>>& moments_history);
+ 
+    void accumulate(double sign);
+    void collect_results(boost::mpi::communicator const &c);
+
+    chebyshev::kpm_bounds const& bounds() const { return bounds_; }
+    /// Bounds of the spectrum of all configurations of the FK model
+    static chebyshev::kpm_bounds spectrum_bounds(const configuration_t& config);
+};
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_MEASURE_KPM_DOS_HPP_
@@ -0,0 +1,178 @@
+#ifndef __FK_MC_MEASURE_RECYCLED_HPP_
+#define __FK_MC_MEASURE_RECYCLED_HPP_
+
+#include <array>
+
+#include "../common.hpp"
+#include "../configuration.hpp"
+#include "../mc_metropolis.hpp"
+#include <boost/mpi/collectives.hpp>
+
+namespace fk {
+
+/** Waste-recycling (improved) estimators.
+ * At every Metropolis step the observables of the current and of the proposed configuration are added with the weights 1-a and a,
+ * where a is the acceptance probability of the proposal, so that the rejected proposals contribute as well.
+ * The average over the steps of a sweep is stored at each measurement, one series per moment - the fluctuations
+ * are obtained from the averaged moments, not from the squares of the series.
+ * Moves without proposed() contribute the current configuration only.
+ * The energy and the spectrum need the spectra of the proposals, i.e. ED moves.
+ * The f-f correlation function is averaged over all lattice translations, C(r) = 1/N sum_i <n_i n_{i+r}>. */
+template <typename lattice_t>
+struct measure_recycled {
+    typedef typename configuration_t::real_array_t  real_array_t;
+    /// Rows of the history
+    enum value_t { energy, energy2, d2energy, nf0, nf0_2, nf0_4, nfpi, nfpi_2, nfpi_4, nvalues };
+
+    configuration_t& config_;
+    const lattice_t& lattice_;
+    /// Measure the energy and the spectrum
+    bool use_ed_;
+
+    int _Z = 0;
+    std::vector<std::vector<double>>& history_; // nvalues x n_measures
+    std::vector<double>& spectrum_;             // L^D
+    std::vector<double>& fcorrel_;              // L^D
+
+    measure_recycled(configuration_t& in, const lattice_t& lattice, bool use_ed, std::vector<std::vector<double>>& history,
+                     std::vector<double>& spectrum, std::vector<double>& fcorrel);
+
+    void recycle(alps::move_wrap const& move, double acceptance);
+    void accumulate(double sign);
+    void collect_results(boost::mpi::communicator const &c);
+    /// The running averages are kept in the checkpoints - the sums over the proposals are empty between the sweeps
+    template <class Archive> void serialize(Archive &ar, const unsigned int version);
+
+protected:
+    /// Add the observables of the configuration c with the weight w
+    void add_(configuration_t const& c, double w);
+
+    std::array<double, nvalues> sums_;
+    real_array_t spectrum_sum_;
+    /// |n(q)|^2, summed over the steps of the sweep
+    real_array_t sq_sum_;
+    /// |n(q)|^2, averaged over the measurements
+    real_array_t sq_average_;
+    double steps_ = 0.0;
+};
+
+template <typename lattice_t>
+measure_recycled<lattice_t>::measure_recycled(configuration_t& in, const lattice_t& lattice, bool use_ed,
+                                              std::vector<std::vector<double>>& history, std::vector<double>& spectrum, std::vector<double>& fcorrel):
+    config_(in), lattice_(lattice), use_ed_(use_ed), history_(history), spectrum_(spectrum), fcorrel_(fcorrel)
+{
+    size_t msize = lattice_.get_msize();
+    sums_.fill(0.0);
+    spectrum_sum_ = real_array_t::Zero(msize);
+    sq_sum_ = real_array_t::Zero(msize);
+    sq_average_ = real_array_t::Zero(msize);
+    history_.resize(nvalues);
+    if (use_ed_) spectrum_.resize(msize, 0.0);
+    fcorrel_.resize(msize, 0.0);
+}
+
+template <typename lattice_t>
+void measure_recycled<lattice_t>::add_(configuration_t const& c, double w)
+{
+    if (use_ed_) {
+        // the proposals of ED moves carry their spectrum, the others have to be diagonalized
+        std::unique_ptr<configuration_t> c_ed;
+        if (c.ed_data().status == ed_cache::empty) { c_ed.reset(new configuration_t(c)); c_ed->calc_ed(false); }
+        configuration_t const& ce = c_ed ? *c_ed : c;
+        const auto& spectrum = ce.ed_data().cached_spectrum;
+        const auto& exp_e = ce.ed_data().cached_exp;
+        double e_c = 0.0, d2e = 0.0;
+        for (int i=0; i<spectrum.size(); ++i) {
+            e_c += spectrum(i) / (1.0+exp_e[i]);
+            d2e += spectrum(i)*spectrum(i) / (1.0+0.5*(exp_e[i] + 1./exp_e[i]));
+            }
+        double e = e_c - ce.params().mu_f*ce.get_nf() + ce.calc_ff_energy();
+        sums_[energy] += w*e;
+        sums_[energy2] += w*e*e;
+        sums_[d2energy] += w*d2e/2.0;
+        spectrum_sum_ += w*spectrum;
+        }
+
+    double n0 = c.f_config_.sum();
+    double npi = std::abs(lattice_.FFT_pi(c.f_config_));
+    sums_[nf0] += w*n0;
+    sums_[nf0_2] += w*n0*n0;
+    sums_[nf0_4] += w*n0*n0*n0*n0;
+    sums_[nfpi] += w*npi;
+    sums_[nfpi_2] += w*npi*npi;
+    sums_[nfpi_4] += w*npi*npi*npi*npi;
+
+    Eigen::ArrayXcd nf_in = c.f_config_.template cast<std::complex<double>>();
+    Eigen::ArrayXcd nq = lattice_.FFT(nf_in, FFTW_FORWARD);
+    sq_sum_ += w*nq.abs2();
+}
+
+template <typename lattice_t>
+void measure_recycled<lattice_t>::recycle(alps::move_wrap const& move, double acceptance)
+{
+    configuration_t const* proposed = move.proposed<configuration_t>();
+    if (!proposed) acceptance = 0.0;
+    if (use_ed_) config_.calc_ed(false);
+    if (acceptance < 1.0) add_(config_, 1.0 - acceptance);
+    if (acceptance > 0.0) add_(*proposed, acceptance);
+    steps_ += 1.0;
+}
+
+template <typename lattice_t>
+void measure_recycled<lattice_t>::accumulate(double sign)
+{
+    // no proposals since the last measurement (e.g. a rejection-free update) - use the current configuration
+    if (steps_ == 0.0) {
+        if (use_ed_) config_.calc_ed(false);
+        add_(config_, 1.0);
+        steps_ = 1.0;
+        }
+
+    for (int v=0; v<nvalues; ++v) history_[v].push_back(sums_[v] / steps_);
+    if (use_ed_)
+        for (int i=0; i<spectrum_.size(); ++i) spectrum_[i] = (spectrum_[i]*_Z + spectrum_sum_(i) / steps_)/(_Z+1);
+    sq_average_ = (sq_average_*_Z + sq_sum_ / steps_)/(_Z+1);
+    _Z++;
+
+    // C(r) = 1/N^2 sum_q |n(q)|^2 exp(iqr)
+    Eigen::ArrayXcd sq = sq_average_.template cast<std::complex<double>>();
+    Eigen::ArrayXcd cr = lattice_.FFT(sq, FFTW_BACKWARD);
+    for (int i=0; i<fcorrel_.size(); ++i) fcorrel_[i] = cr(i).real() / lattice_.get_msize();
+
+    sums_.fill(0.0);
+    spectrum_sum_.setZero();
+    sq_sum_.setZero();
+    steps_ = 0.0;
+}
+
+template <typename lattice_t>
+template <class Archive>
+void measure_recycled<lattice_t>::serialize(Archive &ar, const unsigned int version)
+{
+    std::vector<double> sq(sq_average_.data(), sq_average_.data() + sq_average_.size());
+    ar & _Z & sq;
+    sq_average_ = Eigen::Map<real_array_t>(sq.data(), sq.size());
+}
+
+template <typename lattice_t>
+void measure_recycled<lattice_t>::collect_results(boost::mpi::communicator const &c)
+{
+    for (auto &h : history_) gather_history(c, h);
+    int n = c.size();
+    for (auto v : {&spectrum_, &fcorrel_}) {
+        if (!v->size()) continue;
+        std::vector<double> arr(v->size());
+        boost::mpi::reduce(c, v->data(), v->size(), arr.data(), std::plus<double>(), 0);
+        std::transform(arr.begin(), arr.end(), v->begin(), [n](double x){return x / n; });
+        }
+    if (c.rank() == 0 && history_[0].size()) {
+        auto mean = [](std::vector<double> const& x) { return std::accumulate(x.begin(), x.end(), 0.0) / x.size(); };
+        if (use_ed_) std::cout << "Recycled energy: " << mean(history_[energy]) << std::endl;
+        std::cout << "Recycled nf(q=0): " << mean(history_[nf0]) << std::endl;
+        std::cout << "Recycled nf(q=pi): " << mean(history_[nfpi]) << std::endl;
+    }
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_MEASURE_RECYCLED_HPP_
@@ -0,0 +1,89 @@
+#ifndef __FK_MC_MEASURE_SPECTRAL_FUNCTION_HPP_
+#define __FK_MC_MEASURE_SPECTRAL_FUNCTION_HPP_
+
+#include "../common.hpp"
+#include "../configuration.hpp"
+#include "../kpm.hpp"
+#include "kpm_dos.hpp"
+#include <boost/mpi/collectives.hpp>
+
+namespace fk {
+
+/** Kernel-damped Chebyshev moments of the spectral function A(k,w) = <k|delta(w - H)|k> for a set of k-points.
+ *  As the hamiltonian is real, <k|T_m(H)|k> = <c_k|T_m(H)|c_k> + <s_k|T_m(H)|s_k> with c_k, s_k = cos(kr), sin(kr) / sqrt(N).
+ *  A(k,w) is reconstructed from the moments at save time, see chebyshev::kpm_dos. */
+template <typename lattice_t>
+struct measure_spectral_function {
+    typedef typename lattice_t::BZPoint bz_point;
+
+    measure_spectral_function(configuration_t& in, const lattice_t& lattice, std::vector<bz_point> kpoints, int nmoments, 
+                              std::vector<std::vector<double>>& moments_history);
+ 
+    void accumulate(double sign);
+    void collect_results(boost::mpi::communicator const &c);
+
+    chebyshev::kpm_bounds const& bounds() const { return bounds_; }
+    std::vector<bz_point> const& kpoints() const { return kpoints_; }
+    int nmoments() const { return nmoments_; }
+
+protected:
+    configuration_t& config_;
+    const lattice_t& lattice_;
+    std::vector<bz_point> kpoints_;
+    int nmoments_;
+    /// Spectrum bounds, common for all configurations
+    chebyshev::kpm_bounds bounds_;
+    /// Jackson kernel
+    std::vector<double> kernel_;
+    /// cos(kr), sin(kr) vectors for all k-points
+    Eigen::MatrixXd plane_waves_;
+
+    int _Z = 0.0;
+    std::vector<std::vector<double>>& _moments_history; // (nkpoints * nmoments) x n_measures size
+};
+
+template <typename lattice_t>
+measure_spectral_function<lattice_t>::measure_spectral_function(configuration_t& in, const lattice_t& lattice, std::vector<bz_point> kpoints, 
+                                                                int nmoments, std::vector<std::vector<double>>& moments_history):
+    config_(in), lattice_(lattice), kpoints_(kpoints), nmoments_(nmoments), 
+    bounds_(measure_kpm_dos::spectrum_bounds(in)),
+    kernel_(chebyshev::jackson_kernel(nmoments)),
+    plane_waves_(lattice.get_msize(), 2*kpoints.size()),
+    _moments_history(moments_history)
+{
+    _moments_history.resize(kpoints_.size() * nmoments_);
+    int msize = lattice_.get_msize();
+    for (size_t k=0; k<kpoints_.size(); ++k) { 
+        std::array<double, lattice_t::Ndim> kval = kpoints_[k];
+        for (int i=0; i<msize; ++i) { 
+            auto pos = lattice_.index_to_pos(i);
+            double phase = 0.0;
+            for (size_t d=0; d<lattice_t::Ndim; ++d) phase += kval[d]*pos[d];
+            plane_waves_(i, 2*k) = cos(phase) / std::sqrt(double(msize));
+            plane_waves_(i, 2*k+1) = sin(phase) / std::sqrt(double(msize));
+            }
+        }
+}
+
+template <typename lattice_t>
+void measure_spectral_function<lattice_t>::accumulate(double sign)
+{
+    auto x = chebyshev::rescale(config_.hamilt_, bounds_);
+    Eigen::MatrixXd local_moments = chebyshev::kpm_local_moments(x, nmoments_, plane_waves_);
+    for (size_t k=0; k<kpoints_.size(); ++k) 
+        for (int m=0; m<nmoments_; ++m) 
+            _moments_history[k*nmoments_ + m].push_back((local_moments(m, 2*k) + local_moments(m, 2*k+1)) * kernel_[m]);
+    _Z++;
+}
+
+template <typename lattice_t>
+void measure_spectral_function<lattice_t>::collect_results(boost::mpi::communicator const &c)
+{
+    int sum_Z;
+    boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
+    for (size_t i=0; i<_moments_history.size(); ++i) gather_history(c, _moments_history[i]);
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_MEASURE_SPECTRAL_FUNCTION_HPP_
@@ -18,7 +18,8 @@ struct measure_spectrum {
  
     void accumulate(double sign);
     void collect_results(boost::mpi::communicator const &c);
-
+    /// The number of measurements in the running average is kept in the checkpoints
+    template <class Archive> void serialize(Archive &ar, const unsigned int version) { ar & _Z; }
 };
 
 } // end of namespace fk
@@ -189,19 +189,9 @@ void measure_stiffness<lattice_t>::accumulate(double sign)
 template <typename lattice_t>
 void measure_stiffness<lattice_t>::collect_results(boost::mpi::communicator const &comm)
 {
-    using namespace boost::mpi;
-    int nmeasures = stiffness_vals_.size()*comm.size();
-    std::vector<double> stiffness_vals(nmeasures);
-    gather(comm, stiffness_vals_.data(), stiffness_vals_.size(), stiffness_vals, 0);
-    stiffness_vals_.swap(stiffness_vals);
-
-    std::vector<double> current_cond;
+    gather_history(comm, stiffness_vals_);
     assert(cond_history_.size() == wgrid_.size());
-    for (size_t i=0; i<cond_history_.size(); ++i) {
-        current_cond.resize(cond_history_[i].size()*comm.size());
-        boost::mpi::gather(comm, cond_history_[i].data(), cond_history_[i].size(), current_cond, 0);
-        cond_history_[i].swap(current_cond);
-        };
+    for (size_t i=0; i<cond_history_.size(); ++i) gather_history(comm, cond_history_[i]);
 }
 
 } // end of namespace fk
@@ -0,0 +1,114 @@
+#pragma once 
+
+#include "stiffness.hpp"
+#include "kpm_dos.hpp"
+#include "../kpm.hpp"
+
+namespace fk {
+
+/** A stiffness and conductivity measurement with the kernel polynomial method. No diagonalization is required. 
+ * The Kubo formula is expanded in the 2d Chebyshev moments mu_nm = Tr[J T_n(H) J T_m(H)] / N, evaluated stochastically. 
+ * The resulting current-current density is evaluated on Gauss-Chebyshev nodes e_k, which replace the eigenvalues 
+ * in the sums of measure_stiffness. The moments are not damped with a kernel : the Kubo sums are integrals of the density 
+ * with smooth functions (the Lorentzian of width offset is applied exactly), which converge exponentially in nmoments, 
+ * while the Jackson kernel would add a broadening ~ pi*(e_max - e_min)/(2*nmoments) on top of the offset.
+ */
+template <typename lattice_t>
+struct measure_stiffness_kpm : measure_stiffness<lattice_t> {
+    typedef measure_stiffness<lattice_t> base;
+    typedef typename base::matrix_type matrix_type;
+    typedef typename base::sparse_m sparse_m;
+
+    measure_stiffness_kpm(configuration_t& in, const lattice_t& lattice, random_generator& rnd, int nmoments, int nrandom,
+                          std::vector<double>& stiffness_vals, std::vector<std::vector<double>>& cond_history,
+                          std::vector<double> wgrid, double offset); 
+ 
+    void accumulate(double sign);
+
+protected:
+    random_generator& rnd_;
+    int nmoments_;
+    int nrandom_;
+    /// Spectrum bounds, common for all configurations
+    chebyshev::kpm_bounds bounds_;
+    /// Gauss-Chebyshev nodes in energy
+    Eigen::VectorXd nodes_;
+    /// h_n T_n(x_k), h_0 = 1, h_n = 2
+    matrix_type chebt_nodes_;
+};
+
+template <typename lattice_t>
+measure_stiffness_kpm<lattice_t>::measure_stiffness_kpm(configuration_t& in, const lattice_t& lattice, random_generator& rnd, 
+        int nmoments, int nrandom,
+        std::vector<double>& stiffness_vals,
+        std::vector<std::vector<double>>& cond_history, 
+        std::vector<double> wgrid, double offset
+        ): 
+    base(in, lattice, stiffness_vals, cond_history, wgrid, offset),
+    rnd_(rnd),
+    nmoments_(nmoments),
+    nrandom_(nrandom),
+    bounds_(measure_kpm_dos::spectrum_bounds(in)),
+    nodes_(2*nmoments),
+    chebt_nodes_(nmoments, 2*nmoments)
+{
+    for (int k=0; k<nodes_.size(); ++k) { 
+        double x = cos(M_PI*(k + 0.5)/nodes_.size());
+        nodes_(k) = bounds_.a*x + bounds_.b;
+        for (int n=0; n<nmoments_; ++n) chebt_nodes_(n,k) = (n?2.:1.) * chebyshev::chebyshev_t(x, n);
+        }
+}
+
+template <typename lattice_t>
+void measure_stiffness_kpm<lattice_t>::accumulate(double sign)
+{
+    const sparse_m& Jm = this->Jm_;
+    const sparse_m& Tm = this->Tm_;
+    int m_size = this->lattice_.get_msize(); 
+    double Volume = m_size;
+    double beta = this->config_.params().beta;
+
+    auto x = chebyshev::rescale(this->config_.hamilt_, bounds_);
+    Eigen::MatrixXd r = chebyshev::kpm_random_vectors(m_size, nrandom_, rnd_);
+
+    // mu_nm = <r|J T_n J T_m|r> = <T_n J^T r | J T_m r>, tau_m = <r|Tm T_m|r> 
+    matrix_type mu = matrix_type::Zero(nmoments_, nmoments_);
+    Eigen::VectorXd tau = Eigen::VectorXd::Zero(nmoments_);
+    for (int j=0; j<r.cols(); ++j) { 
+        Eigen::VectorXd r0 = r.col(j);
+        matrix_type tr = chebyshev::chebyshev_vectors(x, nmoments_, r0);
+        matrix_type left = chebyshev::chebyshev_vectors(x, nmoments_, Jm.transpose()*r0);
+        mu.noalias() += left.transpose() * (Jm * tr);
+        tau.noalias() += tr.transpose() * (Tm.transpose() * r0);
+        }
+    double norm = r.squaredNorm() / Volume;
+    mu /= norm;
+    tau /= norm;
+
+    // current-current and kinetic energy densities on the nodes
+    int K = nodes_.size();
+    matrix_type G = chebt_nodes_.transpose() * mu * chebt_nodes_;
+    Eigen::VectorXd t = chebt_nodes_.transpose() * tau;
+    Eigen::VectorXd fermi(K);
+    for (int k=0; k<K; ++k) fermi(k) = 1.0 / (1.0 + std::exp(beta * nodes_(k)));
+
+    double T = -M_PI * t.dot(fermi) / K;
+    double V = 0;
+    std::vector<double> const& wgrid = this->wgrid_;
+    std::vector<double> cond(wgrid.size(), 0.0);
+    for (int k=0; k<K; ++k) { 
+        for (int l=0; l<K; ++l) { 
+            if (k == l) continue; 
+            double sigma_v = M_PI * (fermi(l) - fermi(k)) * G(k,l) / K / K;
+            V += sigma_v / (nodes_(k) - nodes_(l));
+            for (size_t wn = 0; wn < wgrid.size(); ++wn) cond[wn] += sigma_v * lorentzian(wgrid[wn] + nodes_(l) - nodes_(k), this->offset_);
+            }
+        }
+
+    double stiffness = (V + T)/Volume;
+    FKDEBUG("T = " << T << "; V = " << V << "; stiffness = " << stiffness, base::DEBUG_LEVEL, 2);
+    this->stiffness_vals_.push_back(stiffness);
+    for (size_t wn = 0; wn < wgrid.size(); ++wn) this->cond_history_[wn].push_back(cond[wn]);
+}
+
+} // end of namespace fk
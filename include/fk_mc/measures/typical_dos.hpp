@@ -0,0 +1,38 @@
+#ifndef __FK_MC_MEASURE_TYPICAL_DOS_HPP_
+#define __FK_MC_MEASURE_TYPICAL_DOS_HPP_
+
+#include "../common.hpp"
+#include "../configuration.hpp"
+#include "../kpm.hpp"
+#include <boost/mpi/collectives.hpp>
+
+namespace fk {
+
+/** Local dos rho_i(w) from the local Chebyshev moments <i|T_m(H)|i> on a random subset of sites. 
+ *  For each measurement the site averages of log(rho_i(w)) and rho_i(w) on the given grid are stored, 
+ *  the typical dos is exp(<log(rho_i(w))>). */
+struct measure_typical_dos {
+    configuration_t& config;
+    random_generator& rnd_;
+    int nmoments_;
+    int nsites_;
+    std::vector<double> wgrid_;
+    /// Spectrum bounds, common for all configurations
+    chebyshev::kpm_bounds bounds_;
+    /// Jackson kernel
+    std::vector<double> kernel_;
+
+    int _Z = 0.0;
+    std::vector<std::vector<double>>& _log_dos_history; // wgrid x n_measures size
+    std::vector<std::vector<double>>& _dos_history; // wgrid x n_measures size
+
+    measure_typical_dos(configuration_t& in, random_generator& rnd, int nmoments, int nsites, std::vector<double> wgrid, 
+                        std::vector<std::vector<double>>& log_dos_history, std::vector<std::vector<double>>& dos_history);
+ 
+    void accumulate(double sign);
+    void collect_results(boost::mpi::communicator const &c);
+};
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_MEASURE_TYPICAL_DOS_HPP_
@@ -14,6 +14,7 @@ struct move_flip {
     typedef double mc_weight_type;
     typedef typename configuration_t::real_array_t  real_array_t;
 
+    /// Inverse temperature - follows the parameters of the configuration, that can change during the run
     double beta;
     configuration_t& config;
     configuration_t new_config;
@@ -24,9 +25,22 @@ struct move_flip {
     move_flip(double beta, configuration_t& current_config, const chebyshev_eval& cheb, random_generator &RND_): 
         beta(beta), config(current_config), new_config(current_config), cheb_(cheb), RND(RND_) {}
 
-    mc_weight_type attempt();
+    /// Draw the new configuration. Uses the random generator, caches the moments of the current configuration.
+    void propose();
+    /// Weight of the proposed configuration. Doesn't use random numbers or modify the current configuration - can run in a separate thread.
+    mc_weight_type evaluate();
+    mc_weight_type attempt() { propose(); return evaluate(); }
     mc_weight_type accept();
     void reject();
+    /// The proposed configuration
+    configuration_t const& proposed() const { return new_config; }
+
+    /// False if the move is impossible from the current configuration
+    bool valid_ = true;
+    /// Sites, changed by the proposal : an f-electron moves from from_ to to_ (move_addremove only changes to_)
+    size_t from_ = 0, to_ = 0;
+    /// f-f energy of the current configuration, taken in propose(), so that evaluate() doesn't fill the cache of the shared configuration
+    double ff_energy_ = 0.0;
  };
 
 //************************************************************************************
@@ -35,7 +49,9 @@ struct move_randomize : move_flip {
     move_randomize(double beta, configuration_t& current_config, const chebyshev_eval& cheb, random_generator &RND_): 
         move_flip::move_flip(beta, current_config, cheb, RND_) {}
 
-    mc_weight_type attempt();
+    void propose();
+    mc_weight_type evaluate();
+    mc_weight_type attempt() { propose(); return evaluate(); }
 };
 
 //************************************************************************************
@@ -45,7 +61,26 @@ struct move_addremove : move_flip {
     move_addremove(double beta, configuration_t& current_config, const chebyshev_eval& cheb, random_generator &RND_): 
         move_flip::move_flip(beta, current_config, cheb, RND_),exp_beta_mu_f(exp(beta*config.params_.mu_f)) {}
 
-    mc_weight_type attempt();
+    void propose();
+    mc_weight_type evaluate();
+    mc_weight_type attempt() { propose(); return evaluate(); }
+};
+
+//************************************************************************************
+
+/// Move of an f-electron to an empty nearest neighbor. Conserves the number of f-electrons.
+struct move_hop : move_flip {
+    move_hop(double beta, configuration_t& current_config, const chebyshev_eval& cheb, random_generator &RND_): 
+        move_flip::move_flip(beta, current_config, cheb, RND_), neighbors_(config.lattice_.neighbor_shells(1)[0]) {}
+
+    void propose();
+    mc_weight_type evaluate();
+    mc_weight_type attempt() { propose(); return evaluate(); }
+
+    /// Nearest neighbors of each site
+    std::vector<std::vector<size_t>> neighbors_;
+    /// Ratio of the probabilities of the reverse and the direct proposal, differs from 1 if the coordination numbers differ
+    double proposal_ratio_ = 1.0;
 };
 
 } // end of namespace chebyshev
@@ -0,0 +1,73 @@
+#ifndef __FK_MC_MOVES_DELAYED_HPP_
+#define __FK_MC_MOVES_DELAYED_HPP_
+
+#include "common.hpp"
+#include "configuration.hpp"
+#include "chebyshev.hpp"
+
+namespace fk {
+
+/** Counters of the delayed acceptance moves. Shared between the copies of a move, so that speculative clones are counted as well.
+ *  They are counted in accept() and reject(), so that the speculative proposals, that are discarded, do not enter. */
+struct delayed_stats {
+    long nattempt = 0;
+    long nstage1 = 0;
+    long naccept = 0;
+
+    /// Fraction of the proposals, that pass the surrogate test
+    double stage1_rate() const { return nattempt ? double(nstage1) / nattempt : 0.0; }
+    /// Fraction of the proposals, that passed the surrogate test and were accepted
+    double stage2_rate() const { return nstage1 ? double(naccept) / nstage1 : 0.0; }
+};
+
+/** Delayed acceptance (Christen-Fox) add/remove or flip move.
+ * A proposal is first tested with a surrogate ratio r_s, where the change of logZ is taken from ED of a small patch 
+ * of sites within a given number of hoppings from the changed sites. Only the proposals, that pass, are evaluated 
+ * with full ED (or Chebyshev moments) and return r/r_s for the second (Metropolis) test, so that detailed balance is exact. */
+struct move_delayed {
+    typedef double mc_weight_type;
+    typedef typename configuration_t::dense_m dense_m;
+    enum kind_t { add_remove, flip };
+
+    configuration_t& config;
+    configuration_t new_config;
+    const chebyshev::chebyshev_eval* cheb_;
+    random_generator &RND;
+    kind_t kind_;
+
+    move_delayed(configuration_t& current_config, const chebyshev::chebyshev_eval* cheb, random_generator &RND_, kind_t kind, int patch_radius);
+
+    /// Draw the new configuration and the random number of the surrogate test
+    void propose();
+    /// Surrogate test, then the full weight ratio, corrected for the surrogate. Can run in a separate thread.
+    mc_weight_type evaluate();
+    mc_weight_type attempt() { propose(); return evaluate(); }
+    mc_weight_type accept();
+    void reject();
+    /// The proposed configuration
+    configuration_t const& proposed() const { return new_config; }
+
+    delayed_stats const& stats() const { return *stats_; }
+
+protected:
+    /// logZ of the c-electrons on a patch of sites
+    double patch_logz_(configuration_t const& c, std::vector<int> const& sites) const;
+
+    /// Sites within patch_radius hoppings from each site
+    std::vector<std::vector<int>> patches_;
+    /// Patch of the current proposal
+    std::vector<int> patch_;
+    /// Sites, changed by the current proposal
+    std::vector<size_t> changed_;
+    bool valid_ = true;
+    double u_stage1_ = 0.0;
+    /// True if the current proposal passed the surrogate test, set in evaluate()
+    bool stage1_ = false;
+    /// f-f energy of the current configuration, taken in propose()
+    double ff_energy_ = 0.0;
+    std::shared_ptr<delayed_stats> stats_;
+};
+
+} // end of namespace fk
+
+#endif // endif :: ifndef __FK_MC_MOVES_DELAYED_HPP_
@@ -0,0 +1,56 @@
+#ifndef __FK_MC_MOVES_MTM_HPP_
+#define __FK_MC_MOVES_MTM_HPP_
+
+#include "common.hpp"
+#include "configuration.hpp"
+#include "chebyshev.hpp"
+#include "thread_pool.hpp"
+
+namespace fk {
+
+/** Multiple-try Metropolis move. 
+ * Generates ntries symmetric proposals (add/remove of a single f-electron or a flip of an occupied and an empty site), 
+ * evaluates their weights in the thread pool and selects one of them with a probability proportional to its weight. 
+ * The acceptance ratio is completed with ntries-1 reference trials drawn from the selected configuration. 
+ * The weights are evaluated with ED, or with Chebyshev moments if a Chebyshev evaluator is given. */
+struct move_mtm {
+    typedef double mc_weight_type;
+    enum kind_t { add_remove, flip };
+
+    double beta;
+    configuration_t& config;
+    const chebyshev::chebyshev_eval* cheb_;
+    random_generator &RND;
+    alps::thread_pool &pool_;
+    kind_t kind_;
+    int ntries_;
+
+    move_mtm(double beta, configuration_t& current_config, const chebyshev::chebyshev_eval* cheb, random_generator &RND_, 
+             alps::thread_pool &pool, kind_t kind, int ntries);
+
+    mc_weight_type attempt();
+    mc_weight_type accept();
+    void reject();
+    /// The selected trial configuration
+    configuration_t const& proposed() const { return trials_[selected_]; }
+
+protected:
+    /// Log of the weight of the configuration, logZ + beta*mu_f*nf - beta*E_ff
+    double log_weight_(configuration_t& c) const;
+    /// Change f_config of c to a random neighbor of src and update its hamiltonian
+    void propose_(configuration_t const& src, configuration_t& c);
+    /// Evaluate the log weights of the configs in parallel
+    void eval_(std::vector<configuration_t>& configs, std::vector<double>& log_weights, int n);
+
+    /// Trial configurations from the current one
+    std::vector<configuration_t> trials_;
+    /// Reference configurations from the selected trial
+    std::vector<configuration_t> refs_;
+    std::vector<double> trial_logw_;
+    std::vector<double> ref_logw_;
+    int selected_ = 0;
+};
+
+} // end of namespace fk
+
+#endif // endif :: ifndef __FK_MC_MOVES_MTM_HPP_
@@ -0,0 +1,42 @@
+#ifndef __FK_MC_MOVES_NFOLD_HPP_
+#define __FK_MC_MOVES_NFOLD_HPP_
+
+#include "common.hpp"
+#include "configuration.hpp"
+#include "thread_pool.hpp"
+
+namespace fk {
+
+/** Change of logZ of c-electrons, when a rank-one term rho*|i><i| is added to a hamiltonian with the spectrum lambda (ascending).
+ *  z2 are the weights |<k|i>|^2 of the site i in the eigenvectors. The new eigenvalues are found from the secular equation
+ *  1 + rho * sum_k z2_k / (lambda_k - x) = 0, degenerate eigenvalues are merged, the ones with a zero weight don't move. */
+double rank_one_logz_diff(Eigen::ArrayXd const& lambda, Eigen::ArrayXd const& z2, double rho, double beta);
+
+/** Rejection-free (n-fold way) version of the add/remove move.
+ * The Metropolis rates min(1, W'/W) of adding or removing an f-electron on every site are found at once from the eigenvectors
+ * of the current configuration with rank_one_logz_diff, and a site is flipped with the probability proportional to its rate.
+ * The configuration is kept for N / sum(rates) Metropolis steps - see alps::mc_metropolis::update_rejection_free.
+ * Always uses ED. */
+struct nfold_addremove {
+    configuration_t& config;
+    random_generator &RND;
+    alps::thread_pool &pool_;
+
+    nfold_addremove(configuration_t& current_config, random_generator &RND_, alps::thread_pool &pool):
+        config(current_config), RND(RND_), pool_(pool) {}
+
+    /// Calculate the rates of all flips from the current configuration and return its residence time
+    double residence_time();
+    /// Flip a site, chosen according to the rates
+    void advance();
+
+    /// Rates of the flips of each site from the current configuration
+    std::vector<double> const& rates() const { return rates_; }
+
+protected:
+    std::vector<double> rates_;
+};
+
+} // end of namespace fk
+
+#endif // endif :: ifndef __FK_MC_MOVES_NFOLD_HPP_
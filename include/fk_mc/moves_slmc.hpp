@@ -0,0 +1,102 @@
+#ifndef __FK_MC_MOVES_SLMC_HPP_
+#define __FK_MC_MOVES_SLMC_HPP_
+
+#include "common.hpp"
+#include "configuration.hpp"
+#include "chebyshev.hpp"
+#include <boost/serialization/vector.hpp>
+
+namespace fk {
+
+/** Effective classical model of the f-electrons : log W_eff = c_0 + c_1 n_f + sum_l k_l P_l,
+ * where P_l is the number of pairs of occupied sites in the neighbor shell l.
+ * Shared between the copies of a move, so that speculative clones use the same model. */
+struct slmc_model {
+    /// Coefficients c_0, c_1, k_1 .. k_nshells
+    Eigen::VectorXd coefs;
+    /// Root mean square deviation of the fitted log weights on the training set
+    double fit_error = 0.0;
+    bool trained = false;
+
+    /// Features and exact log weights of the training configurations
+    std::vector<Eigen::VectorXd> features;
+    std::vector<double> log_weights;
+
+    long ncluster = 0;
+    long naccept = 0;
+    long cluster_sites = 0;
+
+    /// Acceptance rate of the cluster updates
+    double acceptance_rate() const { return ncluster ? double(naccept) / ncluster : 0.0; }
+    /// Average number of sites in a proposed cluster
+    double mean_cluster_size() const { return ncluster ? double(cluster_sites) / ncluster : 0.0; }
+};
+
+/** Self-learning Monte Carlo move.
+ * While the model is trained, the move does local add/remove updates and records the exact log weight of the current configuration.
+ * After ntrain records the coefficients of slmc_model are fitted by least squares and the move proposes Wolff clusters
+ * for the pair couplings of the effective model, written for the Ising variables s = 2n - 1. The clusters are accepted
+ * with the exact weight ratio, divided by the ratio of the effective pair weights, so that the detailed balance is exact. */
+struct move_slmc {
+    typedef double mc_weight_type;
+
+    configuration_t& config;
+    configuration_t new_config;
+    const chebyshev::chebyshev_eval* cheb_;
+    random_generator &RND;
+
+    move_slmc(configuration_t& current_config, const chebyshev::chebyshev_eval* cheb, random_generator &RND_, int nshells, int ntrain);
+
+    /// Record the training data or build a cluster
+    void propose();
+    /// Exact weight ratio, corrected for the cluster proposal. Can run in a separate thread.
+    mc_weight_type evaluate();
+    mc_weight_type attempt() { propose(); return evaluate(); }
+    mc_weight_type accept();
+    void reject();
+    /// The proposed configuration
+    configuration_t const& proposed() const { return new_config; }
+
+    slmc_model const& model() const { return *model_; }
+    /// The model and its training data are kept in the checkpoints
+    template <class Archive> void serialize(Archive &ar, const unsigned int version);
+
+protected:
+    /// Exact log weight of a configuration
+    double log_weight_(configuration_t& c) const;
+    /// Features 1, n_f, P_1 .. P_nshells of a configuration
+    Eigen::VectorXd features_(configuration_t const& c) const;
+    /// sum_l K_l sum_{pairs in shell l} s_i s_j with K_l = k_l / 4
+    double log_pair_weight_(configuration_t const& c) const;
+    /// Least squares fit of the model to the training data
+    void fit_();
+
+    lattice_base::neighbor_shells_t shells_;
+    size_t ntrain_;
+    std::shared_ptr<slmc_model> model_;
+    /// True if the current proposal is a cluster update
+    bool cluster_ = false;
+    /// Change of the effective pair log weight in the current cluster proposal
+    double log_pair_diff_ = 0.0;
+    /// Exact log weight of the current configuration, taken in propose()
+    double log_weight_current_ = 0.0;
+    /// Number of sites in the current cluster
+    long cluster_size_ = 0;
+};
+
+template <class Archive>
+void move_slmc::serialize(Archive &ar, const unsigned int version)
+{
+    slmc_model& m = *model_;
+    std::vector<double> coefs(m.coefs.data(), m.coefs.data() + m.coefs.size());
+    std::vector<std::vector<double>> features;
+    for (auto const& x : m.features) features.emplace_back(x.data(), x.data() + x.size());
+    ar & coefs & m.fit_error & m.trained & features & m.log_weights & m.ncluster & m.naccept & m.cluster_sites;
+    m.coefs = Eigen::Map<Eigen::VectorXd>(coefs.data(), coefs.size());
+    m.features.clear();
+    for (auto& x : features) m.features.push_back(Eigen::Map<Eigen::VectorXd>(x.data(), x.size()));
+}
+
+} // end of namespace fk
+
+#endif // endif :: ifndef __FK_MC_MOVES_SLMC_HPP_
@@ -0,0 +1,22 @@
+#ifndef __FK_MC_PARAMETER_SCAN_HPP_
+#define __FK_MC_PARAMETER_SCAN_HPP_
+
+#include "common.hpp"
+#include "configuration.hpp"
+#include <map>
+
+namespace fk {
+
+/// Values of a scanned parameter, given as a list "a,b,c" or as a range "min:max:npoints". Empty string = not scanned.
+std::vector<double> scan_values(std::string const& s);
+
+/** Points of a scan in the parameters U, beta, mu_c and mu_f. The scanned parameters are walked in nested loops,
+ * the first one in order is the outermost. With snake = true every loop goes back and forth, so that the subsequent points
+ * differ in one parameter by one step - the chain of a point starts from the configuration of the previous one.
+ * The parameters, that are not scanned, keep their values from base. With half_filling = true mu_c = mu_f = U/2 at every point. */
+std::vector<config_params> scan_points(config_params const& base, std::map<std::string, std::vector<double>> const& values,
+                                       std::vector<std::string> const& order, bool snake = true, bool half_filling = false);
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_PARAMETER_SCAN_HPP_
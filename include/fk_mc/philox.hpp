@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <limits>
+#include <iostream>
+#include <boost/serialization/split_member.hpp>
+
+namespace alps {
+
+/** Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11).
+ * The numbers are a keyed bijection of a 128-bit counter. The key is the seed, the counter holds the stream number
+ * and the position in the stream (64 bits each), so that every (seed, stream) pair gives an independent sequence
+ * and discard() is O(1). The state is a few integers - it can be copied, compared and saved (boost::serialization, iostreams).
+ * Satisfies UniformRandomBitGenerator, i.e. works with the std distributions. */
+class philox4x32 {
+public:
+    typedef uint32_t result_type;
+    typedef std::array<uint32_t, 4> counter_type;
+    typedef std::array<uint32_t, 2> key_type;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    explicit philox4x32(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+    /// Restart at the beginning of the given stream
+    void seed(uint64_t seed, uint64_t stream = 0);
+    result_type operator()();
+    /// Skip z numbers
+    void discard(unsigned long long z);
+
+    uint64_t seed() const { return key_[0] | uint64_t(key_[1]) << 32; }
+    uint64_t stream() const { return stream_; }
+    /// Number of the numbers, drawn from the stream
+    uint64_t position() const { return 4*block_ + idx_ - 4; }
+
+    /// The Philox4x32-10 bijection
+    static counter_type bijection(counter_type ctr, key_type key);
+
+    bool operator==(philox4x32 const &rhs) const { return key_ == rhs.key_ && stream_ == rhs.stream_ && position() == rhs.position(); }
+    bool operator!=(philox4x32 const &rhs) const { return !(*this == rhs); }
+
+    template <class Archive> void save(Archive &ar, const unsigned int) const {
+        uint64_t s = seed(), st = stream_, pos = position();
+        ar & s & st & pos;
+    }
+    template <class Archive> void load(Archive &ar, const unsigned int) {
+        uint64_t s, st, pos;
+        ar & s & st & pos;
+        seed(s, st); discard(pos);
+    }
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+    friend std::ostream& operator<<(std::ostream &os, philox4x32 const &r) {
+        return os << r.seed() << " " << r.stream() << " " << r.position();
+    }
+    friend std::istream& operator>>(std::istream &is, philox4x32 &r) {
+        uint64_t s, st, pos;
+        if (is >> s >> st >> pos) { r.seed(s, st); r.discard(pos); }
+        return is;
+    }
+
+protected:
+    /// Generate the block with the given number into buf_
+    void generate_(uint64_t block);
+
+    key_type key_;
+    uint64_t stream_;
+    /// Number of the next block to generate
+    uint64_t block_;
+    /// Position in buf_, 4 if it is used up
+    int idx_;
+    counter_type buf_;
+};
+
+inline void philox4x32::seed(uint64_t seed, uint64_t stream)
+{
+    key_ = {{ uint32_t(seed), uint32_t(seed >> 32) }};
+    stream_ = stream;
+    block_ = 0;
+    idx_ = 4;
+}
+
+inline philox4x32::counter_type philox4x32::bijection(counter_type ctr, key_type key)
+{
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57, W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    for (int r = 0; r < 10; ++r) {
+        if (r) { key[0] += W0; key[1] += W1; }
+        uint64_t p0 = uint64_t(M0) * ctr[0], p1 = uint64_t(M1) * ctr[2];
+        ctr = {{ uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], uint32_t(p1), uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], uint32_t(p0) }};
+    }
+    return ctr;
+}
+
+inline void philox4x32::generate_(uint64_t block)
+{
+    buf_ = bijection({{ uint32_t(block), uint32_t(block >> 32), uint32_t(stream_), uint32_t(stream_ >> 32) }}, key_);
+}
+
+inline philox4x32::result_type philox4x32::operator()()
+{
+    if (idx_ == 4) { generate_(block_++); idx_ = 0; }
+    return buf_[idx_++];
+}
+
+inline void philox4x32::discard(unsigned long long z)
+{
+    uint64_t pos = position() + z;
+    block_ = pos / 4;
+    idx_ = pos % 4;
+    if (idx_) generate_(block_++);
+    else idx_ = 4;
+}
+
+} // end of namespace alps
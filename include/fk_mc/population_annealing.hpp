@@ -0,0 +1,163 @@
+#ifndef __FK_MC_POPULATION_ANNEALING_HPP_
+#define __FK_MC_POPULATION_ANNEALING_HPP_
+
+#include "common.hpp"
+#include "fk_mc.hpp"
+#include <boost/mpi/collectives.hpp>
+#include <alps/mc/stop_callback.hpp>
+
+namespace fk {
+
+/** Population annealing over the MPI ranks.
+ * Every rank holds pa_replicas f-configurations, which are annealed from pa_beta_start to beta in pa_nsteps steps.
+ * At each step the population is resampled with the weights pi(beta_{k+1})/pi(beta_k), evaluated from the cached spectrum,
+ * redistributed evenly over the ranks, and every replica does pa_sweeps sweeps and one measurement with the engine of its rank.
+ * The resampling weights give the free energy along the path. */
+template <typename MC>
+class population_annealing {
+public:
+    typedef configuration_t::int_array_t int_array_t;
+
+    population_annealing(MC& mc, boost::mpi::communicator const& comm);
+
+    /** Anneal the population through all steps. After max_time seconds (0 - no limit) all ranks stop together 
+     *  after the current step, only the completed steps are kept. */
+    void run(size_t max_time);
+    /// Number of temperature steps, including the starting one
+    int nslots() const { return betas_.size(); }
+    /// Parameters of step k
+    config_params slot_params(int k) const { config_params cp = params_; cp.beta = betas_[k]; return cp; }
+    /// Observables of step k, merged over all ranks on rank 0 (collective call)
+    observables_t collect_observables(int k) { return gather_observables(comm_, stash_[k]); }
+    std::vector<double> const& betas() const { return betas_; }
+    /** log Z at each step. When starting from beta = 0 this is absolute, log Z(0) = 2 N log 2,
+     *  otherwise it is relative to the starting temperature. */
+    std::vector<double> const& log_z() const { return logz_; }
+
+protected:
+    /// Sweep and measure all replicas at step k
+    void sweep_(int k);
+    /// Resample the population from step k to k+1
+    void resample_(int k);
+
+    MC& mc_;
+    boost::mpi::communicator comm_;
+    config_params params_;
+    std::vector<double> betas_;
+    std::vector<int_array_t> replicas_;
+    /// Observables of each step
+    std::vector<observables_t> stash_;
+    std::vector<double> logz_;
+    int nsweeps_;
+    /// Random generator for the resampling, used on rank 0
+    random_generator rnd_;
+};
+
+template <typename MC>
+population_annealing<MC>::population_annealing(MC& mc, boost::mpi::communicator const& comm):
+    mc_(mc),
+    comm_(comm),
+    params_(mc.config().params()),
+    nsweeps_(std::max(int(mc.p["pa_sweeps"]), 1)),
+    rnd_(int(mc.p["seed"]))
+{
+    int nsteps = std::max(int(mc.p["pa_nsteps"]), 1);
+    double beta_start = mc.p["pa_beta_start"], beta_end = mc.p["beta"];
+    betas_.resize(nsteps + 1);
+    for (int k=0; k<=nsteps; ++k) betas_[k] = beta_start + (beta_end - beta_start) * k / nsteps;
+
+    // all steps get the shape of the (empty) observables, set by the measures
+    stash_.assign(betas_.size(), mc_.observables);
+    logz_.assign(betas_.size(), 0.0);
+    if (beta_start == 0.0) logz_[0] = 2. * mc.lattice().get_msize() * std::log(2.);
+
+    // independent occupations with probability 1/2 - the exact distribution at beta = 0
+    int nreplicas = std::max(int(mc.p["pa_replicas"]), 1);
+    std::bernoulli_distribution coin(0.5);
+    for (int i=0; i<nreplicas; ++i) {
+        int_array_t f(mc.lattice().get_msize());
+        for (int j=0; j<f.size(); ++j) f(j) = coin(mc.rng());
+        replicas_.push_back(f);
+        }
+}
+
+template <typename MC>
+void population_annealing<MC>::run(size_t max_time)
+{
+    alps::stop_callback stop(max_time);
+    for (int k=0; k<nslots(); ++k) {
+        if (k) resample_(k-1);
+        sweep_(k);
+        // the ranks stop together, on the clock of rank 0
+        int done = !comm_.rank() && stop();
+        boost::mpi::broadcast(comm_, done, 0);
+        if (done && k + 1 < nslots()) {
+            if (!comm_.rank()) std::cout << "Population annealing : max_time is reached after " << k + 1 << " of " << nslots() << " steps" << std::endl;
+            betas_.resize(k + 1);
+            stash_.resize(k + 1);
+            logz_.resize(k + 1);
+            break;
+            }
+        }
+    mc_.set_params(params_);
+}
+
+template <typename MC>
+void population_annealing<MC>::sweep_(int k)
+{
+    mc_.set_params(slot_params(k));
+    for (auto &f : replicas_) {
+        mc_.set_f_config(f);
+        for (int s=0; s<nsweeps_; ++s) mc_.update();
+        mc_.observables.swap(stash_[k]);
+        mc_.measure();
+        mc_.observables.swap(stash_[k]);
+        f = mc_.config().f_config_;
+        }
+}
+
+template <typename MC>
+void population_annealing<MC>::resample_(int k)
+{
+    int nlocal = replicas_.size();
+    int msize = mc_.lattice().get_msize();
+    config_params p0 = slot_params(k), p1 = slot_params(k+1);
+
+    // reweighting factors of the whole population
+    std::vector<double> lw(nlocal);
+    for (int i=0; i<nlocal; ++i) {
+        mc_.set_f_config(replicas_[i]);
+        lw[i] = mc_.log_weight_at(p1) - mc_.log_weight_at(p0);
+        }
+    std::vector<double> all_lw;
+    boost::mpi::all_gather(comm_, lw.data(), nlocal, all_lw);
+    int ntotal = all_lw.size();
+    double lw_max = *std::max_element(all_lw.begin(), all_lw.end());
+    std::vector<double> cumulative(ntotal);
+    double s = 0.0;
+    for (int i=0; i<ntotal; ++i) { s+=std::exp(all_lw[i] - lw_max); cumulative[i] = s; }
+    logz_[k+1] = logz_[k] + lw_max + std::log(s / ntotal);
+
+    // systematic resampling with one random number, the same on all ranks
+    double u = std::uniform_real_distribution<>(0, 1)(rnd_);
+    boost::mpi::broadcast(comm_, u, 0);
+    std::vector<int> source(ntotal);
+    for (int j=0, i=0; j<ntotal; ++j) {
+        double x = (u + j) / ntotal * s;
+        while (i < ntotal - 1 && cumulative[i] < x) ++i;
+        source[j] = i;
+        }
+
+    // each rank takes its slice of the new population
+    std::vector<int> f_local(nlocal * msize), f_all;
+    for (int i=0; i<nlocal; ++i) std::copy(replicas_[i].data(), replicas_[i].data() + msize, f_local.begin() + i*msize);
+    boost::mpi::all_gather(comm_, f_local.data(), f_local.size(), f_all);
+    for (int i=0; i<nlocal; ++i) {
+        int src = source[comm_.rank() * nlocal + i];
+        std::copy(f_all.begin() + src*msize, f_all.begin() + (src+1)*msize, replicas_[i].data());
+        }
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_POPULATION_ANNEALING_HPP_
@@ -0,0 +1,162 @@
+#ifndef __FK_MC_REPLICA_EXCHANGE_HPP_
+#define __FK_MC_REPLICA_EXCHANGE_HPP_
+
+#include "common.hpp"
+#include "fk_mc.hpp"
+#include <array>
+#include <boost/mpi/collectives.hpp>
+#include <alps/mc/stop_callback.hpp>
+
+namespace fk {
+
+/** Parallel tempering (replica exchange) between the chains of the MPI ranks.
+ * Each rank holds one slot of a ladder of beta (or mu_f) values. Every pt_interval sweeps the neighboring slots
+ * propose to exchange their parameters - the configurations stay on their ranks, only a few numbers are communicated.
+ * The observables are kept per slot on every rank and merged over the ranks by collect_observables. */
+template <typename MC>
+class replica_exchange {
+public:
+    replica_exchange(MC& mc, boost::mpi::communicator const& comm);
+
+    /** Do the thermalization and the measurement sweeps with the exchanges of the parameters.
+     *  After max_time seconds (0 - no limit) all ranks stop together at the next exchange. */
+    void run(size_t max_time);
+    /// Current slot of this rank
+    int slot() const { return slot_; }
+    int nslots() const { return ladder_.size(); }
+    /// Parameters of slot k
+    config_params const& slot_params(int k) const { return ladder_[k]; }
+    /// Observables of slot k, merged over all ranks on rank 0 (collective call)
+    observables_t collect_observables(int k);
+    /// Acceptance rate of the exchanges between slots k and k+1
+    double exchange_rate(int k) const { return nattempt_[k] ? double(naccept_[k]) / nattempt_[k] : 0.0; }
+
+protected:
+    /// Propose the exchanges between all pairs of neighboring slots with a given parity
+    void exchange_();
+    /// Move this rank to another slot
+    void switch_slot_(int new_slot);
+
+    MC& mc_;
+    boost::mpi::communicator comm_;
+    std::vector<config_params> ladder_;
+    int slot_;
+    /// Observables of the slots, that this rank doesn't hold now. The current one is in mc_.observables.
+    std::vector<observables_t> stash_;
+    std::vector<long> nattempt_;
+    std::vector<long> naccept_;
+    long nexchanges_ = 0;
+    /// Random generator for the exchange decisions, used on rank 0
+    random_generator rnd_;
+};
+
+template <typename MC>
+replica_exchange<MC>::replica_exchange(MC& mc, boost::mpi::communicator const& comm):
+    mc_(mc),
+    comm_(comm),
+    ladder_(comm.size(), mc.config().params()),
+    slot_(comm.rank()),
+    nattempt_(comm.size(), 0),
+    naccept_(comm.size(), 0),
+    rnd_(int(mc.p["seed"]))
+{
+    std::string par = mc.p["pt_parameter"];
+    if (par != "beta" && par != "mu_f") throw std::logic_error("replica_exchange : pt_parameter should be beta or mu_f");
+    double pmin = mc.p["pt_min"], pmax = mc.p["pt_max"];
+    int n = ladder_.size();
+    for (int k=0; k<n; ++k) {
+        double x = (n > 1) ? double(k) / (n - 1) : 0.0;
+        if (par == "beta") ladder_[k].beta = pmin * std::pow(pmax / pmin, x);
+        else ladder_[k].mu_f = pmin + (pmax - pmin) * x;
+        }
+    // all slots get the shape of the (empty) observables, set by the measures
+    stash_.assign(n, mc_.observables);
+    mc_.set_params(ladder_[slot_]);
+}
+
+template <typename MC>
+void replica_exchange<MC>::run(size_t max_time)
+{
+    long nsweeps = long(mc_.p["ntherm_sweeps"]) + long(mc_.p["nsweeps"]);
+    int interval = std::max(int(mc_.p["pt_interval"]), 1);
+    alps::stop_callback stop(max_time);
+    for (long s = 1; s <= nsweeps; ++s) {
+        mc_.update();
+        mc_.measure();
+        mc_.fraction_completed();
+        if (s % interval) continue;
+        exchange_();
+        // the ranks stop together, on the clock of rank 0
+        int done = !comm_.rank() && stop();
+        boost::mpi::broadcast(comm_, done, 0);
+        if (done) { 
+            if (!comm_.rank()) std::cout << std::endl << "Parallel tempering : max_time is reached after " << s << " of " << nsweeps << " sweeps";
+            break;
+            }
+        }
+    if (!comm_.rank()) {
+        std::cout << std::endl << "Exchange acceptance rates : ";
+        for (int k=0; k+1<nslots(); ++k) std::cout << exchange_rate(k) << " ";
+        std::cout << std::endl;
+        }
+}
+
+template <typename MC>
+void replica_exchange<MC>::exchange_()
+{
+    int n = nslots();
+    if (n < 2) return;
+    // log weights of the configuration of this rank in its slot and in the neighboring ones
+    std::array<double,4> lw = {{ double(slot_), 0.0, mc_.log_weight_at(ladder_[slot_]), 0.0 }};
+    if (slot_ > 0) lw[1] = mc_.log_weight_at(ladder_[slot_ - 1]);
+    if (slot_ < n - 1) lw[3] = mc_.log_weight_at(ladder_[slot_ + 1]);
+    std::vector<double> all_lw;
+    boost::mpi::all_gather(comm_, lw.data(), lw.size(), all_lw);
+    auto lw_of = [&all_lw](int rank, int i) { return all_lw[4*rank + i]; };
+    std::vector<int> rank_of(n);
+    for (int r=0; r<n; ++r) rank_of[int(lw_of(r, 0))] = r;
+
+    // decide on rank 0 : alternate the pairs (0,1),(2,3)... and (1,2),(3,4)...
+    std::vector<int> accepted(n, 0);
+    int parity = nexchanges_ % 2;
+    if (!comm_.rank()) {
+        std::uniform_real_distribution<> u(0, 1);
+        for (int k = parity; k+1 < n; k+=2) {
+            int lo = rank_of[k], hi = rank_of[k+1];
+            double log_ratio = lw_of(lo, 3) + lw_of(hi, 1) - lw_of(lo, 2) - lw_of(hi, 2);
+            accepted[k] = (log_ratio >= 0 || std::exp(log_ratio) > u(rnd_));
+            }
+        }
+    boost::mpi::broadcast(comm_, accepted.data(), n, 0);
+
+    int new_slot = slot_;
+    for (int k = parity; k+1 < n; k+=2) {
+        nattempt_[k]++;
+        if (!accepted[k]) continue;
+        naccept_[k]++;
+        if (slot_ == k) new_slot = k + 1;
+        else if (slot_ == k + 1) new_slot = k;
+        }
+    switch_slot_(new_slot);
+    nexchanges_++;
+}
+
+template <typename MC>
+void replica_exchange<MC>::switch_slot_(int new_slot)
+{
+    if (new_slot == slot_) return;
+    mc_.observables.swap(stash_[slot_]);
+    mc_.observables.swap(stash_[new_slot]);
+    slot_ = new_slot;
+    mc_.set_params(ladder_[slot_]);
+}
+
+template <typename MC>
+observables_t replica_exchange<MC>::collect_observables(int k)
+{
+    return gather_observables(comm_, (k == slot_) ? mc_.observables : stash_[k]);
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_REPLICA_EXCHANGE_HPP_
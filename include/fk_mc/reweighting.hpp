@@ -0,0 +1,69 @@
+#ifndef __FK_MC_REWEIGHTING_HPP_
+#define __FK_MC_REWEIGHTING_HPP_
+
+#include "common.hpp"
+#include "binning.hpp"
+
+namespace fk {
+
+/** Samples of a run, that are enough to evaluate the exact FK weight at another beta and mu_f :
+ * the c-electron spectrum, nf and the f-f energy of each sample. */
+struct reweight_run {
+    double beta, mu_f;
+    std::vector<std::vector<double>> spectrum_history; // L^D x n_measures size
+    std::vector<double> nf0;
+    std::vector<double> nfpi;
+    std::vector<double> ff_energies;
+
+    /** From the series of a run. The f-f energy is recovered from the total and the c-electron energies, E_ff = E - E_c + mu_f*nf.
+     *  If the energies are not given, E_ff = 0 is assumed. */
+    reweight_run(double beta, double mu_f, std::vector<std::vector<double>> spectrum_history, std::vector<double> nf0, std::vector<double> nfpi,
+                 std::vector<double> const& energies = {}, std::vector<double> const& c_energies = {});
+
+    size_t size() const { return nf0.size(); }
+    size_t volume() const { return spectrum_history.size(); }
+    /// Log of the weight of sample s at (beta, mu_f) : logZ_c + beta*mu_f*nf - beta*E_ff
+    double log_weight(size_t s, double beta, double mu_f) const;
+};
+
+/// Observables, reweighted to a given point
+struct reweight_point {
+    double beta, mu_f;
+    size_t nsamples;
+    /// Kish effective sample size, (sum w)^2 / sum w^2
+    double ess;
+    binning::bin_stats_t energy, cv, nf0, nfpi, binder_0, binder_pi;
+    /// dos on the given real frequency grid
+    std::vector<binning::bin_stats_t> dos;
+};
+
+/** Ferrenberg-Swendsen histogram reweighting of the stored samples to nearby beta and mu_f.
+ * A single run is reweighted with the ratio of the weights. Several runs are combined with the multi-histogram equations :
+ * the weight of a sample at the target is pi_t(s) / sum_r n_r pi_r(s) / Z_r, where the ratios of the partition functions Z_r
+ * of the runs are found self-consistently. The errors are obtained with the jackknife of the weighted averages,
+ * i.e. they include the fluctuations of the weights. */
+class reweighting {
+public:
+    reweighting(std::vector<reweight_run> runs, double tol = 1e-10, int maxiter = 10000);
+
+    /// Observables at (beta, mu_f) with bins of 2^bin samples for the jackknife. The dos is broadened with the offset.
+    reweight_point evaluate(double beta, double mu_f, std::vector<double> const& wgrid, double offset, size_t bin) const;
+    /// Log of the (unnormalized) weights of all samples at (beta, mu_f), in the order of the runs
+    std::vector<double> log_weights(double beta, double mu_f) const;
+    /// log(Z_r / Z_0) of each run
+    std::vector<double> const& log_z() const { return log_z_; }
+    std::vector<reweight_run> const& runs() const { return runs_; }
+
+protected:
+    /// Solve the multi-histogram equations for log_z_
+    void solve_(double tol, int maxiter);
+
+    std::vector<reweight_run> runs_;
+    std::vector<double> log_z_;
+    /// log sum_r n_r pi_r(s) / Z_r for every sample
+    std::vector<double> log_denom_;
+};
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_REWEIGHTING_HPP_
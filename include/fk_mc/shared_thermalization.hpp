@@ -0,0 +1,107 @@
+#ifndef __FK_MC_SHARED_THERMALIZATION_HPP_
+#define __FK_MC_SHARED_THERMALIZATION_HPP_
+
+#include "common.hpp"
+#include "fk_mc.hpp"
+#include <boost/mpi/collectives.hpp>
+
+namespace fk {
+
+/// Overlap of two f-configurations, q = 1/N sum_i (2n_i - 1)(2n'_i - 1) : 1 for the same configuration, m m' for independent disordered ones
+inline double f_overlap(configuration_t::int_array_t const& a, configuration_t::int_array_t const& b)
+{
+    return ((2*a - 1) * (2*b - 1)).template cast<double>().mean();
+}
+
+/** Thermalization, shared by the MPI ranks. Only the first shared_therm_ranks ranks (the sources) do the thermalization sweeps
+ * (ntherm_sweeps, or less with auto_therm). Rank r then starts from the configuration of the source r % shared_therm_ranks,
+ * broadcast within the group of the ranks with the same source, and decorrelates it with shared_decorrelation sweeps
+ * of its own random stream, that replace its thermalization.
+ * The decorrelation is checked with the overlap of the configuration of each rank with its starting one, that is compared
+ * to the overlap of independently thermalized configurations. */
+template <typename MC>
+class shared_thermalization {
+public:
+    shared_thermalization(MC& mc, boost::mpi::communicator const& comm);
+
+    /// Thermalize the sources, pass their configurations and decorrelate them. After it MC::run does the measurements.
+    void run();
+    /// True if this rank thermalizes
+    bool source() const { return comm_.rank() < nsources_; }
+    /// Overlap of the decorrelated configuration of this rank with its starting one (1 on the sources)
+    double overlap() const { return overlap_; }
+    /// False if the mean overlap of the ranks with their starting configurations is closer to 1 than to the independent one (on rank 0)
+    bool decorrelated() const { return decorrelated_; }
+
+protected:
+    void sweep_() { mc_.update(); mc_.measure(); mc_.fraction_completed(); }
+
+    MC& mc_;
+    boost::mpi::communicator comm_;
+    int nsources_;
+    long ndecorrelation_;
+    double overlap_ = 1.0;
+    /// The overlap, expected for independent configurations with the same densities, m m'
+    double overlap_independent_ = 0.0;
+    bool decorrelated_ = true;
+};
+
+template <typename MC>
+shared_thermalization<MC>::shared_thermalization(MC& mc, boost::mpi::communicator const& comm):
+    mc_(mc),
+    comm_(comm),
+    nsources_(std::min(std::max(int(mc.p["shared_therm_ranks"]), 1), comm.size())),
+    ndecorrelation_(std::max(int(mc.p["shared_decorrelation"]), 0))
+{
+    if (!source()) mc_.set_thermalization_sweeps(ndecorrelation_);
+}
+
+template <typename MC>
+void shared_thermalization<MC>::run()
+{
+    typedef configuration_t::int_array_t int_array_t;
+    if (source()) while (!mc_.thermalized()) sweep_();
+
+    int_array_t const& fc = mc_.config().f_config_;
+    std::vector<int> f(fc.data(), fc.data() + fc.size());
+    boost::mpi::communicator group = comm_.split(comm_.rank() % nsources_, comm_.rank());
+    boost::mpi::broadcast(group, f, 0);
+
+    if (!source()) {
+        int_array_t start = Eigen::Map<int_array_t>(f.data(), f.size());
+        mc_.set_f_config(start);
+        while (!mc_.thermalized()) sweep_();
+        int_array_t const& end = mc_.config().f_config_;
+        overlap_ = f_overlap(start, end);
+        overlap_independent_ = (2.0*start.sum() / start.size() - 1.0) * (2.0*end.sum() / end.size() - 1.0);
+        }
+
+    // the overlap of two sources is the reference for the independent configurations, also in an ordered phase
+    std::vector<int> f1;
+    if (nsources_ > 1 && comm_.rank() == 1) comm_.send(0, 0, f);
+    if (nsources_ > 1 && comm_.rank() == 0) comm_.recv(1, 0, f1);
+    std::vector<double> q, q_ind;
+    boost::mpi::gather(comm_, overlap_, q, 0);
+    boost::mpi::gather(comm_, overlap_independent_, q_ind, 0);
+    if (comm_.rank() || comm_.size() == nsources_) return;
+
+    double q_mean = 0.0, q_max = -1.0, q_ref = 0.0;
+    int n = comm_.size() - nsources_;
+    for (int r=nsources_; r<comm_.size(); ++r) {
+        q_mean += q[r] / n;
+        q_max = std::max(q_max, q[r]);
+        q_ref += q_ind[r] / n;
+        }
+    if (nsources_ > 1) q_ref = f_overlap(Eigen::Map<int_array_t>(f.data(), f.size()), Eigen::Map<int_array_t>(f1.data(), f1.size()));
+    std::cout << "Shared thermalization : " << mc_.thermalization_sweeps() << " sweeps on " << nsources_ << " ranks, " 
+              << ndecorrelation_ << " decorrelation sweeps on " << n << " ranks, "
+              << "overlap with the starting configuration = " << q_mean << " (max " << q_max << "), "
+              << "independent configurations = " << q_ref << std::endl;
+    decorrelated_ = q_mean <= 0.5 * (1.0 + q_ref);
+    if (!decorrelated_)
+        std::cerr << "Warning : the ranks are not decorrelated from their starting configuration, increase shared_decorrelation" << std::endl;
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_SHARED_THERMALIZATION_HPP_
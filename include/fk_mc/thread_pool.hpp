@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace alps {
+
+/** A fixed-size pool of worker threads to run parallel loops. 
+ * The calling thread takes part in the loop, so a pool of size 1 has no worker threads and runs everything in place. */
+class thread_pool {
+public:
+    explicit thread_pool(int nthreads = 1);
+    ~thread_pool();
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    /// Number of threads, including the calling one.
+    int size() const { return workers_.size() + 1; }
+    /// Call f(i) for i in [0;n) and wait for all calls to finish. The first exception, thrown by f, is rethrown.
+    void parallel_for(size_t n, std::function<void(size_t)> const& f);
+
+protected:
+    /// Take tasks from the queue until it is empty. Returns false, if the queue was empty.
+    bool run_pending();
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+} // end of namespace alps
@@ -0,0 +1,132 @@
+#ifndef __FK_MC_THREADED_CHAINS_HPP_
+#define __FK_MC_THREADED_CHAINS_HPP_
+
+#include "common.hpp"
+#include "fk_mc.hpp"
+#include <boost/mpi/collectives.hpp>
+#include <alps/mc/stop_callback.hpp>
+
+namespace fk {
+
+/** Several independent chains per MPI rank, run in threads.
+ * The chains share one lattice and one Chebyshev evaluator, each has its own configuration, moves and measures.
+ * Chain t of rank r draws its random numbers from the stream r*nchains + t, so that all chains of all ranks are independent.
+ * The observables and the move statistics are merged over the chains of a rank in-process,
+ * so that only one set per rank takes part in the MPI collection. */
+template <typename MC>
+class threaded_chains {
+public:
+    typedef typename MC::lattice_type lattice_type;
+
+    threaded_chains(parameters_t const& p, int nchains, boost::mpi::communicator const& comm);
+
+    /// Initialize all chains with the same lattice
+    void initialize(lattice_type const& lattice, std::vector<double> wgrid_conductivity = {0.0});
+    /// Continue every chain from its checkpoint (after initialize)
+    void load_checkpoints();
+    /** Run every chain in its own thread, until the chains of all ranks are completed together (see mc_metropolis::completed_together), 
+     *  which is checked every convergence_interval sweeps, or max_time seconds pass on rank 0. Every chain writes its checkpoint at the end. */
+    void run(size_t max_time);
+
+    int nchains() const { return chains_.size(); }
+    MC& chain(int t) { return *chains_[t]; }
+    MC const& chain(int t) const { return *chains_[t]; }
+    /** Observables of all chains of all ranks on rank 0 (collective call). The running averages (the spectrum and
+     *  the waste-recycling averages) are weighted with the number of measurements. The observables are moved out of the chains. */
+    observables_t collect_observables();
+    /// Statistics of the moves, summed over all chains of all ranks on rank 0 (collective call)
+    std::vector<alps::move_statistics> collect_move_stats() const;
+
+protected:
+    boost::mpi::communicator comm_;
+    std::vector<std::unique_ptr<MC>> chains_;
+    alps::thread_pool pool_;
+};
+
+template <typename MC>
+threaded_chains<MC>::threaded_chains(parameters_t const& p, int nchains, boost::mpi::communicator const& comm):
+    comm_(comm),
+    pool_(std::max(nchains, 1))
+{
+    nchains = std::max(nchains, 1);
+    for (int t=0; t<nchains; ++t) chains_.emplace_back(new MC(p, comm.rank()*nchains + t));
+}
+
+template <typename MC>
+void threaded_chains<MC>::initialize(lattice_type const& lattice, std::vector<double> wgrid_conductivity)
+{
+    auto lattice_ptr = std::make_shared<lattice_type>(lattice);
+    chains_[0]->initialize(lattice_ptr, nullptr, true, wgrid_conductivity);
+    for (size_t t=1; t<chains_.size(); ++t) chains_[t]->initialize(lattice_ptr, chains_[0]->cheb_ptr, true, wgrid_conductivity);
+}
+
+template <typename MC>
+void threaded_chains<MC>::load_checkpoints()
+{
+    for (auto& c : chains_) c->load_checkpoint(c->checkpoint_file());
+}
+
+template <typename MC>
+void threaded_chains<MC>::run(size_t max_time)
+{
+    alps::stop_callback stop(max_time);
+    std::vector<alps::mc_metropolis*> chains;
+    for (auto& c : chains_) chains.push_back(c.get());
+    long interval = chains_[0]->convergence_interval();
+    do {
+        pool_.parallel_for(chains_.size(), [&](size_t t) { 
+            MC& mc = *chains_[t];
+            for (long s=0; s<interval && !mc.sweeps_done(); ++s) { mc.update(); mc.measure(); mc.fraction_completed(); }
+            });
+        } while (!alps::mc_metropolis::completed_together(comm_, chains, !comm_.rank() && stop()));
+    pool_.parallel_for(chains_.size(), [&](size_t t) { chains_[t]->checkpoint(); });
+}
+
+template <typename MC>
+observables_t threaded_chains<MC>::collect_observables()
+{
+    std::vector<double> observables_t::* averages[] = { &observables_t::spectrum, &observables_t::recycled_spectrum, &observables_t::recycled_fcorrel };
+    // sums of the running averages, weighted with the number of measurements
+    std::vector<std::vector<double>> sums;
+    for (auto avg : averages) sums.emplace_back((chains_[0]->observables.*avg).size(), 0.0);
+    double nmeasures = 0.0;
+
+    observables_t local;
+    for (auto& c : chains_) {
+        observables_t& obs = c->observables;
+        double w = obs.nf0.size();
+        nmeasures += w;
+        for (size_t k=0; k<sums.size(); ++k) {
+            std::vector<double>& avg = obs.*averages[k];
+            for (size_t i=0; i<std::min(avg.size(), sums[k].size()); ++i) sums[k][i] += w*avg[i];
+            avg.clear();
+            }
+        local.merge(obs);
+        }
+
+    // the running averages of the rank, then averaged over the ranks
+    if (nmeasures > 0)
+        for (size_t k=0; k<sums.size(); ++k) {
+            local.*averages[k] = sums[k];
+            for (auto& x : local.*averages[k]) x /= nmeasures;
+            }
+    return gather_observables_averaged(comm_, local);
+}
+
+template <typename MC>
+std::vector<alps::move_statistics> threaded_chains<MC>::collect_move_stats() const
+{
+    std::vector<alps::move_statistics> local = chains_[0]->move_stats();
+    for (size_t t=1; t<chains_.size(); ++t)
+        for (size_t i=0; i<local.size(); ++i) {
+            auto const& s = chains_[t]->move_stats()[i];
+            local[i].nattempt += s.nattempt;
+            local[i].naccept += s.naccept;
+            local[i].time += s.time;
+            }
+    return MC::reduce_move_stats(comm_, local);
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_THREADED_CHAINS_HPP_
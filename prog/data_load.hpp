@@ -1,141 +1,129 @@
 #pragma once
-#include <triqs/h5.hpp>
+#include <alps/hdf5.hpp>
 
 #include "fk_mc.hpp"
 
-namespace fk { 
+namespace fk {
 
+template <typename T>
+void load_if_exists(alps::hdf5::archive& ar, std::string path, T& data) { if (ar.is_data(path)) alps::hdf5::load(ar, path, data); }
 
-// construct a solver from given hdf5 file. The observables are populated with existing data
-parameters_t load_parameters(std::string output_file, parameters_t pnew)
+/** Parameters of a finished run, saved in the output file. Throws, if the most important parameters differ from the ones
+ * of the new run, so that the observables of both runs can not be merged. */
+inline parameters_t load_parameters(std::string output_file, parameters_t const& pnew)
 {
     boost::mpi::communicator world;
-    bool success = true; 
+    alps::hdf5::archive ar(output_file, "r");
+    parameters_t pold;
+    alps::hdf5::load(ar, "/parameters", pold);
 
-    // first we construct mc from parameters (mostly the ones saved in hdf5 file, except of number of cycles, random seed, etc
-    H5::H5File input(output_file.c_str(),H5F_ACC_RDONLY);
-    triqs::h5::group top(input);
-
-    parameters_t pold, p;
-    h5_read(top, "parameters", pold);
+    auto same = [&](std::string name) { return std::abs(pnew[name].as<double>() - pold[name].as<double>()) < 1e-12; };
+    auto same_flag = [&](std::string name) { return pnew[name].as<bool>() == pold[name].as<bool>(); };
 
     // Check that the most important parameters are the same in new and old runs
-    success = 
-        (!pold.exists("t") || std::abs(double(pnew["t"]) - double(pold["t"])) < 1e-4) && 
-        (!pold.exists("L") || int(pold["L"]) == int(pnew["L"])) && 
-        std::abs(double(pnew["U"]) - double(pold["U"])) < 1e-4 && 
-        std::abs(double(pnew["beta"]) - double(pold["beta"])) < 1e-4 && 
-        bool(pnew["measure_history"]) == bool(pold["measure_history"]) && 
-        bool(pnew["measure_stiffness"]) == bool(pold["measure_stiffness"]) && 
-        (!bool(pnew["measure_stiffness"]) || std::abs(double(pnew["cond_offset"]) - double(pold["cond_offset"]))<1e-12) &&
-        (!bool(pnew["measure_stiffness"]) || int(pold["cond_npoints"]) == int(pnew["cond_npoints"])) &&
-        bool(pnew["measure_ipr"]) == bool(pold["measure_ipr"]) && 
-        bool(pnew["cheb_moves"]) == bool(pold["cheb_moves"]) &&
-        (!bool(pnew["cheb_moves"]) || double(pnew["cheb_prefactor"]) == double(pold["cheb_prefactor"]));
-
-    if (!success) { 
-            if (!world.rank()) std::cerr << "Parameters mismatch" << std::endl << "old: " << pold << std::endl << "new: " << pnew << std::endl; 
-            TRIQS_RUNTIME_ERROR << "Parameters mismatch";
-            };
-
-    // first put old parameters and then override them with new ones
-    p.update(pold);
-    p.update(pnew);
-    // update ncycles and max_time but keep old cycle length
-    p["n_cycles"] = std::max(0, int(pold["n_cycles"]));
-    p["length_cycle"] = pold["length_cycle"];
-    if (!world.rank()) std::cout << "params : " << p << std::endl;
-
-    return p;
+    bool success =
+        same("t") && pnew["L"].as<size_t>() == pold["L"].as<size_t>() && same("U") && same("beta") && same("mu_c") && same("mu_f") &&
+        same_flag("measure_history") && same_flag("measure_stiffness") && same_flag("measure_ipr") && same_flag("cheb_moves") &&
+        same_flag("measure_kpm_dos") && same_flag("measure_typical_dos") && same_flag("measure_spectral_function") && 
+        same_flag("measure_recycled") && same_flag("measure_eigenfunctions") &&
+        (!pnew["measure_stiffness"].as<bool>() || (same("cond_offset") && pnew["cond_npoints"].as<int>() == pold["cond_npoints"].as<int>())) &&
+        (!pnew["cheb_moves"].as<bool>() || same("cheb_prefactor")) &&
+        (!(pnew["measure_kpm_dos"].as<bool>() || pnew["measure_typical_dos"].as<bool>() || pnew["measure_spectral_function"].as<bool>()) 
+            || pnew["kpm_moments"].as<int>() == pold["kpm_moments"].as<int>()) &&
+        (!pnew["measure_typical_dos"].as<bool>() || (pnew["dos_npts"].as<int>() == pold["dos_npts"].as<int>() && same("dos_width"))) &&
+        (!pnew["measure_spectral_function"].as<bool>() || same_flag("spectral_all_k"));
+
+    if (!success) {
+        if (!world.rank()) std::cerr << "Parameters mismatch" << std::endl << "old: " << pold << std::endl << "new: " << pnew << std::endl;
+        throw std::logic_error("Parameters mismatch");
+        };
+    return pold;
 }
 
-observables_t load_observables(std::string output_file, parameters_t p)
+/// Observables of a finished run, saved in the output file
+inline observables_t load_observables(std::string output_file, parameters_t const& p)
 {
-    // now load actual data
-    H5::H5File input(output_file.c_str(),H5F_ACC_RDONLY);
-    triqs::h5::group top(input);
+    alps::hdf5::archive ar(output_file, "r");
+    std::string top = "/mc_data/";
     observables_t obs;
 
-    auto h5_mc_data = top.open_group("mc_data");
     std::cout << "Loading observables... " << std::flush;
-    if (h5_mc_data.exists("energies")) h5_read(h5_mc_data,"energies", obs.energies);
-    if (h5_mc_data.exists("d2energies")) h5_read(h5_mc_data,"d2energies", obs.d2energies);
-    if (h5_mc_data.exists("c_energies")) {h5_read(h5_mc_data,"c_energies", obs.c_energies);} 
-            
-    h5_read(h5_mc_data,"nf0", obs.nf0);
-    h5_read(h5_mc_data,"nfpi", obs.nfpi);
-    if (h5_mc_data.exists("spectrum")) h5_read(h5_mc_data,"spectrum", obs.spectrum);
-    if (h5_mc_data.exists("stiffness") && p["measure_stiffness"]) h5_read(h5_mc_data,"stiffness", obs.stiffness);
-
-    if (p["measure_history"]) { 
-        std::cout << "spectrum_history... " << std::flush;
-        triqs::arrays::array<double, 2> t_spectrum_history; 
-        h5_read(h5_mc_data,"spectrum_history", t_spectrum_history);
-        obs.spectrum_history.resize(t_spectrum_history.shape()[0]);
-        for (int i=0; i<obs.spectrum_history.size(); i++) { 
-            obs.spectrum_history[i].resize(t_spectrum_history.shape()[1]);
-            for (int j=0; j< obs.spectrum_history[0].size(); j++)
-                obs.spectrum_history[i][j] = t_spectrum_history(i,j);
-            }
-        
-        std::cout << "focc_history... " << std::flush;
-        triqs::arrays::array<double, 2> focc_history;
-        h5_read(h5_mc_data,"focc_history", focc_history);
-        obs.focc_history.resize(focc_history.shape()[0]);
-        for (int i=0; i<obs.focc_history.size(); i++) { 
-            obs.focc_history[i].resize(focc_history.shape()[1]);
-            for (int j=0; j< obs.focc_history[0].size(); j++)
-                obs.focc_history[i][j] = focc_history(i,j);
-            }
+    load_if_exists(ar, top + "energies", obs.energies);
+    load_if_exists(ar, top + "d2energies", obs.d2energies);
+    load_if_exists(ar, top + "c_energies", obs.c_energies);
+    load_if_exists(ar, top + "nf0", obs.nf0);
+    load_if_exists(ar, top + "nfpi", obs.nfpi);
+    load_if_exists(ar, top + "spectrum", obs.spectrum);
+    if (p["measure_stiffness"]) {
+        std::cout << "conductivity... " << std::flush;
+        load_if_exists(ar, top + "stiffness", obs.stiffness);
+        load_if_exists(ar, top + "cond_history", obs.cond_history);
+        };
+
+    if (p["measure_history"]) {
+        std::cout << "spectrum_history... focc_history... " << std::flush;
+        load_if_exists(ar, top + "spectrum_history", obs.spectrum_history);
+        load_if_exists(ar, top + "focc_history", obs.focc_history);
         };
 
     // Inverse participation ratio
     if (p["measure_ipr"] && p["measure_history"]) {
-        std::cout << "ipr..." << std::flush;
-        triqs::arrays::array<double, 2> t_ipr_history;
-        h5_read(h5_mc_data,"ipr_history", t_ipr_history);
-        obs.ipr_history.resize(t_ipr_history.shape()[0]);
-        for (int i=0; i<obs.ipr_history.size(); i++) { 
-            obs.ipr_history[i].resize(t_ipr_history.shape()[1]);
-            for (int j=0; j< obs.ipr_history[0].size(); j++)
-                obs.ipr_history[i][j] = t_ipr_history(i,j); 
-            };
+        std::cout << "ipr... " << std::flush;
+        load_if_exists(ar, top + "ipr_history", obs.ipr_history);
         };
 
-    // Inverse participation ratio
-    if (p["measure_stiffness"]) {
-        std::cout << "conductivity..." << std::flush;
-        triqs::arrays::array<double, 2> t_cond_history;
-        h5_read(h5_mc_data,"cond_history", t_cond_history);
-        obs.cond_history.resize(t_cond_history.shape()[0]);
-        for (int i=0; i<obs.cond_history.size(); i++) { 
-            obs.cond_history[i].resize(t_cond_history.shape()[1]);
-            for (int j=0; j< obs.cond_history[0].size(); j++)
-                obs.cond_history[i][j] = t_cond_history(i,j); 
-            };
+    // Kpm measures
+    if (p["measure_kpm_dos"]) {
+        std::cout << "kpm moments... " << std::flush;
+        load_if_exists(ar, top + "kpm_moments_history", obs.kpm_moments_history);
+        };
+    if (p["measure_typical_dos"]) {
+        std::cout << "local dos... " << std::flush;
+        load_if_exists(ar, top + "ldos_log_history", obs.ldos_log_history);
+        load_if_exists(ar, top + "ldos_history", obs.ldos_history);
+        };
+    if (p["measure_spectral_function"]) {
+        std::cout << "spectral moments... " << std::flush;
+        load_if_exists(ar, top + "spectral_moments_history", obs.spectral_moments_history);
+        };
+
+    // Waste-recycling estimators
+    if (p["measure_recycled"]) {
+        std::cout << "recycled... " << std::flush;
+        load_if_exists(ar, top + "recycled_history", obs.recycled_history);
+        load_if_exists(ar, top + "recycled_spectrum", obs.recycled_spectrum);
+        load_if_exists(ar, top + "recycled_fcorrel", obs.recycled_fcorrel);
         };
 
     // Eigenfunctions
-    if (bool(p["measure_eigenfunctions"]) && bool(p["save_eigenfunctions"])) {
-        std::cout << "eigenfunctions..." << std::flush;
-        triqs::arrays::array<double, 3> t_eig_history;
-        h5_read(h5_mc_data,"eig_history", t_eig_history);
-        obs.eigenfunctions_history.resize(t_eig_history.shape()[0]);
-        for (int i=0; i<t_eig_history.shape()[0]; i++) { 
-            obs.eigenfunctions_history[i] = observables_t::dense_m(t_eig_history.shape()[1], t_eig_history.shape()[2]);
-            for (int j=0; j< t_eig_history.shape()[1]; j++)
-                for (int k=0; k<t_eig_history.shape()[2]; k++)
-                    obs.eigenfunctions_history[i](j,k) = t_eig_history(i,j,k); 
+    if (bool(p["measure_eigenfunctions"]) && bool(p["save_eigenfunctions"]) && ar.is_data(top + "eig_history")) {
+        std::cout << "eigenfunctions... " << std::flush;
+        std::vector<std::vector<std::vector<double>>> eig_history;
+        alps::hdf5::load(ar, top + "eig_history", eig_history);
+        obs.eigenfunctions_history.resize(eig_history.size());
+        for (size_t i=0; i<eig_history.size(); i++) {
+            obs.eigenfunctions_history[i] = observables_t::dense_m(eig_history[i].size(), eig_history[i][0].size());
+            for (size_t j=0; j<eig_history[i].size(); j++)
+                for (size_t k=0; k<eig_history[i][j].size(); k++)
+                    obs.eigenfunctions_history[i](j,k) = eig_history[i][j][k];
             };
         };
 
-
     std::cout << "done." << std::endl;
-    return std::move(obs);
+    return obs;
 }
 
-
+/// Merge the observables of a finished run into the ones of the new chains. 
+/// The running averages of the waste-recycling estimators are weighted with the number of measurements of each run.
+inline void merge_resumed(observables_t& obs, observables_t& obs_old)
+{
+    double n = obs.nf0.size(), n_old = obs_old.nf0.size();
+    for (auto avg : { &observables_t::recycled_spectrum, &observables_t::recycled_fcorrel }) {
+        auto &a = obs.*avg, &a_old = obs_old.*avg;
+        if (a.size() != a_old.size() || n + n_old == 0) continue;
+        for (size_t i=0; i<a.size(); ++i) a[i] = (n*a[i] + n_old*a_old[i]) / (n + n_old);
+        }
+    obs.merge(obs_old);
+}
 
 } // end of namespace fk
-
-
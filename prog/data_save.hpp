@@ -8,8 +8,13 @@
 #include <alps/hdf5.hpp>
 
 #include "fk_mc.hpp"
+#include "measures/kpm_dos.hpp"
+#include "measures/typical_dos.hpp"
+#include "measures/spectral_function.hpp"
+#include "measures/recycled.hpp"
 #include "binning.hpp"
 #include "jackknife.hpp"
+#include "reweighting.hpp"
 
 namespace fk {
 
@@ -53,12 +58,22 @@ protected:
     void save_fstats();
     /// Save f-f correlation functions.
     void save_fcorrel();
+    /// Save the waste-recycling estimators.
+    void save_recycled();
+    /// Save the observables, reweighted to a window of beta and mu_f around the run.
+    void save_reweighting();
     /// Save the c-electron conductivity.
     void save_conductivity(std::vector<double> wgrid);
     /// Save Inverse Participation Ratio.
     void save_ipr(std::vector<double> wgrid);
     /// Save the local gf.
     void save_glocal(std::vector<double> wgrid_real);
+    /// Save the dos, reconstructed from kpm moments.
+    void save_kpm_dos(std::vector<double> wgrid_real);
+    /// Save the typical dos, obtained from local kpm moments.
+    void save_typical_dos(std::vector<double> wgrid_real);
+    /// Save the spectral function A(k,w), reconstructed from kpm moments.
+    void save_spectral_function(std::vector<double> wgrid_real);
     /// Save G(w,r) and G(w,k) to plaintext files.
     // Warning: only works for 2d.
     void save_gwr(std::vector<std::complex<double>> wgrid, double imag_offset, bool save_only_dos);
@@ -81,7 +96,11 @@ public:
       return pd;
     }
     
-    data_saver(const mc_t& mc, parameters_t &p) : mc_(mc), lattice_(mc.lattice()), observables_(mc_.observables), p_(p), ar_(p["output"].as<std::string>(), "w") 
+    data_saver(const mc_t& mc, parameters_t &p) : data_saver(mc, p, mc.observables) {}
+    /** Save given observables (measured with the parameters p) to the group top of the output file. 
+     * The file is opened with a given mode - "a" adds the group to an existing file. */
+    data_saver(const mc_t& mc, parameters_t &p, observables_t const& observables, std::string top = "/", std::string mode = "w") : 
+        mc_(mc), lattice_(mc.lattice()), observables_(observables), p_(p), top_(top), ar_(p["output"].as<std::string>(), mode) 
     {
         //p_.update(save_defaults());
         //p_["output_file"] = output_file; 
@@ -101,9 +120,162 @@ void save_all_data(const MC& mc, parameters_t p, std::vector<double> wgrid_cond
     saver.save_all(wgrid_cond);
 }
 
+// save data of the parallel tempering slots (or population annealing steps) to "/slot_k" groups of the hdf5 file 
+template <typename MC, typename RE>
+void save_all_slots(const MC& mc, RE& re, parameters_t p, std::vector<double> wgrid_cond = {0.0})
+{
+    boost::mpi::communicator comm;
+    // plaintext files would be overwritten by every slot
+    p["plaintext"] = false;
+    for (int k=0; k<re.nslots(); ++k) {
+        observables_t obs = re.collect_observables(k);
+        if (comm.rank()) continue;
+        config_params const& cp = re.slot_params(k);
+        p["beta"] = cp.beta;
+        p["mu_f"] = cp.mu_f;
+        print_section("Slot " + std::to_string(k) + " : beta = " + std::to_string(cp.beta) + ", mu_f = " + std::to_string(cp.mu_f));
+        data_saver<MC> saver(mc, p, obs, "/slot_" + std::to_string(k) + "/", k ? "a" : "w");
+        saver.save_all(wgrid_cond);
+        }
+}
+
+// save data of the batched chains to "/chain_k" groups of the hdf5 file, chain k is chain k % nchains of the rank k / nchains
+template <typename MC, typename BC>
+void save_all_chains(const MC& mc, BC const& chains, parameters_t p, std::vector<double> wgrid_cond = {0.0})
+{
+    boost::mpi::communicator comm;
+    // the batched chains measure the energies, the f-electron stats and the spectrum only
+    p["plaintext"] = false;
+    p["measure_stiffness"] = false;
+    p["measure_ipr"] = false;
+    p["measure_eigenfunctions"] = false;
+    int nchains = chains.nchains();
+    for (int k=0; k<nchains*comm.size(); ++k) {
+        int owner = k / nchains;
+        observables_t obs;
+        if (owner == 0) { if (!comm.rank()) obs = chains.observables()[k]; }
+        else if (comm.rank() == owner) comm.send(0, k, chains.observables()[k % nchains]);
+        else if (!comm.rank()) comm.recv(owner, k, obs);
+        if (comm.rank()) continue;
+        print_section("Chain " + std::to_string(k));
+        data_saver<MC> saver(mc, p, obs, "/chain_" + std::to_string(k) + "/", k ? "a" : "w");
+        saver.save_all(wgrid_cond);
+        }
+}
+
+// save log Z and the free energy per site along the annealing path to "/population_annealing" group
+inline void save_free_energy(std::vector<double> const& betas, std::vector<double> const& log_z, size_t volume, parameters_t p)
+{
+    alps::hdf5::archive ar(p["output"].as<std::string>(), "a");
+    std::vector<double> free_energy(betas.size());
+    for (size_t k=0; k<betas.size(); ++k) free_energy[k] = betas[k] > 0 ? -log_z[k] / betas[k] / volume : 0.0;
+    alps::hdf5::save(ar, "/population_annealing/beta", betas);
+    alps::hdf5::save(ar, "/population_annealing/log_z", log_z);
+    alps::hdf5::save(ar, "/population_annealing/free_energy", free_energy);
+}
+
+// save the parameters of the points of a scan, in the order of the walk, to "/scan" group - point k is in "/point_k" group
+inline void save_scan(std::vector<config_params> const& points, parameters_t p)
+{
+    alps::hdf5::archive ar(p["output"].as<std::string>(), "a");
+    std::vector<double> beta, U, mu_c, mu_f;
+    for (auto const& cp : points) { 
+        beta.push_back(cp.beta);
+        U.push_back(cp.U);
+        mu_c.push_back(cp.mu_c);
+        mu_f.push_back(cp.mu_f);
+        }
+    alps::hdf5::save(ar, "/scan/beta", beta);
+    alps::hdf5::save(ar, "/scan/U", U);
+    alps::hdf5::save(ar, "/scan/mu_c", mu_c);
+    alps::hdf5::save(ar, "/scan/mu_f", mu_f);
+}
+
+// save the thermalization length, the sweep length, the intervals of the measures and the autocorrelation times of the monitors 
+// to "<top>/convergence" group
+template <typename MC>
+void save_convergence(const MC& mc, parameters_t p, std::string top_group = "")
+{
+    alps::hdf5::archive ar(p["output"].as<std::string>(), "a");
+    alps::hdf5::save(ar, top_group + "/convergence/ntherm_sweeps", mc.thermalization_sweeps());
+    alps::hdf5::save(ar, top_group + "/convergence/sweep_len", mc.sweep_len());
+    for (auto const& s : mc.measure_skips()) alps::hdf5::save(ar, top_group + "/convergence/measure_skip/" + s.first, s.second);
+    for (auto const& m : mc.monitors()) { 
+        std::string top = top_group + "/convergence/monitors/" + m.name;
+        alps::hdf5::save(ar, top + "/tau_therm", m.tau_therm);
+        alps::hdf5::save(ar, top + "/tau", m.binning.tau());
+        alps::hdf5::save(ar, top + "/mean", m.binning.mean());
+        alps::hdf5::save(ar, top + "/error", m.binning.error());
+        }
+}
+
+// save the weights and the statistics of the moves to "<top>/moves/<name>" groups
+template <typename MC>
+void save_move_stats(const MC& mc, std::vector<alps::move_statistics> const& stats, parameters_t p, std::string top_group = "")
+{
+    alps::hdf5::archive ar(p["output"].as<std::string>(), "a");
+    for (size_t i=0; i<stats.size(); ++i) { 
+        std::string top = top_group + "/moves/" + mc.move_names()[i];
+        alps::hdf5::save(ar, top + "/weight", mc.move_weights()[i]);
+        alps::hdf5::save(ar, top + "/nattempt", stats[i].nattempt);
+        alps::hdf5::save(ar, top + "/naccept", stats[i].naccept);
+        alps::hdf5::save(ar, top + "/time", stats[i].time);
+        }
+}
+
 void savetxt (std::string fname, const gftools::container<double,1>& in);
 void savetxt (std::string fname, const gftools::container<double,2>& in);
 
+/// Points of a npts x npts grid of (beta, mu_f). A parameter with min == max is not varied.
+inline std::vector<std::pair<double, double>> reweight_grid(double beta_min, double beta_max, double mu_f_min, double mu_f_max, int npts)
+{
+    auto points = [npts](double a, double b) { 
+        if (npts < 2 || a == b) return std::vector<double>({(a + b) / 2.});
+        std::vector<double> x(npts);
+        for (int k=0; k<npts; ++k) x[k] = a + (b - a) * k / (npts - 1);
+        return x;
+        };
+    std::vector<std::pair<double, double>> out;
+    for (double beta : points(beta_min, beta_max))
+        for (double mu_f : points(mu_f_min, mu_f_max)) out.push_back(std::make_pair(beta, mu_f));
+    return out;
+}
+
+/** Save the observables, reweighted to the given points, to h5_group and to reweighting.dat, reweighting_dos.dat (plaintext).
+ * The columns are beta, mu_f, number of samples, effective sample size and the mean and the error of 
+ * energy, cv, nf(q=0), nf(q=pi), binder_0, binder_pi. */
+inline void save_reweighting(reweighting const& rw, std::vector<std::pair<double, double>> const& points, std::vector<double> const& wgrid,
+                             double offset, size_t bin, alps::hdf5::archive& ar, std::string h5_group, bool save_plaintext = false)
+{
+    gftools::container<double, 2> table(points.size(), 16), dos(points.size(), wgrid.size()), dos_err(points.size(), wgrid.size());
+    for (size_t k=0; k<points.size(); ++k) {
+        auto pt = rw.evaluate(points[k].first, points[k].second, wgrid, offset, bin);
+        std::array<double, 4> head({{pt.beta, pt.mu_f, double(pt.nsamples), pt.ess}});
+        std::copy(head.begin(), head.end(), &table[k][0]);
+        int col = 4;
+        for (auto const* st : {&pt.energy, &pt.cv, &pt.nf0, &pt.nfpi, &pt.binder_0, &pt.binder_pi}) {
+            table[k][col++] = std::get<binning::_MEAN>(*st);
+            table[k][col++] = std::get<binning::_SQERROR>(*st);
+            }
+        for (size_t i=0; i<wgrid.size(); ++i) {
+            dos[k][i] = std::get<binning::_MEAN>(pt.dos[i]);
+            dos_err[k][i] = std::get<binning::_SQERROR>(pt.dos[i]);
+            }
+        std::cout << "reweighted to beta = " << pt.beta << ", mu_f = " << pt.mu_f << " : effective samples = " << pt.ess << " of " << pt.nsamples
+                  << ", energy = " << std::get<binning::_MEAN>(pt.energy) << " +/- " << std::get<binning::_SQERROR>(pt.energy)
+                  << ", cv = " << std::get<binning::_MEAN>(pt.cv) << " +/- " << std::get<binning::_SQERROR>(pt.cv) << std::endl;
+        }
+    alps::hdf5::save(ar, h5_group + "/table", table);
+    alps::hdf5::save(ar, h5_group + "/dos", dos);
+    alps::hdf5::save(ar, h5_group + "/dos_err", dos_err);
+    alps::hdf5::save(ar, h5_group + "/wgrid", wgrid);
+    alps::hdf5::save(ar, h5_group + "/log_z", rw.log_z());
+    if (save_plaintext) { 
+        savetxt("reweighting.dat", table); 
+        savetxt("reweighting_dos.dat", dos); 
+        }
+}
+
 /// Estimate the bin, at which the error bar is saturated.
 inline size_t estimate_bin(const fk::binning::bin_data_t& data)
 {
@@ -38,7 +38,7 @@ void data_saver<MC>::save_all(std::vector<double> wgrid_cond)
 
     print_section("Statistics");
     //H5::H5File output(output_file.c_str(),H5F_ACC_TRUNC);
-    top_ = "/"; //triqs::h5::group(output);
+    //top_ = triqs::h5::group(output);
     // save parameters to "/parameters" dataset
     alps::hdf5::save(ar_, top_ + "parameters", p_);
 
@@ -61,10 +61,13 @@ void data_saver<MC>::save_all(std::vector<double> wgrid_cond)
     if (observables_.nf0.size() && observables_.nfpi.size()) { this->save_fstats(); }
     // f-electron correlation functions
     if (p_["measure_history"]) { this->save_fcorrel(); }
+    // waste-recycling estimators
+    if (observables_.recycled_history.size()) { this->save_recycled(); }
+    // histogram reweighting needs the spectrum history
+    if (int(p_["reweight_npts"]) > 0 && observables_.spectrum_history.size() && observables_.energies.size()) { this->save_reweighting(); }
 
     size_t dos_npts = p_["dos_npts"];
-    double dos_width = p_["dos_width"];
-    std::vector<double> grid_real(dos_npts); for (size_t i=0; i<dos_npts; i++) grid_real[i] = -dos_width+2.*dos_width*i/(1.*dos_npts);
+    std::vector<double> grid_real = mc_t::dos_grid(p_);
     std::vector<std::complex<double>> grid_real2(dos_npts); for (size_t i=0; i<dos_npts; i++) grid_real2[i] = grid_real[i];
 
     // G(w,k)
@@ -76,6 +79,12 @@ void data_saver<MC>::save_all(std::vector<double> wgrid_cond)
     } 
     // Save glocal
     this->save_glocal(grid_real);
+    // Save kpm dos
+    if (observables_.kpm_moments_history.size()) { this->save_kpm_dos(grid_real); }
+    // Save typical dos
+    if (observables_.ldos_history.size()) { this->save_typical_dos(grid_real); }
+    // Save A(k,w)
+    if (observables_.spectral_moments_history.size()) { this->save_spectral_function(grid_real); }
     // Inverse participation ratio
     if (p_["measure_ipr"]) { this->save_ipr(grid_real); }
     // Conductivity and Drude weight
@@ -99,11 +108,14 @@ void data_saver<MC>::save_measurements()
         };
 
     if (p_["measure_history"]) { 
-        gftools::container<double, 2> t_spectrum_history(observables_.spectrum_history.size(), observables_.spectrum_history[0].size());
-        for (int i=0; i<observables_.spectrum_history.size(); i++)
-            for (int j=0; j< observables_.spectrum_history[0].size(); j++)
-                t_spectrum_history[i][j] =  observables_.spectrum_history[i][j];
-        h5_write(h5_mc_data_,"spectrum_history", t_spectrum_history);
+        // spectrum history is not measured in Chebyshev runs
+        if (observables_.spectrum_history.size()) { 
+            gftools::container<double, 2> t_spectrum_history(observables_.spectrum_history.size(), observables_.spectrum_history[0].size());
+            for (int i=0; i<observables_.spectrum_history.size(); i++)
+                for (int j=0; j< observables_.spectrum_history[0].size(); j++)
+                    t_spectrum_history[i][j] =  observables_.spectrum_history[i][j];
+            h5_write(h5_mc_data_,"spectrum_history", t_spectrum_history);
+            };
 
         gftools::container<double, 2> focc_history( observables_.focc_history.size(), observables_.focc_history[0].size() );
         for (int i=0; i<observables_.focc_history.size(); i++)
@@ -112,6 +124,28 @@ void data_saver<MC>::save_measurements()
         h5_write(h5_mc_data_,"focc_history", focc_history);
         };
 
+    if (observables_.kpm_moments_history.size()) { 
+        const auto& moments_history = observables_.kpm_moments_history;
+        gftools::container<double, 2> t_moments_history(moments_history.size(), moments_history[0].size());
+        for (int i=0; i<moments_history.size(); i++)
+            for (int j=0; j< moments_history[0].size(); j++)
+                t_moments_history[i][j] =  moments_history[i][j];
+        h5_write(h5_mc_data_,"kpm_moments_history", t_moments_history);
+        };
+
+    // local dos and A(k,w) moments are kept for resuming the run
+    for (auto h : { std::make_pair(std::string("ldos_log_history"), &observables_t::ldos_log_history), 
+                    std::make_pair(std::string("ldos_history"), &observables_t::ldos_history), 
+                    std::make_pair(std::string("spectral_moments_history"), &observables_t::spectral_moments_history) }) { 
+        const auto& history = observables_.*h.second;
+        if (!history.size()) continue;
+        gftools::container<double, 2> t_history(history.size(), history[0].size());
+        for (int i=0; i<history.size(); i++)
+            for (int j=0; j< history[0].size(); j++)
+                t_history[i][j] =  history[i][j];
+        h5_write(h5_mc_data_, h.first, t_history);
+        };
+
     // Inverse participation ratio
     if (p_["measure_ipr"] && p_["measure_history"]) {
         std::cout << "Inverse participation ratio" << std::endl;
@@ -151,7 +185,7 @@ void data_saver<MC>::save_measurements()
 template <typename MC>
 void data_saver<MC>::save_energy()
 {
-    double beta = mc_.config().params().beta;
+    double beta = p_["beta"];
 
     if (observables_.energies.size()) { 
         const std::vector<double>& energies = observables_.energies;
@@ -259,7 +293,7 @@ template <typename MC>
 void data_saver<MC>::save_glocal(std::vector<double> grid_real)
 {
     bool save_plaintext = p_["plaintext"];
-    double beta = mc_.config().params().beta;
+    double beta = p_["beta"];
     std::vector<double> const& spectrum = observables_.spectrum;
     // Local green's functions
     auto gf_im_f = [&](const std::vector<double>& spec, std::complex<double> z, double offset, int norm)->double {
@@ -279,7 +313,7 @@ void data_saver<MC>::save_glocal(std::vector<double> grid_real)
     std::cout << "DOS imag offset = " << p_["dos_offset"] << std::endl; 
 
     /// Save glocal with error-bars
-    if (p_["measure_history"])
+    if (p_["measure_history"] && observables_.spectrum_history.size())
     { 
         std::vector<double> grid_imag(std::max(int(beta)*10,1024)); for (size_t i=0; i<grid_imag.size(); i++) grid_imag[i] = PI/beta*(2.*i + 1);
         // dos(w=0)
@@ -338,6 +372,142 @@ void data_saver<MC>::save_glocal(std::vector<double> grid_real)
       }
 }
 
+template <typename MC>
+void data_saver<MC>::save_kpm_dos(std::vector<double> grid_real)
+{
+    bool save_plaintext = p_["plaintext"];
+    double beta = p_["beta"];
+    const auto& moments_history = observables_.kpm_moments_history;
+    auto bounds = mc_.template extract_measurement<measure_kpm_dos>("kpm_dos").bounds();
+    size_t nmoments = moments_history.size();
+    size_t nmeasures = moments_history[0].size();
+
+    INFO("Saving KPM DOS w errorbars");
+    // dos for each measurement : linear in moments
+    std::vector<double> moments(nmoments);
+    std::vector<std::vector<double>> dos_hist(grid_real.size(), std::vector<double>(nmeasures)); 
+    std::vector<double> dos0_data(nmeasures);
+    for (size_t m=0; m<nmeasures; ++m) { 
+        for (size_t k=0; k<nmoments; ++k) moments[k] = moments_history[k][m];
+        auto dos_m = chebyshev::kpm_dos(moments, bounds, grid_real);
+        for (size_t i=0; i<grid_real.size(); ++i) dos_hist[i][m] = dos_m[i];
+        dos0_data[m] = chebyshev::kpm_dos(moments, bounds, {0.0})[0];
+        }
+    auto dos0_stats = binning::accumulate_binning(dos0_data.rbegin(), dos0_data.rend(), max_bin_);
+    save_binning(dos0_stats,ar_,h5_binning_,h5_stats_,"kpm_dos0",save_plaintext);
+    size_t dos_bin = estimate_bin(dos0_stats);
+
+    gftools::container<double, 2> dos_ev(grid_real.size(),size_t(3));
+    gftools::real_grid wgrid(grid_real);
+    gftools::grid_object<double, gftools::real_grid> ncw(wgrid), ncw_err(wgrid);
+    auto fermi = [&](double w) { return 1.0 / ( 1.0 + std::exp(beta * w)); };
+    for (size_t i=0; i<grid_real.size(); i++) {
+        auto dosz_data = binning::bin(dos_hist[i].rbegin(), dos_hist[i].rend(), dos_bin);
+        dos_ev[i][0] = grid_real[i]; 
+        dos_ev[i][1] = std::get<binning::bin_m::_MEAN>(dosz_data);
+        dos_ev[i][2] = std::get<binning::bin_m::_SQERROR>(dosz_data); 
+        ncw[i] = dos_ev[i][1] * fermi(grid_real[i]);
+        ncw_err[i] = std::pow(dos_ev[i][2] * fermi(grid_real[i]), 2);
+        }
+    h5_write(h5_stats_,"kpm_dos_err",dos_ev);
+    if (save_plaintext) savetxt("kpm_dos_err.dat",dos_ev);
+
+    binning::bin_stats_t nc_stats;
+    std::get<binning::bin_m::_MEAN>(nc_stats) = wgrid.integrate(ncw);
+    std::get<binning::bin_m::_SQERROR>(nc_stats) = std::sqrt(wgrid.integrate(ncw_err));
+    save_bin_data(nc_stats, ar_, h5_stats_, "kpm_nc", save_plaintext);
+}
+
+template <typename MC>
+void data_saver<MC>::save_typical_dos(std::vector<double> grid_real)
+{
+    bool save_plaintext = p_["plaintext"];
+    const auto& log_dos_history = observables_.ldos_log_history;
+    const auto& dos_history = observables_.ldos_history;
+    double resolution = PI * mc_.template extract_measurement<measure_typical_dos>("typical_dos").bounds_.a / double(p_["kpm_moments"]);
+
+    INFO("Saving typical DOS");
+    auto index_zero = std::distance(grid_real.begin(), std::min_element(grid_real.begin(), grid_real.end(), 
+                                    [](double x, double y){ return std::abs(x) < std::abs(y); }));
+    auto dos0_stats = binning::accumulate_binning(dos_history[index_zero].rbegin(), dos_history[index_zero].rend(), max_bin_);
+    int dos_bin = estimate_bin(dos0_stats);
+
+    std::function<double(double)> geom_f = [](double x){ return std::exp(x); };
+    std::function<double(double, double)> ratio_f = [](double x, double y){ return std::exp(x) / y; };
+    // same columns as tdos_gwr : w, resolution, typical dos, error, dos, error, ratio, error 
+    gftools::container<double, 2> tdos_vals(grid_real.size(), size_t(8));
+    for (size_t i=0; i<grid_real.size(); i++) {
+        auto geom_stats = jackknife::jack(geom_f, std::vector<std::vector<double>>({log_dos_history[i]}), dos_bin); 
+        auto dos_stats = binning::bin(dos_history[i].rbegin(), dos_history[i].rend(), dos_bin);
+        auto ratio_stats = jackknife::jack(ratio_f, std::vector<std::vector<double>>({log_dos_history[i], dos_history[i]}), dos_bin); 
+        tdos_vals[i][0] = grid_real[i];
+        tdos_vals[i][1] = resolution;
+        tdos_vals[i][2] = std::get<binning::bin_m::_MEAN>(geom_stats);
+        tdos_vals[i][3] = std::get<binning::bin_m::_SQERROR>(geom_stats);
+        tdos_vals[i][4] = std::get<binning::bin_m::_MEAN>(dos_stats);
+        tdos_vals[i][5] = std::get<binning::bin_m::_SQERROR>(dos_stats);
+        tdos_vals[i][6] = std::get<binning::bin_m::_MEAN>(ratio_stats);
+        tdos_vals[i][7] = std::get<binning::bin_m::_SQERROR>(ratio_stats);
+        }
+    h5_write(h5_stats_,"tdos_kpm",tdos_vals);
+    if (save_plaintext) savetxt("tdos_kpm.dat",tdos_vals);
+}
+
+template <typename MC>
+void data_saver<MC>::save_spectral_function(std::vector<double> grid_real)
+{
+    bool save_plaintext = p_["plaintext"];
+    const auto& moments_history = observables_.spectral_moments_history;
+    const auto& m = mc_.template extract_measurement<measure_spectral_function<lattice_t>>("spectral_function");
+    auto bounds = m.bounds();
+    const auto& kpoints = m.kpoints();
+    int nmoments = m.nmoments();
+    size_t nmeasures = moments_history[0].size();
+    size_t npts = grid_real.size();
+
+    INFO("Saving A(k,w) at " << kpoints.size() << " k-points");
+    // A(k,w) is linear in the moments : A_w = sum_m kpm_m(w) mu_m
+    Eigen::MatrixXd kpm_w(npts, nmoments);
+    for (int n=0; n<nmoments; ++n) { 
+        std::vector<double> unit(nmoments, 0.0); 
+        unit[n] = 1.0; 
+        auto col = chebyshev::kpm_dos(unit, bounds, grid_real);
+        for (size_t i=0; i<npts; ++i) kpm_w(i,n) = col[i];
+        }
+
+    gftools::container<double, 2> akw(kpoints.size(), npts), akw_err(kpoints.size(), npts), kpoints_out(kpoints.size(), lattice_t::Ndim);
+    std::ofstream out;
+    if (save_plaintext) { out.open("akw.dat"); out.setf(std::ios::scientific); }
+    int a_bin = -1;
+    Eigen::MatrixXd moments(nmoments, nmeasures);
+    for (size_t k=0; k<kpoints.size(); ++k) { 
+        for (int n=0; n<nmoments; ++n) 
+            for (size_t j=0; j<nmeasures; ++j) moments(n,j) = moments_history[k*nmoments + n][j];
+        Eigen::MatrixXd a_hist = kpm_w * moments; // npts x nmeasures
+        std::array<double, lattice_t::Ndim> kval = kpoints[k];
+        for (size_t d=0; d<lattice_t::Ndim; ++d) kpoints_out[k][d] = kval[d];
+        for (size_t i=0; i<npts; ++i) { 
+            std::vector<double> a_data(nmeasures);
+            for (size_t j=0; j<nmeasures; ++j) a_data[j] = a_hist(i,j);
+            // the binning depth is estimated once at the first point
+            if (a_bin < 0) a_bin = estimate_bin(binning::accumulate_binning(a_data.rbegin(), a_data.rend(), max_bin_));
+            auto a_stats = binning::bin(a_data.rbegin(), a_data.rend(), a_bin);
+            akw[k][i] = std::get<binning::bin_m::_MEAN>(a_stats);
+            akw_err[k][i] = std::get<binning::bin_m::_SQERROR>(a_stats);
+            if (save_plaintext) { 
+                out << k << " ";
+                for (double kv : kval) out << kv << " ";
+                out << grid_real[i] << " " << akw[k][i] << " " << akw_err[k][i] << "\n";
+                }
+            }
+        if (save_plaintext) out << "\n";
+        }
+    h5_write(h5_stats_,"akw",akw);
+    h5_write(h5_stats_,"akw_err",akw_err);
+    h5_write(h5_stats_,"akw_kpoints",kpoints_out);
+    h5_write(h5_stats_,"akw_wgrid",grid_real);
+}
+
 template <typename MC>
 void data_saver<MC>::save_fcorrel()
 {
@@ -415,6 +585,83 @@ void data_saver<MC>::save_fcorrel()
         if (save_plaintext) fcorrel_q.savetxt("fcorrel_q.dat");
 }
 
+template <typename MC>
+void data_saver<MC>::save_recycled()
+{
+    bool save_plaintext = p_["plaintext"];
+    double beta = p_["beta"];
+    typedef measure_recycled<lattice_t> m_t;
+    auto const& h = observables_.recycled_history;
+    auto series = [&h](int v) { return std::make_pair(h[v].rbegin(), h[v].rend()); };
+
+    gftools::container<double, 2> t_history(h.size(), h[0].size());
+    for (int i=0; i<h.size(); i++)
+        for (int j=0; j<h[0].size(); j++)
+            t_history[i][j] = h[i][j];
+    h5_write(h5_mc_data_,"recycled_history", t_history);
+
+    // the energy and the spectrum are only measured with ED
+    if (observables_.recycled_spectrum.size()) { 
+        h5_write(h5_mc_data_,"recycled_spectrum", observables_.recycled_spectrum);
+        auto energy_stats = binning::accumulate_binning(h[m_t::energy].rbegin(), h[m_t::energy].rend(), max_bin_); 
+        save_binning(energy_stats,ar_,h5_binning_,h5_stats_,"recycled_energy",save_plaintext);
+
+        typedef decltype(h[0].rbegin()) it_t;
+        std::function<double(double, double, double)> cv_function = [beta, this](double e, double e2, double de2){return beta*beta*(e2 - de2 - e*e)/volume_;}; 
+        std::vector<std::pair<it_t,it_t>> c_data = { series(m_t::energy), series(m_t::energy2), series(m_t::d2energy) };
+        auto cv_stats = jackknife::accumulate_jackknife(cv_function,c_data,max_bin_);
+        save_binning(cv_stats,ar_,h5_binning_,h5_stats_,"recycled_cv",save_plaintext);
+        }
+
+    /* nf(q=0), nf(q=pi), their susceptibilities and Binder cumulants from the recycled moments */
+    std::function<double(double,double)> disp_f = [](double x, double x2){return x2 - x*x;};
+    std::function<double(double,double)> binder_f = [](double x2, double x4){return 1. - x4/3./x2/x2;};
+    for (auto q : {std::make_tuple(std::string("0"), int(m_t::nf0), int(m_t::nf0_2), int(m_t::nf0_4)), 
+                   std::make_tuple(std::string("pi"), int(m_t::nfpi), int(m_t::nfpi_2), int(m_t::nfpi_4))}) { 
+        std::string name = std::get<0>(q);
+        auto const &n = h[std::get<1>(q)], &n2 = h[std::get<2>(q)], &n4 = h[std::get<3>(q)];
+        auto n_stats = binning::accumulate_binning(n.rbegin(), n.rend(), max_bin_);
+        save_binning(n_stats,ar_,h5_binning_,h5_stats_,"recycled_nf_" + name,save_plaintext);
+        auto fsusc_stats = jackknife::accumulate_jackknife(disp_f,std::vector<std::vector<double>>({n,n2}),max_bin_);
+        save_binning(fsusc_stats,ar_,h5_binning_,h5_stats_,"recycled_fsusc_" + name,save_plaintext);
+        auto binder = jackknife::jack(binder_f, std::vector<std::vector<double>>({n2, n4}), estimate_bin(fsusc_stats));
+        save_bin_data(binder,ar_,h5_stats_,"recycled_binder_" + name,save_plaintext);
+        }
+
+    /* translation-averaged f-f correlations : the full C(r) and the connected part along the axes, averaged over the directions */
+    auto const& cr = observables_.recycled_fcorrel;
+    h5_write(h5_stats_,"recycled_fcorrel_r", cr);
+    h5_write(h5_mc_data_,"recycled_fcorrel", cr);
+    double nf_mean = std::accumulate(h[m_t::nf0].begin(), h[m_t::nf0].end(), 0.0) / h[m_t::nf0].size() / volume_;
+    const auto dims = lattice_.dims;
+    gftools::container<double, 2> fcorrel_out(dims[0] / 2 + 1, 2);
+    for (int l = 0; l <= dims[0] / 2; l++) { 
+        double c = 0.0;
+        for (int d = 0; d < lattice_.Ndim; d++) { 
+            auto pos = lattice_.index_to_pos(0);
+            pos[d] = l % dims[d];
+            c += cr[lattice_.pos_to_index(pos)];
+            }
+        fcorrel_out[l][0] = l;
+        fcorrel_out[l][1] = c / lattice_.Ndim - nf_mean * nf_mean;
+        }
+    h5_write(h5_stats_,"recycled_fcorrel",fcorrel_out);
+    if (save_plaintext) savetxt("fcorrel_recycled.dat",fcorrel_out);
+}
+
+
+template <typename MC>
+void data_saver<MC>::save_reweighting()
+{
+    print_section("Reweighting");
+    double beta = p_["beta"], mu_f = p_["mu_f"];
+    double dbeta = p_["reweight_dbeta"], dmu_f = p_["reweight_dmu_f"];
+    reweighting rw({reweight_run(beta, mu_f, observables_.spectrum_history, observables_.nf0, observables_.nfpi, 
+                                 observables_.energies, observables_.c_energies)});
+    size_t bin = estimate_bin(binning::accumulate_binning(observables_.energies.rbegin(), observables_.energies.rend(), max_bin_));
+    auto points = reweight_grid(beta - dbeta, beta + dbeta, mu_f - dmu_f, mu_f + dmu_f, p_["reweight_npts"]);
+    fk::save_reweighting(rw, points, mc_t::dos_grid(p_), p_["dos_offset"], bin, ar_, h5_stats_ + "/reweighting", p_["plaintext"]);
+}
 
 template <typename MC>
 void data_saver<MC>::save_conductivity(std::vector<double> wgrid_cond)
@@ -480,7 +727,7 @@ void data_saver<MC>::save_conductivity(std::vector<double> wgrid_cond)
 template <typename MC>
 void data_saver<MC>::save_ipr(std::vector<double> grid_real) 
 {
-    double beta = mc_.config().params().beta;
+    double beta = p_["beta"];
 
     auto ipr_f = [&](std::vector<double> const& ipr_spec, double z, double offset, int volume)->double  {
         double nom = 0.0, denom = 0.0;
@@ -707,7 +954,7 @@ template <typename MC>
 void data_saver<MC>::save_glocal(std::vector<double> grid_real)
 {
     bool save_plaintext = p_["plaintext"];
-    double beta = mc_.config.params().beta;
+    double beta = p_["beta"];
     std::vector<double> const& spectrum = observables_.spectrum;
     // Local green's functions
     auto gf_im_f = [&](const std::vector<double>& spec, std::complex<double> z, double offset, int norm)->double {
@@ -753,7 +1000,7 @@ void data_saver<MC>::save_glocal(std::vector<double> grid_real)
     };
 
     /// Save glocal with error-bars
-    if (p_["measure_history"])
+    if (p_["measure_history"] && observables_.spectrum_history.size())
     { 
         std::vector<double> grid_imag(std::max(int(beta)*10,1024)); for (size_t i=0; i<grid_imag.size(); i++) grid_imag[i] = PI/beta*(2.*i + 1);
         // dos(w=0)
@@ -3,10 +3,17 @@
 #include <random>
 
 #include "fk_mc.hpp"
+#include "replica_exchange.hpp"
+#include "population_annealing.hpp"
 #include "data_save.hpp"
-//#include "data_load.hpp"
+#include "moves_delayed.hpp"
+#include "moves_slmc.hpp"
+#include "batched.hpp"
+#include "threaded_chains.hpp"
+#include "shared_thermalization.hpp"
+#include "parameter_scan.hpp"
+#include "data_load.hpp"
 #include "measures/polarization.hpp"
-#include <alps/mc/mpiadapter.hpp>
 #include <alps/mc/stop_callback.hpp>
 
 
@@ -43,8 +50,6 @@ size_t _myrank;
 
 using namespace std::chrono;
 
-typedef alps::mcmpiadapter<fk_mc<lattice_t>> qmc_t;
-
 // params from command line
 alps::params cmdline_params(int argc, char *argv[]);
 
@@ -73,7 +78,7 @@ int main(int argc, char* argv[])
 
     double beta = p["beta"]; 
     double U = p["U"]; 
-    bool resume = false; 
+    bool resume = p["resume"]; 
     bool dry_run = p["exit"];
     //p["random_seed"] = (random_seed_switch.getValue()?std::random_device()():(rnd_seed_arg.getValue()+comm.rank()));
 
@@ -86,22 +91,22 @@ int main(int argc, char* argv[])
 try{
     // try resuming calc
     observables_t obs_old;
-/*
-    if (resume) {
-        p = load_parameters(h5fname, p);
-        nsweeps_old = p["nsweeps"]; // this is old + new number of sweeps
+    // the chains continue exactly from their checkpoints and count nsweeps from the start of the run
+    bool from_checkpoint = resume && !p["checkpoint"].as<std::string>().empty();
+    if (!p["checkpoint"].as<std::string>().empty() && (p["parallel_tempering"] || p["population_annealing"] || int(p["batch_chains"]) > 0))
+        throw std::logic_error("Checkpoints can not be combined with parallel tempering, population annealing or batched chains");
+    // without checkpoints a finished run is extended by new chains, their observables are merged with the saved ones
+    if (resume && !from_checkpoint) {
+        parameters_t pold = load_parameters(p["output"], p);
+        nsweeps_old = pold["nsweeps"]; // this is old + new number of sweeps
         if (!comm.rank()) {
              std::cout << "Resuming calculation from " << nsweeps_old << " sweeps. "<< std::endl;
-             obs_old = load_observables(h5fname, p);
-             std::cout << "parameters for run : " << p << std::endl;
+             obs_old = load_observables(p["output"], p);
         };
         comm.barrier();
-       // boost::mpi::broadcast(comm, p, 0); 
-        //std::cout << "proc " << comm.rank() << " parameters : " << p << std::endl;
-        //exit(0);
         }
+    if (from_checkpoint) MINFO("Resuming the chains from the checkpoints " << p["checkpoint"] << ".<rank>");
 
-*/
     int nsweeps_total = std::max(nsweeps_new, nsweeps_old);
     p["nsweeps"] = std::max(nsweeps_total - nsweeps_old, 0); // do a calc with only new number of sweeps
     if (!comm.rank()) std::cout << nsweeps_old << " -> " << nsweeps_total << " sweeps" << std::endl; 
@@ -131,6 +136,36 @@ try{
     MINFO2("MC flip moves weight         : " << p["mc_flip"]); 
     MINFO2("MC add/remove moves weight   : " << p["mc_add_remove"]);
     MINFO2("MC reshuffle moves weight    : " << p["mc_reshuffle"]);
+    MINFO2("MC hop moves weight          : " << p["mc_hop"]);
+    MINFO2("MC delayed acceptance weights: add/remove " << p["mc_delayed_add_remove"] << ", flip " << p["mc_delayed_flip"]);
+    MINFO2("MC self-learning moves weight: " << p["mc_slmc"]);
+    MINFO2("Rejection-free updates       : " << bool(p["rejection_free"]));
+    if (p["parallel_tempering"]) { 
+        MINFO2("Parallel tempering in        : " << p["pt_parameter"] << " from " << p["pt_min"] << " to " << p["pt_max"]); 
+        MINFO2("Sweeps between exchanges     : " << p["pt_interval"]); 
+        }
+    if (int(p["chains_per_rank"]) > 1) MINFO2("Threaded chains per rank     : " << p["chains_per_rank"]);
+    if (int(p["batch_chains"]) > 0) MINFO2("Batched chains per rank      : " << p["batch_chains"]);
+    // the scanned parameters, from the outermost to the innermost loop
+    std::map<std::string, std::vector<double>> scan_values_in;
+    std::vector<std::string> scan_order;
+    { 
+        std::istringstream in(p["scan_order"].as<std::string>());
+        for (std::string name; std::getline(in, name, ',');) scan_order.push_back(name);
+        for (std::string name : {"beta", "U", "mu_c", "mu_f"}) 
+            if (!p["scan_" + name].as<std::string>().empty()) scan_values_in[name] = scan_values(p["scan_" + name]);
+    }
+    bool scan = !scan_values_in.empty();
+    if (scan) MINFO2("Scan in                      : " << p["scan_order"] << (p["scan_snake"] ? ", snake order" : "") 
+                                                      << (p["scan_half_filling"] ? ", at half filling" : ""));
+    if (p["shared_therm"]) MINFO2("Shared thermalization on     : " << p["shared_therm_ranks"] << " ranks, decorrelation sweeps = " << p["shared_decorrelation"]);
+    if (p["population_annealing"]) { 
+        MINFO2("Population annealing from    : beta = " << p["pa_beta_start"] << " in " << p["pa_nsteps"] << " steps"); 
+        MINFO2("Replicas per rank            : " << p["pa_replicas"]); 
+        MINFO2("Sweeps per replica and step  : " << p["pa_sweeps"]); 
+        // every replica is measured at every step
+        p["ntherm_sweeps"] = 0;
+        }
 
     if (dry_run) exit(0);
 
@@ -172,21 +207,178 @@ try{
         
     std::vector<double> wgrid_conductivity ({wgrid1.data(), wgrid1.data() + wgrid1.size()});
 
+    if (p["shared_therm"] && (p["parallel_tempering"] || p["population_annealing"] || int(p["batch_chains"]) > 0 || int(p["chains_per_rank"]) > 1))
+        throw std::logic_error("Shared thermalization can not be combined with parallel tempering, population annealing, batched or threaded chains");
+    if (scan) { 
+        if (p["parallel_tempering"] || p["population_annealing"] || int(p["batch_chains"]) > 0 || int(p["chains_per_rank"]) > 1 || p["shared_therm"] 
+            || !p["checkpoint"].as<std::string>().empty() || resume)
+            throw std::logic_error("A scan can not be combined with parallel tempering, population annealing, batched or threaded chains, "
+                                   "shared thermalization, checkpoints or resume");
+        config_params base({beta, U, mu_c, mu_f, p["W"].as<std::vector<double>>()});
+        std::vector<config_params> points = scan_points(base, scan_values_in, scan_order, p["scan_snake"], p["scan_half_filling"]);
+        MINFO("Scan : " << points.size() << " points");
+        // the lattice and the Chebyshev evaluator do not depend on the scanned parameters
+        auto lattice_ptr = std::make_shared<lattice_t>(lattice);
+        std::shared_ptr<chebyshev::chebyshev_eval> cheb;
+        configuration_t::int_array_t f;
+        std::unique_ptr<fk_mc<lattice_t>::random_generator> rng;
+        steady_clock::time_point start = steady_clock::now();
+        for (size_t k=0; k<points.size(); ++k) {
+            config_params const& cp = points[k];
+            parameters_t pk(p);
+            pk["beta"] = cp.beta;
+            pk["U"] = cp.U;
+            pk["mu_c"] = cp.mu_c;
+            pk["mu_f"] = cp.mu_f;
+            if (k && int(p["scan_ntherm_sweeps"]) >= 0) pk["ntherm_sweeps"] = int(p["scan_ntherm_sweeps"]);
+            // the ranks stop the scan together
+            size_t elapsed = duration_cast<seconds>(steady_clock::now() - start).count();
+            boost::mpi::broadcast(comm, elapsed, 0);
+            size_t max_time = p["max_time"].as<size_t>();
+            if (elapsed >= max_time) { MINFO("Scan : max_time is reached, " << k << " of " << points.size() << " points done"); break; }
+
+            // the chain of the point starts from the configuration of the previous one and continues its random stream
+            fk_mc<lattice_t> mc(pk, _myrank);
+            mc.initialize(lattice_ptr, cheb, k == 0, wgrid_conductivity);
+            cheb = mc.cheb_ptr;
+            if (k) { 
+                mc.set_f_config(f);
+                mc.rng() = *rng;
+                }
+            mc.run(alps::stop_callback(max_time - elapsed));
+            f = mc.config().f_config_;
+            rng.reset(new fk_mc<lattice_t>::random_generator(mc.rng()));
+
+            comm.barrier();
+            auto move_stats = mc.collect_move_stats(comm);
+            mc.observables = gather_observables_averaged(comm, mc.observables);
+            if (comm.rank()) continue;
+            std::string top = "/point_" + std::to_string(k);
+            print_section("Point " + std::to_string(k) + " : beta = " + std::to_string(cp.beta) + ", U = " + std::to_string(cp.U) 
+                          + ", mu_c = " + std::to_string(cp.mu_c) + ", mu_f = " + std::to_string(cp.mu_f));
+            mc.print_move_stats(move_stats);
+            // plaintext files would be overwritten by every point
+            pk["plaintext"] = false;
+            pk["nsweeps"] = nsweeps_total;
+            data_saver<fk_mc<lattice_t>> saver(mc, pk, mc.observables, top + "/", k ? "a" : "w");
+            saver.save_all(wgrid_conductivity);
+            save_move_stats(mc, move_stats, pk, top);
+            if (mc.monitoring() || !mc.measure_skips().empty()) save_convergence(mc, pk, top);
+            }
+        steady_clock::time_point end = steady_clock::now();
+        if (!comm.rank()) { 
+            save_scan(points, p);
+            std::cout << "Calculation lasted : " << duration_cast<seconds>(end-start).count() << "s" << std::endl;
+            }
+        return 0;
+        }
+    if (int(p["chains_per_rank"]) > 1) {
+        if (p["parallel_tempering"] || p["population_annealing"] || int(p["batch_chains"]) > 0) 
+            throw std::logic_error("Several chains per rank can not be combined with parallel tempering, population annealing or batched chains");
+        threaded_chains<fk_mc<lattice_t>> chains(p, p["chains_per_rank"], comm);
+        chains.initialize(lattice, wgrid_conductivity);
+        if (from_checkpoint) chains.load_checkpoints();
+        steady_clock::time_point start = steady_clock::now();
+        chains.run(p["max_time"].as<size_t>());
+        steady_clock::time_point end = steady_clock::now();
+        comm.barrier();
+        auto move_stats = chains.collect_move_stats();
+        fk_mc<lattice_t>& mc = chains.chain(0);
+        mc.observables = chains.collect_observables();
+        if (!comm.rank()) {
+            mc.print_move_stats(move_stats);
+            merge_resumed(mc.observables, obs_old);
+            p["nsweeps"] = nsweeps_total;
+            std::cout << "Calculation lasted : " << duration_cast<seconds>(end-start).count() << "s" << std::endl;
+            save_all_data(mc, p, wgrid_conductivity);
+            save_move_stats(mc, move_stats, p);
+            if (mc.monitoring() || !mc.measure_skips().empty()) save_convergence(mc, p);
+            }
+        return 0;
+        }
+
     fk_mc<lattice_t> mc(p, _myrank); 
     mc.initialize(lattice, true, wgrid_conductivity);
+    if (from_checkpoint) mc.load_checkpoint(mc.checkpoint_file());
 
     //#ifdef LATTICE_chain
     //mc.add_measure(measure_polarization<lattice_t>(mc.config,mc.lattice),"polarization");
     //#endif
         
     steady_clock::time_point start, end;
+    if (p["parallel_tempering"]) {
+        if (p["measure_eigenfunctions"]) throw std::logic_error("Eigenfunctions can not be measured with parallel tempering");
+        replica_exchange<fk_mc<lattice_t>> re(mc, comm);
+        start = steady_clock::now();
+        re.run(p["max_time"].as<size_t>());
+        end = steady_clock::now();
+        comm.barrier();
+        if (!comm.rank()) std::cout << "Calculation lasted : " << duration_cast<seconds>(end-start).count() << "s" << std::endl;
+        p["nsweeps"] = nsweeps_total;
+        save_all_slots(mc, re, p, wgrid_conductivity);
+        return 0;
+        }
+    if (p["population_annealing"]) {
+        population_annealing<fk_mc<lattice_t>> pa(mc, comm);
+        start = steady_clock::now();
+        pa.run(p["max_time"].as<size_t>());
+        end = steady_clock::now();
+        comm.barrier();
+        for (int k=0; k<pa.nslots(); ++k) MINFO("beta = " << pa.betas()[k] << ", log Z = " << pa.log_z()[k]);
+        if (!comm.rank()) std::cout << "Calculation lasted : " << duration_cast<seconds>(end-start).count() << "s" << std::endl;
+        save_all_slots(mc, pa, p, wgrid_conductivity);
+        if (!comm.rank()) save_free_energy(pa.betas(), pa.log_z(), lattice.get_msize(), p);
+        return 0;
+        }
+
+    if (int(p["batch_chains"]) > 0) {
+        int nb = p["batch_chains"];
+        double flip = p["mc_flip"], add_remove = p["mc_add_remove"];
+        batched_chains<lattice_t> chains(lattice, mc.config().params(), nb, p["seed"].as<long>(), uint64_t(comm.rank())*nb, 
+                                         flip, add_remove, p["measure_history"]);
+        chains.randomize(p["Nf_start"]);
+        start = steady_clock::now();
+        chains.run(p["ntherm_sweeps"], p["nsweeps"], p["sweep_len"], p["max_time"].as<size_t>());
+        end = steady_clock::now();
+        comm.barrier();
+        MINFO("Batched chains : " << nb << " per rank, acceptance rate on rank 0 = " << chains.acceptance_rate());
+        if (!comm.rank()) std::cout << "Calculation lasted : " << duration_cast<seconds>(end-start).count() << "s" << std::endl;
+        save_all_chains(mc, chains, p, wgrid_conductivity);
+        return 0;
+        }
+
     start = steady_clock::now();
-    mc.run(alps::stop_callback(p["max_time"].as<size_t>())); // this runs monte-carlo
+    // a resumed chain is thermalized already
+    if (p["shared_therm"] && !from_checkpoint) { 
+        shared_thermalization<fk_mc<lattice_t>> st(mc, comm);
+        st.run();
+        }
+    // the ranks stop together, on the error of the combined means
+    mc.run(alps::stop_callback(p["max_time"].as<size_t>()), comm); // this runs monte-carlo
     end = steady_clock::now();
+    // also when stopped by max_time - the run is continued with resume
+    mc.checkpoint();
 
     comm.barrier();
+    auto move_stats = mc.collect_move_stats(comm);
+    if (!comm.rank()) mc.print_move_stats(move_stats);
+    if (mc.monitoring()) {
+        MINFO("Thermalization sweeps on rank 0 : " << mc.thermalization_sweeps());
+        for (auto const& m : mc.monitors()) 
+            MINFO(m.name << " : " << m.binning.mean() << " +/- " << m.binning.error() << " from " << m.binning.count() << " measurements, tau = " << m.binning.tau());
+        }
+    for (std::string name : {"delayed_add_remove", "delayed_flip"}) { 
+        if (double(p["mc_" + name]) < std::numeric_limits<double>::epsilon()) continue;
+        auto const& stats = mc.template extract_move<move_delayed>(name).stats();
+        MINFO(name << " : stage 1 acceptance = " << stats.stage1_rate() << ", stage 2 acceptance = " << stats.stage2_rate());
+        }
+    if (double(p["mc_slmc"]) > std::numeric_limits<double>::epsilon()) { 
+        auto const& model = mc.template extract_move<move_slmc>("slmc").model();
+        MINFO("slmc : effective model coefficients = " << model.coefs.transpose() << ", fit error = " << model.fit_error);
+        MINFO("slmc : cluster acceptance = " << model.acceptance_rate() << ", mean cluster size = " << model.mean_cluster_size());
+        }
     if (comm.rank() == 0) {
-        mc.observables.merge(obs_old);
+        merge_resumed(mc.observables, obs_old);
         p["nsweeps"] = nsweeps_total;
         std::cout << "Calculation lasted : " 
             << duration_cast<hours>(end-start).count() << "h " 
@@ -197,6 +389,8 @@ try{
 
         start = steady_clock::now();
         save_all_data(mc,p,wgrid_conductivity);
+        save_move_stats(mc, move_stats, p);
+        if (mc.monitoring() || !mc.measure_skips().empty()) save_convergence(mc, p);
         end = steady_clock::now();
         std::cout << "Saving lasted : " 
             << duration_cast<hours>(end-start).count() << "h " 
@@ -217,7 +411,7 @@ alps::params cmdline_params(int argc, char *argv[]) {
 
     p.description("Falicov-Kimball Monte Carlo - parameters from command line");
 
-    qmc_t::define_parameters(p);
+    fk_mc<lattice_t>::define_parameters(p);
 
     p.define<size_t> ("L", 4, "System linear size");
     p.define<double> ("t", 1.0, "Hopping");
@@ -227,23 +421,35 @@ alps::params cmdline_params(int argc, char *argv[]) {
     #elif LATTICE_chain
         p.define<double> ("delta", 0.0, "chain : delta");
         p.define<double> ("eta", 0.0, "chain : eta");
-    #elif LATTICE_cubic1d 
-        p.define<std::vector<double>>( "W", "1d : f-f interaction");
     #endif
+    p.define<std::vector<double>>("W", std::vector<double>(), "f-f interaction : on-site, then on the neighbor shells 1,2,...");
 
     p.define<std::string>("output", "output.h5", "archive to read/write data to");
     p.define<bool>("plaintext", false, "plaintext output level");
     p.define<int>("maxtime", 24*30, "max evaluation time");
     // DOS args
-    p.define<double>("dos_width", 6.0, "Width of DOS");
-    p.define<int>("dos_npts", 240, "Number of points for DOS sampling");
     p.define<double>("dos_offset", 0.05, "DOS offset from real axis");
+    // histogram reweighting
+    p.define<int>("reweight_npts", 0, "Number of points in beta and mu_f to reweight the measurements to (0 = no reweighting)");
+    p.define<double>("reweight_dbeta", 0.0, "Half-width of the reweighting window in beta");
+    p.define<double>("reweight_dmu_f", 0.0, "Half-width of the reweighting window in mu_f");
     // stiffness args
     p.define<int>("cond_npoints", 150, "number of points to sample conductivity");
     // eigenfunctions storage
     p.define<bool>("save_eigenfunctions", false, "Store eigenfunctions?");
 
+    // parameter scan
+    p.define<std::string>("scan_beta", "", "Scan in beta : a list \"a,b,c\" or a range \"min:max:npoints\" (empty = not scanned)");
+    p.define<std::string>("scan_U", "", "Scan in U : a list or a range");
+    p.define<std::string>("scan_mu_c", "", "Scan in mu_c : a list or a range");
+    p.define<std::string>("scan_mu_f", "", "Scan in mu_f : a list or a range");
+    p.define<std::string>("scan_order", "beta,U,mu_c,mu_f", "Order of the scan loops, from the outermost to the innermost");
+    p.define<bool>("scan_snake", true, "Walk every scan loop back and forth, so that the subsequent points are neighbors");
+    p.define<bool>("scan_half_filling", false, "Set mu_c = mu_f = U/2 at every point of the scan");
+    p.define<int>("scan_ntherm_sweeps", -1, "Thermalization sweeps at the points of the scan after the first one (-1 = ntherm_sweeps)");
+
     p.define<bool>("exit", false, "dry_run");
+    p.define<bool>("resume", false, "Continue the chains from their checkpoints, or extend the finished run in output, if the checkpoints are off");
     p.define<size_t>("max_time",size_t(14*24*3600), "Maximum running time in seconds");
 
     return p;
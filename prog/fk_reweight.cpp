@@ -0,0 +1,75 @@
+#include <boost/mpi/environment.hpp>
+#include <sstream>
+
+#include "data_save.hpp"
+#include "reweighting.hpp"
+
+using namespace fk;
+
+// Histogram reweighting of the stored measurements of one or several runs (multi-histogram) to a window of beta and mu_f.
+// The runs have to be done on the same lattice with measure_history and ED (no Chebyshev moves).
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+
+    alps::params p(argc, (const char **) argv);
+    p.description("Falicov-Kimball histogram reweighting");
+    p.define<std::string>("input", "output.h5", "Comma separated list of archives of the runs")
+     .define<std::string>("output", "reweighting.h5", "Archive to write the reweighted data to")
+     .define<double>("beta_min", 1.0, "Smallest beta of the window")
+     .define<double>("beta_max", 1.0, "Largest beta of the window")
+     .define<double>("mu_f_min", 0.5, "Smallest mu_f of the window")
+     .define<double>("mu_f_max", 0.5, "Largest mu_f of the window")
+     .define<int>("npts", 11, "Number of points in beta and mu_f")
+     .define<double>("dos_width", 6.0, "Width of DOS")
+     .define<int>("dos_npts", 240, "Number of points for DOS sampling")
+     .define<double>("dos_offset", 0.05, "DOS offset from real axis")
+     .define<bool>("plaintext", false, "plaintext output level");
+    if (p.help_requested(std::cerr)) return 1;
+
+    std::vector<reweight_run> runs;
+    std::stringstream inputs(p["input"].as<std::string>());
+    std::string fname;
+    std::vector<double> energies0;
+    while (std::getline(inputs, fname, ',')) {
+        alps::hdf5::archive ar(fname, "r");
+        double beta, mu_f;
+        alps::hdf5::load(ar, "/parameters/beta", beta);
+        alps::hdf5::load(ar, "/parameters/mu_f", mu_f);
+        if (!ar.is_data("/mc_data/spectrum_history")) {
+            std::cerr << fname << " : no spectrum history, run with measure_history and without Chebyshev moves" << std::endl;
+            return 1;
+            }
+        std::vector<std::vector<double>> spectrum_history;
+        std::vector<double> nf0, nfpi, energies, c_energies;
+        alps::hdf5::load(ar, "/mc_data/spectrum_history", spectrum_history);
+        alps::hdf5::load(ar, "/mc_data/nf0", nf0);
+        alps::hdf5::load(ar, "/mc_data/nfpi", nfpi);
+        if (ar.is_data("/mc_data/energies") && ar.is_data("/mc_data/c_energies")) {
+            alps::hdf5::load(ar, "/mc_data/energies", energies);
+            alps::hdf5::load(ar, "/mc_data/c_energies", c_energies);
+            }
+        std::cout << fname << " : beta = " << beta << ", mu_f = " << mu_f << ", " << nf0.size() << " samples" << std::endl;
+        if (energies0.empty()) energies0 = energies;
+        runs.emplace_back(beta, mu_f, spectrum_history, nf0, nfpi, energies, c_energies);
+        }
+
+    reweighting rw(runs);
+    for (size_t r=0; r<runs.size(); ++r)
+        std::cout << "run " << r << " : log(Z/Z_0) = " << rw.log_z()[r] << std::endl;
+
+    // bins as in data_saver, the bin is taken from the autocorrelation of the energy of the first run
+    std::vector<double> const& e = energies0.size() ? energies0 : runs[0].nf0;
+    int max_bin = std::min(15,std::max(int(std::log(double(e.size())/16)/std::log(2.)-1),1));
+    size_t bin = estimate_bin(binning::accumulate_binning(e.rbegin(), e.rend(), max_bin));
+
+    size_t dos_npts = p["dos_npts"];
+    double dos_width = p["dos_width"];
+    std::vector<double> wgrid(dos_npts);
+    for (size_t i=0; i<dos_npts; i++) wgrid[i] = -dos_width+2.*dos_width*i/(1.*dos_npts);
+
+    auto points = reweight_grid(p["beta_min"], p["beta_max"], p["mu_f_min"], p["mu_f_max"], p["npts"]);
+    alps::hdf5::archive ar(p["output"].as<std::string>(), "w");
+    save_reweighting(rw, points, wgrid, p["dos_offset"], bin, ar, "/reweighting", p["plaintext"]);
+    return 0;
+}
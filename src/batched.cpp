@@ -0,0 +1,164 @@
+#include "batched.hpp"
+
+namespace fk {
+
+namespace {
+/** Eigenvalues of a batch of symmetric tridiagonal matrices with the diagonals d[i*nbatch + b] and the subdiagonals e[i*nbatch + b]
+ * (e[(n-1)*nbatch + b] = 0) - implicit QL, done in lockstep for the whole batch: the lanes share the loops over the matrix and run through the batch in the innermost loops.
+ * Every matrix joins the chase at its own unreduced block [l, m], the converged and the split ones are masked. d is overwritten. */
+void batched_tridiagonal_ql(double* d, double* e, int n, int nbatch)
+{
+    std::vector<double> tol(nbatch, 0.0), lim(nbatch), m(nbatch), dm(nbatch), g(nbatch), s(nbatch), c(nbatch), p(nbatch), split(nbatch);
+    // the off-diagonal elements are negligible on the scale of the whole matrix - a relative test stalls at zero eigenvalues
+    for (int i=0; i<n; ++i) {
+        double const* di = d + i*nbatch, *ei = e + i*nbatch, *ej = e + (i ? i-1 : 0)*nbatch;
+        for (int b=0; b<nbatch; ++b) tol[b] = std::max(tol[b], std::abs(di[b]) + std::abs(ei[b]) + (i ? std::abs(ej[b]) : 0.0));
+        }
+    for (int b=0; b<nbatch; ++b) tol[b] *= std::numeric_limits<double>::epsilon();
+
+    for (int l=0; l<n-1; ++l) {
+        for (int iter=0; iter<64; ++iter) {
+            // the first negligible subdiagonal element m >= l of every matrix, m = l if d[l] has converged
+            double const* dn = d + (n-1)*nbatch;
+            for (int b=0; b<nbatch; ++b) { lim[b] = n-1; dm[b] = dn[b]; }
+            for (int k=n-2; k>=l; --k) {
+                double const* dk = d + k*nbatch, *ek = e + k*nbatch;
+                for (int b=0; b<nbatch; ++b) {
+                    bool small = std::abs(ek[b]) <= tol[b];
+                    lim[b] = small ? k : lim[b];
+                    dm[b] = small ? dk[b] : dm[b];
+                    }
+                }
+            double mmax = l;
+            for (int b=0; b<nbatch; ++b) { lim[b] = lim[b] > l ? lim[b] : -1.0; mmax = std::max(mmax, lim[b]); }
+            if (mmax <= l) break;
+            m = lim;
+
+            // the shifts
+            double* dl = d + l*nbatch, *dl1 = dl + nbatch, *el = e + l*nbatch;
+            for (int b=0; b<nbatch; ++b) {
+                double gg = (dl1[b] - dl[b]) / (2.0*el[b]);
+                double r = std::sqrt(gg*gg + 1.0);
+                g[b] = dm[b] - dl[b] + el[b] / (gg + std::copysign(r, gg));
+                s[b] = 1.0; c[b] = 1.0; p[b] = 0.0; split[b] = 0.0;
+                }
+            // the rotations from m - 1 down to l, a matrix, that splits (r = 0), leaves the chase
+            for (int i=int(mmax)-1; i>=l; --i) {
+                double* di = d + i*nbatch, *di1 = di + nbatch, *ei = e + i*nbatch, *ei1 = ei + nbatch;
+                for (int b=0; b<nbatch; ++b) {
+                    double f = s[b]*ei[b], bb = c[b]*ei[b];
+                    double r = std::sqrt(f*f + g[b]*g[b]);
+                    bool on = i < lim[b], rot = on & (r != 0.0), sp = on & (r == 0.0);
+                    double ir = 1.0 / (rot ? r : 1.0);
+                    double sn = f*ir, cn = g[b]*ir;
+                    double gn = di1[b] - p[b];
+                    double rn = (di[b] - gn)*sn + 2.0*cn*bb;
+                    double pn = sn*rn;
+                    ei1[b] = on ? r : ei1[b];
+                    di1[b] = rot ? gn + pn : di1[b] - (sp ? p[b] : 0.0);
+                    s[b] = rot ? sn : s[b];
+                    c[b] = rot ? cn : c[b];
+                    g[b] = rot ? cn*rn - bb : g[b];
+                    p[b] = rot ? pn : p[b];
+                    split[b] = sp ? 1.0 : split[b];
+                    lim[b] = sp ? -1.0 : lim[b];
+                    }
+                }
+            for (int b=0; b<nbatch; ++b) {
+                if (m[b] < 0) continue;
+                if (!split[b]) { dl[b] -= p[b]; el[b] = g[b]; }
+                e[int(m[b])*nbatch + b] = 0.0;
+                }
+            }
+        }
+}
+
+/// Sort the columns x[i*nbatch + b] of a batch in ascending order - odd-even transposition sort, the same compare-exchange for every column
+void batched_sort(double* x, int n, int nbatch)
+{
+    for (int pass=0; pass<n; ++pass)
+        for (int i=pass%2; i+1<n; i+=2) {
+            double* xi = x + i*nbatch, *xj = xi + nbatch;
+            for (int b=0; b<nbatch; ++b) {
+                double lo = std::min(xi[b], xj[b]), hi = std::max(xi[b], xj[b]);
+                xi[b] = lo; xj[b] = hi;
+                }
+            }
+}
+}
+
+void batched_eigenvalues(std::vector<double>& a, int n, int nbatch, std::vector<double>& evals)
+{
+    auto at = [&a, n, nbatch](int i, int j) { return a.data() + (i*n + j)*nbatch; };
+    // Householder vectors, A v and the norms for the whole batch, v[i*nbatch + b]
+    std::vector<double> v(n*nbatch), p(n*nbatch), alpha(nbatch), tau(nbatch), kk(nbatch);
+    std::vector<double> diag(n*nbatch), sub(n*nbatch, 0.0);
+
+    // tridiagonalization, the same sequence of operations for every matrix
+    for (int k=0; k<n-2; ++k) {
+        // the reflection, that zeroes the column k below the subdiagonal
+        std::fill(alpha.begin(), alpha.end(), 0.0);
+        for (int i=k+1; i<n; ++i) {
+            double const* aik = at(i,k);
+            for (int b=0; b<nbatch; ++b) alpha[b] += aik[b]*aik[b];
+            }
+        double const* a1k = at(k+1,k);
+        for (int b=0; b<nbatch; ++b) {
+            double x0 = a1k[b], norm = std::sqrt(alpha[b]);
+            alpha[b] = -std::copysign(norm, x0);
+            double vnorm2 = 2.0*(norm*norm - x0*alpha[b]);
+            // a zero column needs no reflection
+            tau[b] = vnorm2 > 0.0 ? 2.0 / vnorm2 : 0.0;
+            v[(k+1)*nbatch + b] = x0 - alpha[b];
+            }
+        for (int i=k+2; i<n; ++i) {
+            double const* aik = at(i,k);
+            for (int b=0; b<nbatch; ++b) v[i*nbatch + b] = aik[b];
+            }
+
+        // A <- H A H on the trailing block : p = tau A v, w = p - (tau/2 v.p) v, A <- A - v w^T - w v^T
+        std::fill(kk.begin(), kk.end(), 0.0);
+        for (int i=k+1; i<n; ++i) {
+            double* pi = &p[i*nbatch];
+            std::fill(pi, pi + nbatch, 0.0);
+            for (int j=k+1; j<n; ++j) {
+                double const* aij = at(i,j);
+                double const* vj = &v[j*nbatch];
+                for (int b=0; b<nbatch; ++b) pi[b] += aij[b]*vj[b];
+                }
+            double const* vi = &v[i*nbatch];
+            for (int b=0; b<nbatch; ++b) { pi[b] *= tau[b]; kk[b] += vi[b]*pi[b]; }
+            }
+        for (int b=0; b<nbatch; ++b) kk[b] *= 0.5*tau[b];
+        for (int i=k+1; i<n; ++i) {
+            double* pi = &p[i*nbatch];
+            double const* vi = &v[i*nbatch];
+            for (int b=0; b<nbatch; ++b) pi[b] -= kk[b]*vi[b];
+            }
+        for (int i=k+1; i<n; ++i) {
+            double const* vi = &v[i*nbatch];
+            double const* wi = &p[i*nbatch];
+            for (int j=k+1; j<=i; ++j) {
+                double* aij = at(i,j);
+                double const* vj = &v[j*nbatch];
+                double const* wj = &p[j*nbatch];
+                for (int b=0; b<nbatch; ++b) aij[b] -= vi[b]*wj[b] + wi[b]*vj[b];
+                }
+            // keep the block symmetric for the next A v
+            for (int j=k+1; j<i; ++j) std::copy(at(i,j), at(i,j) + nbatch, at(j,i));
+            }
+
+        std::copy(at(k,k), at(k,k) + nbatch, &diag[k*nbatch]);
+        std::copy(alpha.begin(), alpha.end(), &sub[k*nbatch]);
+        }
+    for (int k=std::max(n-2, 0); k<n; ++k) std::copy(at(k,k), at(k,k) + nbatch, &diag[k*nbatch]);
+    if (n > 1) std::copy(at(n-1,n-2), at(n-1,n-2) + nbatch, &sub[(n-2)*nbatch]);
+
+    // eigenvalues of the tridiagonal matrices
+    std::fill(&sub[(n-1)*nbatch], &sub[n*nbatch], 0.0);
+    batched_tridiagonal_ql(diag.data(), sub.data(), n, nbatch);
+    batched_sort(diag.data(), n, nbatch);
+    evals.swap(diag);
+}
+
+} // end of namespace fk
@@ -1,5 +1,7 @@
 #include "fk_mc/configuration.hpp"
 
+#include <mutex>
+
 #include "../eigen/ArpackSupport"
 
 namespace fk {
@@ -18,6 +20,14 @@ configuration_t::configuration_t(
     hamilt_(lattice_.hopping_m().rows(), lattice_.hopping_m().cols())
 { 
     f_config_.setZero(); 
+    init_ff_shells_();
+}
+
+void configuration_t::init_ff_shells_()
+{
+    size_t nshells = params_.W.size() > 1 ? params_.W.size() - 1 : 0;
+    if (nshells && (!ff_shells_ || ff_shells_->size() < nshells)) 
+        ff_shells_ = std::make_shared<const lattice_base::neighbor_shells_t>(lattice_.neighbor_shells(nshells));
 }
 
 /*
@@ -35,7 +45,10 @@ configuration_t& configuration_t::operator=(const configuration_t& rhs)
     hamilt_ = rhs.hamilt_;
     ed_data_ = rhs.ed_data_;
     cheb_data_ = rhs.cheb_data_;
-    if (!(params_ == rhs.params_)) throw (std::logic_error("Mismatched parameters in config assignment"));
+    params_ = rhs.params_;
+    ff_shells_ = rhs.ff_shells_;
+    ff_energy_ = rhs.ff_energy_;
+    ff_valid_ = rhs.ff_valid_;
     return *this;
 };
 
@@ -55,35 +68,76 @@ void configuration_t::randomize_f(random_generator &rnd, size_t nf){
         while (f_config_(ind)==1) ind = distr(rnd);//(lattice_.get_msize());
         f_config_(ind) = 1; 
     };
+    ff_valid_ = false;
 }
 
 
 double configuration_t::calc_ff_energy() const 
 {
-    // 1D - easy to add f-f interactions
-    if (this->lattice_.ndim() != 1) return 0;
+    if (ff_valid_) return ff_energy_;
     double e = 0;
-    size_t V = lattice_.get_msize();
-    for (int i = 0; i < V; ++i) {  
-        if (!f_config_(i)) continue;
-        for (int l = 0; l < params_.W.size(); ++l) { 
-            int left = (i - l + V)%V;
-            int right = (i + l)%V;
-            double el = params_.W[l] * f_config_(left);
-            double er = params_.W[l] * f_config_(right); 
-            e+=el;
-            e+=er * (l>0);
+    if (!params_.W.empty()) 
+        for (size_t i = 0; i < lattice_.get_msize(); ++i) {  
+            if (!f_config_(i)) continue;
+            e += params_.W[0];
+            for (size_t l = 1; l < params_.W.size(); ++l) 
+                for (size_t j : (*ff_shells_)[l-1][i]) e += params_.W[l] * f_config_(j);
             }
-        }
+    ff_energy_ = e;
+    ff_valid_ = true;
     return e;
 }
 
+double configuration_t::calc_ff_energy_diff(size_t i) const 
+{
+    if (params_.W.empty()) return 0;
+    // every pair enters calc_ff_energy twice
+    double de = params_.W[0];
+    for (size_t l = 1; l < params_.W.size(); ++l) { 
+        int n = 0;
+        for (size_t j : (*ff_shells_)[l-1][i]) n += f_config_(j);
+        de += 2. * params_.W[l] * n;
+        }
+    return f_config_(i) ? -de : de;
+}
+
+double configuration_t::calc_ff_energy_diff(std::vector<size_t> const& sites) const 
+{
+    if (params_.W.empty()) return 0;
+    double de = 0;
+    for (size_t k = 0; k < sites.size(); ++k) { 
+        size_t i = sites[k];
+        de += calc_ff_energy_diff(i);
+        // the sites are flipped one after another - correct for the pairs with the already flipped ones
+        for (size_t m = 0; m < k; ++m) 
+            for (size_t l = 1; l < params_.W.size(); ++l) { 
+                auto const& shell = (*ff_shells_)[l-1][i];
+                if (std::binary_search(shell.begin(), shell.end(), sites[m])) 
+                    de += 2. * params_.W[l] * (1 - 2*f_config_(i)) * (1 - 2*f_config_(sites[m]));
+                }
+        }
+    return de;
+}
+
 const typename configuration_t::sparse_m& configuration_t::calc_hamiltonian()
 {
     reset_cache();
-    hamilt_.reserve(lattice_.hopping_m().nonZeros() + lattice_.get_msize());
+    ff_valid_ = false;
     hamilt_ = lattice_.hopping_m();
     for (size_t i=0; i<lattice_.get_msize(); ++i) hamilt_.coeffRef(i,i)+= -params_.mu_c + params_.U*f_config_(i); // unoptimized
+    // the diagonal is inserted now - compress, so that the hamiltonian can be rebuilt in place and update_hamiltonian only changes the values
+    hamilt_.makeCompressed();
+    return hamilt_;
+}
+
+const typename configuration_t::sparse_m& configuration_t::update_hamiltonian(std::vector<size_t> const& sites)
+{
+    // calc_hamiltonian stores the whole diagonal
+    assert(size_t(hamilt_.nonZeros()) >= lattice_.get_msize() && "update_hamiltonian needs a hamiltonian from calc_hamiltonian");
+    reset_cache();
+    // the diff from the new configuration back to the old one
+    if (ff_valid_) ff_energy_ -= calc_ff_energy_diff(sites);
+    for (size_t i : sites) hamilt_.coeffRef(i,i) = lattice_.hopping_m().coeff(i,i) - params_.mu_c + params_.U*f_config_(i);
     return hamilt_;
 }
 
@@ -92,8 +146,14 @@ void configuration_t::calc_chebyshev( const chebyshev::chebyshev_eval& cheb)
     if (int(cheb_data_.status) >= int(chebyshev_cache::logz)) return;
     sparse_m x = hamilt_; 
     size_t msize = lattice_.get_msize();
-    double e_min = Eigen::ArpackGeneralizedSelfAdjointEigenSolver<sparse_m>(hamilt_,1,"SA",Eigen::EigenvaluesOnly).eigenvalues()[0];
-    double e_max = Eigen::ArpackGeneralizedSelfAdjointEigenSolver<sparse_m>(hamilt_,1,"LA",Eigen::EigenvaluesOnly).eigenvalues()[0];
+    double e_min, e_max;
+    {
+        // Arpack keeps its state in static fortran variables - it can not be called from several threads at once
+        static std::mutex arpack_mutex;
+        std::lock_guard<std::mutex> lock(arpack_mutex);
+        e_min = Eigen::ArpackGeneralizedSelfAdjointEigenSolver<sparse_m>(hamilt_,1,"SA",Eigen::EigenvaluesOnly).eigenvalues()[0];
+        e_max = Eigen::ArpackGeneralizedSelfAdjointEigenSolver<sparse_m>(hamilt_,1,"LA",Eigen::EigenvaluesOnly).eigenvalues()[0];
+    }
     double a = (e_max - e_min)/2.;
     double b = (e_max + e_min)/2.; 
     double beta = params_.beta;
@@ -192,14 +252,18 @@ void configuration_t::calc_chebyshev( const chebyshev::chebyshev_eval& cheb)
     assert(m==cheb_size/2+1);
 
     std::function<double(double)> logz_f = [a,b,beta,msize](double w){return msize*log(1. + exp(-beta*(a*w+b)));}; 
-    double s = cheb.moment_f(logz_f, 0);
-    for (m=1; m<cheb_size; m++) s+=2.*cheb.moment_f(logz_f, m)*cheb_data_.moments[m];
-
-    cheb_data_.logZ = s;
+    cheb_data_.logZ = chebyshev::trace_f(cheb, cheb_data_.moments, logz_f);
     cheb_data_.x.swap(x);
     cheb_data_.status = chebyshev_cache::logz;
 }
 
+double configuration_t::calc_logz(const chebyshev::chebyshev_eval* cheb)
+{
+    if (cheb) { calc_chebyshev(*cheb); return cheb_data_.logZ; }
+    calc_ed(false);
+    return ed_data_.logZ;
+}
+
 void configuration_t::calc_ed(bool calc_evecs)
 {
     if ( (ed_data_.status == ed_cache::spectrum && !calc_evecs) || (ed_data_.status == ed_cache::full && calc_evecs)) return;
@@ -216,6 +280,11 @@ void configuration_t::calc_ed(bool calc_evecs)
     //std::sort (cached_spectrum.data(), cached_spectrum.data()+cached_spectrum.size());  
     //FKDEBUG((Eigen::VectorXd(cached_spectrum - s2)).squaredNorm());
 
+    calc_ed_weights();
+}
+
+void configuration_t::calc_ed_weights()
+{
     const auto& cached_spectrum = ed_data_.cached_spectrum;
 
     double beta = params_.beta;
@@ -240,6 +309,38 @@ void configuration_t::calc_ed(bool calc_evecs)
 
 }
 
+double configuration_t::logz_at(double beta, const chebyshev::chebyshev_eval* cheb)
+{
+    calc_logz(cheb);
+    // log(1 + exp(-beta*e)) without overflows
+    auto log1p_exp = [beta](double e) { return std::max(-beta*e, 0.0) + std::log1p(std::exp(-beta*std::abs(e))); };
+    if (cheb) { 
+        double a = cheb_data_.a, b = cheb_data_.b;
+        size_t msize = lattice_.get_msize();
+        std::function<double(double)> logz_f = [a,b,msize,&log1p_exp](double w){return msize*log1p_exp(a*w+b);}; 
+        return chebyshev::trace_f(*cheb, cheb_data_.moments, logz_f);
+        }
+    double logz = 0.0;
+    for (size_t i=0; i<ed_data_.cached_spectrum.size(); ++i) logz += log1p_exp(ed_data_.cached_spectrum[i]);
+    return logz;
+}
+
+void configuration_t::set_params(config_params const& p)
+{
+    double tol = std::numeric_limits<double>::epsilon(); 
+    bool hamiltonian_changed = std::abs(p.U - params_.U) > tol || std::abs(p.mu_c - params_.mu_c) > tol;
+    bool beta_changed = std::abs(p.beta - params_.beta) > tol;
+    if (p.W != params_.W) ff_valid_ = false;
+    params_ = p;
+    init_ff_shells_();
+    if (hamiltonian_changed) { calc_hamiltonian(); return; }
+    if (beta_changed) { 
+        // the spectrum and the moments do not depend on beta
+        if (ed_data_.status != ed_cache::empty) calc_ed_weights();
+        cheb_data_.status = chebyshev_cache::empty;
+        }
+}
+
 
 
 } // end of namespace fk
@@ -0,0 +1,97 @@
+#include "fk_mc/convergence.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace alps {
+
+void online_binning::add(double x)
+{
+    for (size_t k = 0; ; ++k) {
+        if (k == levels_.size()) levels_.emplace_back();
+        level &l = levels_[k];
+        l.n++;
+        l.sum += x;
+        l.sum2 += x * x;
+        if (!l.has_pending) { l.pending = x; l.has_pending = true; return; }
+        // the bin is full, its mean goes to the next level
+        x = 0.5 * (l.pending + x);
+        l.has_pending = false;
+    }
+}
+
+double online_binning::level_error(size_t k) const
+{
+    if (k >= levels_.size() || levels_[k].n < 2) return 0.0;
+    level const &l = levels_[k];
+    double mean = l.sum / l.n;
+    double var = std::max(l.sum2 / l.n - mean * mean, 0.0) * l.n / (l.n - 1);
+    return std::sqrt(var / l.n);
+}
+
+double online_binning::error(long min_bins) const
+{
+    double err = level_error(0);
+    for (size_t k = 1; k < levels_.size() && levels_[k].n >= min_bins; ++k) err = std::max(err, level_error(k));
+    return err;
+}
+
+double online_binning::tau(long min_bins) const
+{
+    double err0 = level_error(0);
+    if (err0 <= 0) return 0.0;
+    double r = error(min_bins) / err0;
+    return 0.5 * (r * r - 1.0);
+}
+
+size_t mser_truncation(std::vector<double> const &x, size_t batch)
+{
+    size_t nb = x.size() / batch;
+    if (nb < 20) return x.size();
+    std::vector<double> y(nb, 0.0);
+    for (size_t j = 0; j < nb; ++j) {
+        for (size_t i = 0; i < batch; ++i) y[j] += x[j * batch + i];
+        y[j] /= batch;
+    }
+    // suffix sums give the statistic for all truncation points in one pass from the end
+    double s = 0.0, s2 = 0.0, best = std::numeric_limits<double>::max();
+    size_t best_d = nb;
+    for (size_t d = nb; d-- > 0;) {
+        s += y[d];
+        s2 += y[d] * y[d];
+        if (d > nb / 2) continue;
+        double m = nb - d;
+        double mser = (s2 - s * s / m) / (m * m);
+        if (mser <= best) { best = mser; best_d = d; }
+    }
+    return best_d == nb / 2 ? x.size() : best_d * batch;
+}
+
+double integrated_autocorrelation(std::vector<double> const &x, double c)
+{
+    size_t n = x.size();
+    if (n < 8) return 0.5;
+    double mean = 0.0;
+    for (double v : x) mean += v;
+    mean /= n;
+    double c0 = 0.0;
+    for (double v : x) c0 += (v - mean) * (v - mean);
+    if (c0 <= 0) return 0.5;
+    double tau = 0.5;
+    for (size_t t = 1; t < n / 4; ++t) {
+        double ct = 0.0;
+        for (size_t i = 0; i + t < n; ++i) ct += (x[i] - mean) * (x[i + t] - mean);
+        tau += ct / c0;
+        if (t >= c * tau) break;
+    }
+    return std::max(tau, 0.5);
+}
+
+double convergence_monitor::rel_error() const
+{
+    double mean = std::abs(binning.mean());
+    return mean > 0 ? binning.error() / mean : std::numeric_limits<double>::infinity();
+}
+
+} // end of namespace alps
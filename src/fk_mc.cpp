@@ -1,4 +1,5 @@
 #include "fk_mc.hxx"
+#include <boost/mpi/collectives.hpp>
 
 #include "lattice/hypercubic.hpp"
 #include "lattice/triangular.hpp"
@@ -27,6 +28,11 @@ void observables_t::reserve(int n)
     nq_history.reserve(n);       // nqpts x n_measures size
     fsuscq_history.reserve(n);   // nqpts x n_measures size
     eigenfunctions_history.reserve(n);   // L^D * L^D * n_measures size (huge)
+    kpm_moments_history.reserve(n); // kpm_moments x n_measures size
+    ldos_log_history.reserve(n); // dos_npts x n_measures size
+    ldos_history.reserve(n); // dos_npts x n_measures size
+    spectral_moments_history.reserve(n); // (nkpoints * kpm_moments) x n_measures size
+    recycled_history.reserve(n); // nvalues x n_measures size
 }
 
 template<typename T>
@@ -45,12 +51,39 @@ void auto_merge_vv(T& in, T& out)
     if (out.size() > 0) { for (int i=0; i<out.size(); i++) auto_merge(in[i], out[i]); } 
 }
 
+void observables_t::swap(observables_t& rhs)
+{
+    energies.swap(rhs.energies);
+    c_energies.swap(rhs.c_energies);
+    d2energies.swap(rhs.d2energies);
+    nf0.swap(rhs.nf0);
+    nfpi.swap(rhs.nfpi);
+    spectrum.swap(rhs.spectrum);
+    spectrum_history.swap(rhs.spectrum_history);
+    ipr_history.swap(rhs.ipr_history);
+    stiffness.swap(rhs.stiffness);
+    cond_history.swap(rhs.cond_history);
+    focc_history.swap(rhs.focc_history);
+    nq_history.swap(rhs.nq_history);
+    fsuscq_history.swap(rhs.fsuscq_history);
+    eigenfunctions_history.swap(rhs.eigenfunctions_history);
+    kpm_moments_history.swap(rhs.kpm_moments_history);
+    ldos_log_history.swap(rhs.ldos_log_history);
+    ldos_history.swap(rhs.ldos_history);
+    spectral_moments_history.swap(rhs.spectral_moments_history);
+    recycled_history.swap(rhs.recycled_history);
+    recycled_spectrum.swap(rhs.recycled_spectrum);
+    recycled_fcorrel.swap(rhs.recycled_fcorrel);
+}
+
 void observables_t::merge(observables_t& rhs)
 {
     if (rhs.nfpi.size()==0) return;
     if (this->nfpi.size()==0) { std::swap(*this, rhs); return; }
     auto_merge(energies, rhs.energies);
+    auto_merge(c_energies, rhs.c_energies);
     auto_merge(d2energies, rhs.d2energies);
+    auto_merge(stiffness, rhs.stiffness);
     auto_merge(nf0, rhs.nf0);
     auto_merge(nfpi, rhs.nfpi);
     auto_merge(spectrum, rhs.spectrum);
@@ -58,10 +91,52 @@ void observables_t::merge(observables_t& rhs)
 
     auto_merge_vv(spectrum_history, rhs.spectrum_history);
     auto_merge_vv(ipr_history, rhs.ipr_history);
+    auto_merge_vv(cond_history, rhs.cond_history);
     auto_merge_vv(focc_history, rhs.focc_history);
     auto_merge_vv(nq_history, rhs.nq_history);
     auto_merge_vv(fsuscq_history, rhs.fsuscq_history);
+    auto_merge_vv(kpm_moments_history, rhs.kpm_moments_history);
+    auto_merge_vv(ldos_log_history, rhs.ldos_log_history);
+    auto_merge_vv(ldos_history, rhs.ldos_history);
+    auto_merge_vv(spectral_moments_history, rhs.spectral_moments_history);
+    auto_merge_vv(recycled_history, rhs.recycled_history);
 } 
 
 
+observables_t gather_observables(boost::mpi::communicator const& comm, observables_t const& local)
+{
+    std::vector<observables_t> all;
+    boost::mpi::gather(comm, local, all, 0);
+    observables_t out;
+    for (auto &o : all) out.merge(o);
+    // the running average of the spectrum is not additive over chains, that visit different parameters
+    out.spectrum.clear();
+    out.recycled_spectrum.clear();
+    out.recycled_fcorrel.clear();
+    return out;
+}
+
+observables_t gather_observables_averaged(boost::mpi::communicator const& comm, observables_t const& local)
+{
+    std::vector<double> observables_t::* averages[] = { &observables_t::spectrum, &observables_t::recycled_spectrum, &observables_t::recycled_fcorrel };
+    double nmeasures = local.nf0.size(), nmeasures_all = 0.0;
+    boost::mpi::reduce(comm, nmeasures, nmeasures_all, std::plus<double>(), 0);
+    std::vector<std::vector<double>> sums_all;
+    for (auto avg : averages) {
+        std::vector<double> sum = local.*avg;
+        for (auto& x : sum) x *= nmeasures;
+        sums_all.emplace_back(sum.size(), 0.0);
+        boost::mpi::reduce(comm, sum.data(), sum.size(), sums_all.back().data(), std::plus<double>(), 0);
+        }
+
+    observables_t out = gather_observables(comm, local);
+    if (!comm.rank() && nmeasures_all > 0)
+        for (size_t k=0; k<sums_all.size(); ++k) {
+            out.*averages[k] = sums_all[k];
+            for (auto& x : out.*averages[k]) x /= nmeasures_all;
+            }
+    return out;
+}
+
+
 } // end of namespace FK
@@ -45,8 +45,8 @@ std::array<std::array<int, D>, 2*D> hypercubic_lattice<D>::neighbor_pos(std::arr
     std::array<std::array<int, D>, 2*D> result;
 
     for (int i = 0; i < D; ++i) {
-        result[2*i].fill(0);
-        result[2*i+1].fill(0);
+        result[2*i] = pos;
+        result[2*i+1] = pos;
         result[2*i][i] = pos[i] == 0 ? dims[i] - 1 : pos[i] - 1;
         result[2*i+1][i] = pos[i] == dims[i] - 1 ? 0 : pos[i] + 1;
     }
@@ -93,6 +93,39 @@ std::vector<typename hypercubic_lattice<D>::BZPoint> hypercubic_lattice<D>::get_
     return out;
 }
 
+template <size_t D>
+std::vector<typename hypercubic_lattice<D>::BZPoint> hypercubic_lattice<D>::get_bzpath(std::vector<BZPoint> corners) const
+{
+    std::vector<BZPoint> out;
+    if (!corners.size()) return out;
+    for (size_t c=0; c+1<corners.size(); ++c) { 
+        auto pos0 = index_to_pos(size_t(corners[c])), pos1 = index_to_pos(size_t(corners[c+1]));
+        int nsteps = 0;
+        for (size_t i=0; i<D; i++) nsteps = std::max(nsteps, std::abs(pos1[i] - pos0[i]));
+        for (int s=0; s<nsteps; s++) { 
+            auto pos = pos0;
+            for (size_t i=0; i<D; i++) pos[i] = pos0[i] + int(std::round(double(s)*(pos1[i] - pos0[i])/nsteps));
+            out.push_back(this->get_bzpoint(pos_to_index(pos)));
+            }
+        }
+    out.push_back(corners.back());
+    return out;
+}
+
+template <size_t D>
+std::vector<typename hypercubic_lattice<D>::BZPoint> hypercubic_lattice<D>::get_high_symmetry_path() const
+{
+    std::array<int, D> pos; 
+    pos.fill(0);
+    std::vector<BZPoint> corners(1, this->get_bzpoint(pos_to_index(pos)));
+    for (size_t i=0; i<D; i++) { 
+        pos[i] = dims[i]/2;
+        corners.push_back(this->get_bzpoint(pos_to_index(pos)));
+        }
+    if (D > 1) corners.push_back(corners[0]);
+    return get_bzpath(corners);
+}
+
 template <size_t D>
 void hypercubic_lattice<D>::fill(double t)
 {
@@ -1,5 +1,12 @@
 #include "fk_mc/mc_metropolis.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
 namespace alps {
 
 namespace extra {
@@ -13,7 +20,19 @@ mc_metropolis::parameters_type &mc_metropolis::define_parameters(parameters_type
     p.define<int>("nsweeps", 1024, "Total number of sweeps (1 sweep = #sweep_len moves + 1 measurement)")
         .define<int>("sweep_len", 16, "Number of moves between subsequent measurements")
         .define<int>("ntherm_sweeps", 1, "How many sweeps to do before start measuring")
-        .define<bool>("show_output", true, "Show run progress of mc");
+        .define<bool>("show_output", true, "Show run progress of mc")
+        .define<int>("nthreads", 1, "Number of threads per process, used by the moves with several trial configurations")
+        .define<int>("nspeculative", 0, "Number of proposals evaluated in parallel, assuming the previous ones are rejected (0 = sequential update)")
+        .define<bool>("adapt_moves", false, "Retune the move weights during the thermalization to maximize the accepted moves per second")
+        .define<int>("adapt_interval", 16, "Number of sweeps between the adaptations of the move weights")
+        .define<double>("adapt_min_weight", 0.05, "Minimal fraction of each move after the adaptation of the weights")
+        .define<bool>("auto_therm", false, "End the thermalization, when the monitored series pass the MSER test (ntherm_sweeps is the upper limit)")
+        .define<double>("target_rel_error", 0.0, "Stop, when the binning errors of the monitored means are below this relative error (0 = off, nsweeps is the upper limit)")
+        .define<int>("convergence_interval", 64, "Number of sweeps between the checks of the thermalization and of the error target")
+        .define<bool>("adapt_sweep_len", false, "Set sweep_len after the thermalization, so that the fastest monitored series decorrelates in about one sweep")
+        .define<int>("expensive_skip", 1, "Do the expensive measures every expensive_skip sweeps (0 = about once per autocorrelation time of the slowest monitored series)")
+        .define<std::string>("checkpoint", "", "Prefix of the checkpoint files, one per chain (empty = no checkpoints)")
+        .define<int>("checkpoint_interval", 1800, "Number of seconds between the checkpoints");
     p["nprocs"] = 1;
     return p;
 }
@@ -21,43 +40,365 @@ mc_metropolis::parameters_type &mc_metropolis::define_parameters(parameters_type
 mc_metropolis::mc_metropolis(parameters_type const &p, int rank) :
 // warning : define_parameters should be called first
     alps::mcbase(p, rank),
+    adapt_moves_(p["adapt_moves"]),
+    adapt_interval_(std::max(p["adapt_interval"].as<int>(), 1)),
+    adapt_min_weight_(p["adapt_min_weight"]),
+    auto_therm_(p["auto_therm"]),
+    target_rel_error_(p["target_rel_error"]),
+    convergence_interval_(std::max(p["convergence_interval"].as<int>(), 1)),
+    adapt_sweep_len_(p["adapt_sweep_len"]),
+    expensive_skip_(std::max(p["expensive_skip"].as<int>(), 0)),
 #warning SEED is signed (alpscore)
-    random(p["SEED"].as<long>() + rank),
+    random(p["SEED"].as<long>(), rank),
     rank_(rank),
+    pool_(std::make_shared<thread_pool>(p["nthreads"].as<int>())),
+    nspeculative_(p["nspeculative"]),
     measure_sweeps_(p["nsweeps"]),
     sweep_len_(p["sweep_len"]),
     thermalization_sweeps_(p["ntherm_sweeps"]),
     nprocs_(p["nprocs"]) {
     moves_.reserve(20);
+    std::string prefix = p["checkpoint"].as<std::string>();
+    if (!prefix.empty()) checkpoint_file_ = prefix + "." + std::to_string(rank);
+    checkpoint_interval_ = std::chrono::seconds(std::max(p["checkpoint_interval"].as<int>(), 1));
+    next_checkpoint_ = std::chrono::steady_clock::now() + checkpoint_interval_;
 }
 
 void mc_metropolis::update() {
+    if (rejection_free_) { update_rejection_free(); return; }
     if (!moves_.size()) {
         std::cout << ALPS_STACKTRACE;
         throw std::logic_error("No registered moves");
     }
+    nsteps_ += sweep_len_;
+    if (nspeculative_ > 1) update_speculative();
+    else update_sequential();
+    if (adapt_moves_ && sweep_count_ <= thermalization_sweeps_ && sweep_count_ % adapt_interval_ == 0) adapt_move_weights();
+};
+
+void mc_metropolis::update_sequential() {
     // Select a random move and do it
     for (size_t m = 0; m < sweep_len_; m++) {
         auto move_index = move_distrib_(random);
+        auto &stats = move_stats_[move_index];
+        auto start = std::chrono::steady_clock::now();
         mc_weight_t weight = moves_[move_index].attempt();
+        stats.nattempt++;
+        if (recycling_) recycle_proposal(moves_[move_index], weight);
         if (std::abs(weight) > metropolis_distrib_(random)) {
             weight *= moves_[move_index].accept();
             naccept_++;
+            stats.naccept++;
             phase_ *= extra::sgn(weight);
             assert(std::abs(std::abs(phase_) - 1.0) < 1e-8);
         }
         else moves_[move_index].reject();
+        stats.time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     };
     sweep_count_++;
 };
 
+void mc_metropolis::update_speculative() {
+    if (spec_moves_.empty()) {
+        for (auto &move : moves_) 
+            if (!move.splittable()) {
+                if (!rank_) std::cerr << "Not all moves support speculative evaluation, using sequential update" << std::endl;
+                nspeculative_ = 0;
+                update_sequential();
+                return;
+            }
+        spec_moves_.resize(nspeculative_);
+        for (auto &slot : spec_moves_) for (auto &move : moves_) slot.push_back(move.clone());
+    }
+
+    std::vector<int> move_index(nspeculative_);
+    std::vector<mc_weight_t> weight(nspeculative_);
+    std::vector<double> metropolis_u(nspeculative_);
+    std::vector<random_generator> rng_after(nspeculative_);
+    for (size_t m = 0; m < sweep_len_;) {
+        size_t nspec = std::min<size_t>(nspeculative_, sweep_len_ - m);
+        // draw the random numbers in the same order, as the sequential update would do for a chain of rejected moves
+        for (size_t j = 0; j < nspec; j++) {
+            move_index[j] = move_distrib_(random);
+            spec_moves_[j][move_index[j]].propose();
+            metropolis_u[j] = metropolis_distrib_(random);
+            rng_after[j] = random;
+        }
+        auto start = std::chrono::steady_clock::now();
+        pool_->parallel_for(nspec, [&](size_t j) { weight[j] = spec_moves_[j][move_index[j]].evaluate(); });
+        // the wall time of the batch is shared by all proposals in it, including the discarded ones
+        double batch_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (size_t j = 0; j < nspec; j++) move_stats_[move_index[j]].time += batch_time / nspec;
+        // commit in order up to the first accepted move, the rest of the speculative work is discarded
+        size_t j = 0;
+        for (; j < nspec; j++) {
+            auto &move = spec_moves_[j][move_index[j]];
+            move_stats_[move_index[j]].nattempt++;
+            if (recycling_) recycle_proposal(move, weight[j]);
+            if (std::abs(weight[j]) > metropolis_u[j]) {
+                weight[j] *= move.accept();
+                naccept_++;
+                move_stats_[move_index[j]].naccept++;
+                phase_ *= extra::sgn(weight[j]);
+                assert(std::abs(std::abs(phase_) - 1.0) < 1e-8);
+                random = rng_after[j];
+                break;
+            }
+            else move.reject();
+        }
+        m += std::min(j + 1, nspec);
+    };
+    sweep_count_++;
+}
+
+void mc_metropolis::update_rejection_free() {
+    double t = sweep_len_;
+    if (residence_left_ < 0) residence_left_ = rejection_free_.residence_time();
+    while (residence_left_ <= t) {
+        t -= residence_left_;
+        rejection_free_.advance();
+        naccept_++;
+        residence_left_ = rejection_free_.residence_time();
+    }
+    residence_left_ -= t;
+    nsteps_ += sweep_len_;
+    sweep_count_++;
+}
+
+void mc_metropolis::recycle_proposal(move_wrap const &move, mc_weight_t weight) {
+    if (measure_count_ < thermalization_sweeps_) return;
+    double acceptance = std::min(1.0, std::abs(weight));
+    for (auto &measure : measures_) 
+        if (measure.second.recycles()) measure.second.recycle(move, acceptance);
+}
+
+void mc_metropolis::adapt_move_weights() {
+    double total = std::accumulate(move_probs_.begin(), move_probs_.end(), 0.0);
+    double share = 0.0, eff_sum = 0.0;
+    for (size_t i = 0; i < moves_.size(); i++) {
+        if (!move_stats_[i].nattempt) continue;
+        share += move_probs_[i] / total;
+        eff_sum += move_stats_[i].efficiency();
+    }
+    if (eff_sum <= 0) return;
+    std::vector<double> probs(moves_.size());
+    for (size_t i = 0; i < moves_.size(); i++) {
+        probs[i] = move_stats_[i].nattempt ? share * move_stats_[i].efficiency() / eff_sum : move_probs_[i] / total;
+    }
+    // the moves below the minimum get exactly adapt_min_weight_, the rest is shared by the others in proportion to their weights
+    size_t n = moves_.size();
+    double min_weight = std::min(adapt_min_weight_, 1.0 / n);
+    std::vector<char> floored(n, 0);
+    for (bool changed = true; changed;) {
+        changed = false;
+        double free_sum = 0.0, left = 1.0;
+        for (size_t i = 0; i < n; i++) { if (floored[i]) left -= min_weight; else free_sum += probs[i]; }
+        for (size_t i = 0; i < n; i++) 
+            if (!floored[i] && probs[i] * left < min_weight * free_sum) { floored[i] = 1; changed = true; }
+        if (changed) continue;
+        for (size_t i = 0; i < n; i++) probs[i] = floored[i] ? min_weight : probs[i] * left / free_sum;
+    }
+    move_probs_.swap(probs);
+    move_distrib_ = std::discrete_distribution<>(move_probs_.begin(), move_probs_.end());
+}
+
+std::vector<move_statistics> mc_metropolis::reduce_move_stats(boost::mpi::communicator const &c, std::vector<move_statistics> const &local) {
+    size_t n = local.size();
+    std::vector<long> nattempt(n), naccept(n), nattempt_sum(n), naccept_sum(n);
+    std::vector<double> time(n), time_sum(n);
+    for (size_t i = 0; i < n; i++) { 
+        nattempt[i] = local[i].nattempt; 
+        naccept[i] = local[i].naccept; 
+        time[i] = local[i].time; 
+    }
+    boost::mpi::reduce(c, nattempt.data(), n, nattempt_sum.data(), std::plus<long>(), 0);
+    boost::mpi::reduce(c, naccept.data(), n, naccept_sum.data(), std::plus<long>(), 0);
+    boost::mpi::reduce(c, time.data(), n, time_sum.data(), std::plus<double>(), 0);
+    std::vector<move_statistics> out(n);
+    for (size_t i = 0; i < n; i++) { 
+        out[i].nattempt = nattempt_sum[i]; 
+        out[i].naccept = naccept_sum[i]; 
+        out[i].time = time_sum[i]; 
+    }
+    return out;
+}
+
 void mc_metropolis::measure() {
+    if (measure_count_ == 0 && thermalization_sweeps_ == 0) end_thermalization();
     if (measure_count_ >= thermalization_sweeps_) {
+        long n = measure_count_ - thermalization_sweeps_;
         for (auto &measure : measures_) {
+            auto skip = measure_skip_.find(measure.first);
+            if (skip != measure_skip_.end() && n % skip->second) continue;
             measure.second.accumulate(phase_);
         }
     }
+    if (monitoring() && !monitors_.empty()) monitor_convergence();
+    else if (measure_count_ + 1 == thermalization_sweeps_) end_thermalization();
     measure_count_++;
+    // a sweep is complete, the chain can be continued from here
+    if (!checkpoint_file_.empty() && std::chrono::steady_clock::now() >= next_checkpoint_) {
+        save_checkpoint(checkpoint_file_);
+        next_checkpoint_ = std::chrono::steady_clock::now() + checkpoint_interval_;
+    }
+}
+
+void mc_metropolis::save_checkpoint(std::string const &file) {
+    std::string tmp = file + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        boost::archive::binary_oarchive ar(out);
+        // the derived state goes first : restoring the configuration resets the residence time
+        save_state(ar);
+        ar << random << sweep_count_ << measure_count_ << naccept_ << nsteps_ << phase_ << residence_left_
+           << thermalization_sweeps_ << sweep_len_ << measure_skip_ << error_progress_ << move_probs_ << move_stats_;
+        ar << monitors_.size();
+        for (auto const &m : monitors_) ar << m;
+        for (auto const &move : moves_) if (move.has_state()) move.save_state(ar);
+        for (auto const &measure : measures_) {
+            if (!measure.second.has_state()) continue;
+            ar << measure.first;
+            measure.second.save_state(ar);
+        }
+        if (!out) throw std::runtime_error("mc_metropolis : can not write checkpoint " + tmp);
+    }
+    if (std::rename(tmp.c_str(), file.c_str())) throw std::runtime_error("mc_metropolis : can not rename checkpoint " + tmp);
+}
+
+void mc_metropolis::load_checkpoint(std::string const &file) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) throw std::runtime_error("mc_metropolis : can not open checkpoint " + file);
+    boost::archive::binary_iarchive ar(in);
+    load_state(ar);
+    ar >> random >> sweep_count_ >> measure_count_ >> naccept_ >> nsteps_ >> phase_ >> residence_left_
+       >> thermalization_sweeps_ >> sweep_len_ >> measure_skip_ >> error_progress_;
+    std::vector<double> probs;
+    std::vector<move_statistics> stats;
+    ar >> probs >> stats;
+    if (probs.size() != moves_.size()) throw std::logic_error("mc_metropolis : the moves differ from the ones in checkpoint " + file);
+    move_probs_.swap(probs);
+    move_stats_.swap(stats);
+    move_distrib_ = std::discrete_distribution<>(move_probs_.begin(), move_probs_.end());
+
+    size_t nmonitors;
+    ar >> nmonitors;
+    if (nmonitors != monitors_.size()) throw std::logic_error("mc_metropolis : the monitors differ from the ones in checkpoint " + file);
+    for (auto &m : monitors_) {
+        std::string name = m.name;
+        ar >> m;
+        if (m.name != name) throw std::logic_error("mc_metropolis : the monitors differ from the ones in checkpoint " + file);
+    }
+    for (auto &move : moves_) if (move.has_state()) move.load_state(ar);
+    for (auto &measure : measures_) {
+        if (!measure.second.has_state()) continue;
+        std::string name;
+        ar >> name;
+        if (name != measure.first) throw std::logic_error("mc_metropolis : the measures differ from the ones in checkpoint " + file);
+        measure.second.load_state(ar);
+    }
+    next_checkpoint_ = std::chrono::steady_clock::now() + checkpoint_interval_;
+}
+
+void mc_metropolis::end_thermalization() {
+    if (expensive_skip_ > 1) for (auto const &name : expensive_measures_) measure_skip_[name] = expensive_skip_;
+    if (monitors_.empty() || (!adapt_sweep_len_ && expensive_skip_ > 0)) return;
+
+    // the autocorrelation times from the equilibrated part of the series
+    double tau_min = std::numeric_limits<double>::max(), tau_max = 0.0;
+    for (auto &m : monitors_) {
+        std::vector<double> const &x = m.therm_series;
+        size_t d = mser_truncation(x);
+        if (d >= x.size()) d = x.size() / 2;
+        m.tau_therm = integrated_autocorrelation(std::vector<double>(x.begin() + d, x.end()));
+        tau_min = std::min(tau_min, m.tau_therm);
+        tau_max = std::max(tau_max, m.tau_therm);
+        std::vector<double>().swap(m.therm_series);
+    }
+    if (adapt_sweep_len_) {
+        // tau = 1/2 for uncorrelated samples
+        long len = std::max(1L, std::lround(sweep_len_ * 2.0 * tau_min));
+        tau_max *= double(sweep_len_) / len;
+        sweep_len_ = len;
+    }
+    if (expensive_skip_ == 0) {
+        long skip = std::max(1L, long(std::ceil(2.0 * tau_max)));
+        for (auto const &name : expensive_measures_) measure_skip_[name] = skip;
+    }
+    if (!rank_) {
+        std::cout << "Autocorrelation times (sweeps) :";
+        for (auto const &m : monitors_) std::cout << " " << m.name << " = " << m.tau_therm;
+        std::cout << ", sweep_len = " << sweep_len_;
+        for (auto const &s : measure_skip_) std::cout << ", " << s.first << " every " << s.second << " sweeps";
+        std::cout << std::endl;
+    }
+}
+
+void mc_metropolis::add_monitor(std::string name, std::function<double()> value) {
+    monitors_.emplace_back();
+    monitors_.back().name = name;
+    monitors_.back().value = value;
+}
+
+void mc_metropolis::monitor_convergence() {
+    bool thermalizing = measure_count_ < thermalization_sweeps_;
+    for (auto &m : monitors_) {
+        double x = m.value();
+        if (thermalizing) m.therm_series.push_back(x);
+        else m.binning.add(x);
+    }
+    if (thermalizing && measure_count_ + 1 == thermalization_sweeps_) { end_thermalization(); return; }
+    long n = thermalizing ? measure_count_ + 1 : measure_count_ + 1 - thermalization_sweeps_;
+    if (n % convergence_interval_) return;
+
+    if (thermalizing) {
+        if (!auto_therm_) return;
+        for (auto &m : monitors_) 
+            if (mser_truncation(m.therm_series) >= m.therm_series.size()) return;
+        // the next measurement is the first one
+        thermalization_sweeps_ = measure_count_ + 1;
+        if (!rank_) std::cout << "Thermalized after " << thermalization_sweeps_ << " sweeps" << std::endl;
+        end_thermalization();
+        return;
+    }
+    if (target_rel_error_ > 0 && n >= 2 * convergence_interval_) {
+        error_progress_ = 1.0;
+        for (auto &m : monitors_) error_progress_ = std::min(error_progress_, error_progress(m));
+    }
+}
+
+double mc_metropolis::error_progress(convergence_monitor const &m) const {
+    if (m.binning.count() < 2 * convergence_interval_) return 0.0;
+    double err = m.rel_error();
+    return err > 0 ? std::pow(target_rel_error_ / err, 2) : 1.0;
+}
+
+bool mc_metropolis::completed_together(boost::mpi::communicator const &c, std::vector<mc_metropolis *> const &chains, bool stop) {
+    mc_metropolis const &first = *chains.front();
+    size_t n = first.monitors_.size();
+    std::vector<double> progress(n, 0.0), total(n, 0.0);
+    int done = 1;
+    for (auto mc : chains) {
+        done &= mc->sweeps_done();
+        if (mc->target_rel_error_ > 0) for (size_t i = 0; i < n; i++) progress[i] += mc->error_progress(mc->monitors_[i]);
+    }
+    if (n) boost::mpi::all_reduce(c, progress.data(), n, total.data(), std::plus<double>());
+    done = boost::mpi::all_reduce(c, done, boost::mpi::minimum<int>());
+    int stopped = stop;
+    boost::mpi::broadcast(c, stopped, 0);
+    double combined = (first.target_rel_error_ > 0 && n) ? *std::min_element(total.begin(), total.end()) : 0.0;
+    for (auto mc : chains) mc->combined_progress_ = combined;
+    return done || stopped || combined >= 1.0;
+}
+
+void mc_metropolis::run(std::function<bool()> const &stop, boost::mpi::communicator const &c) {
+    std::vector<mc_metropolis *> chains(1, this);
+    do {
+        for (long s = 0; s < convergence_interval_ && !sweeps_done(); s++) { 
+            update(); 
+            measure(); 
+            fraction_completed(); 
+        }
+    } while (!completed_together(c, chains, !c.rank() && stop()));
 }
 
 void mc_metropolis::collect_results(boost::mpi::communicator const &c)
@@ -79,6 +420,8 @@ inline std::string percent(int x, int y, size_t step = 2) {
 
 double mc_metropolis::fraction_completed() const {
     double f = double(sweep_count_) / double(measure_sweeps_ + thermalization_sweeps_);
+    // the error of the mean goes as 1/sqrt(n), the combined progress is known after a check of completed_together
+    if (target_rel_error_ > 0) f = std::max({f, error_progress_, combined_progress_});
     if (!rank_ && parameters["show_output"].as<bool>()) std::cout << percent(f * nprocs_) << std::flush;
     return f;
 }
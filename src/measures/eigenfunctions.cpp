@@ -21,18 +21,15 @@ void measure_eigenfunctions::collect_results(boost::mpi::communicator const &c)
 {
     int sum_Z;
     boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
+    // the chains can have different numbers of measurements - the matrices are gathered as one history
+    size_t rows = config.lattice_.get_msize(), cols = rows;
+    size_t volume = rows*cols;
     std::vector<double> buffer;
+    buffer.reserve(volume*eigenfunctions_.size());
+    for (auto const& e : eigenfunctions_) buffer.insert(buffer.end(), e.data(), e.data() + volume);
+    gather_history(c, buffer);
     std::vector<dense_m> buffer2;
-    size_t rows = eigenfunctions_[0].rows();
-    size_t cols = eigenfunctions_[0].cols();
-    size_t volume = rows*cols;
-    for (size_t i=0; i<eigenfunctions_.size(); ++i) {
-        buffer.resize(volume*c.size());
-        boost::mpi::gather(c, eigenfunctions_[i].data(), volume, buffer, 0);
-        for (int l=0; l<c.size(); ++l) { 
-            buffer2.push_back(Eigen::Map<dense_m>(buffer.data() + l*volume, rows, cols));
-            }
-        };
+    for (size_t l=0; l<buffer.size()/volume; ++l) buffer2.push_back(Eigen::Map<dense_m>(buffer.data() + l*volume, rows, cols));
     eigenfunctions_.swap(buffer2);
 }
 
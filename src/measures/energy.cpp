@@ -33,19 +33,9 @@ void measure_energy::collect_results(boost::mpi::communicator const &c)
     boost::mpi::reduce(c, _average_energy, sum_E, std::plus<double>(), 0);
     boost::mpi::reduce(c, _average_d2energy, sum_d2E, std::plus<double>(), 0);
 
-    std::vector<double> energies(_energies.size()*c.size());
-    boost::mpi::gather(c, _energies.data(), _energies.size(), energies, 0);
-    _energies.swap(energies);
-
-    c.barrier();
-    std::vector<double> d2energies(_d2energies.size()*c.size());
-    boost::mpi::gather(c, _d2energies.data(), _d2energies.size(), d2energies, 0);
-    _d2energies.swap(d2energies);
-
-    c.barrier();
-    std::vector<double> c_energies(_c_energies.size()*c.size());
-    boost::mpi::gather(c, _c_energies.data(), _c_energies.size(), c_energies, 0);
-    _c_energies.swap(c_energies);
+    gather_history(c, _energies);
+    gather_history(c, _d2energies);
+    gather_history(c, _c_energies);
 
     if (c.rank() == 0) {
     std::cout << "Total energy: " << sum_E / sum_Z << std::endl;
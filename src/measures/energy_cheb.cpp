@@ -0,0 +1,32 @@
+#include "fk_mc/measures/energy_cheb.hpp"
+
+namespace fk {
+
+void measure_energy_cheb::accumulate(double sign) 
+{
+    config.calc_chebyshev(cheb_);
+    const auto& cheb_data = config.cheb_data();
+    double a = cheb_data.a, b = cheb_data.b;
+    double beta = config.params().beta;
+    size_t msize = config.lattice_.get_msize();
+    _Z++;
+
+    // e * n_F(e) and e^2 n_F(e) (1 - n_F(e)), written with exp(-beta*|e|) to avoid overflows
+    std::function<double(double)> e_f = [a,b,beta,msize](double w){
+        double e = a*w+b; double ex = exp(-beta*std::abs(e)); 
+        return msize * e * (e > 0 ? ex / (1.0 + ex) : 1.0 / (1.0 + ex)); };
+    std::function<double(double)> d2e_f = [a,b,beta,msize](double w){
+        double e = a*w+b; double ex = exp(-beta*std::abs(e)); 
+        return msize * e * e * ex / (1.0 + ex) / (1.0 + ex); };
+
+    double e_val_c = chebyshev::trace_f(cheb_, cheb_data.moments, e_f);
+    double e_val = e_val_c - double(config.params_.mu_f)*config.get_nf() + config.calc_ff_energy();
+    double d2e_val = chebyshev::trace_f(cheb_, cheb_data.moments, d2e_f);
+    _average_energy += e_val;
+    _average_d2energy += d2e_val;
+    _energies.push_back(e_val);
+    _d2energies.push_back(d2e_val);
+    _c_energies.push_back(e_val_c);
+}
+
+} // end of namespace FK
@@ -0,0 +1,37 @@
+#include <boost/mpi/collectives.hpp>
+
+#include "fk_mc/measures/kpm_dos.hpp"
+
+namespace fk {
+
+chebyshev::kpm_bounds measure_kpm_dos::spectrum_bounds(const configuration_t& config)
+{
+    double mu_c = config.params().mu_c, U = config.params().U;
+    return chebyshev::gershgorin_bounds(config.lattice_.hopping_m(), -mu_c + std::min(U, 0.0), -mu_c + std::max(U, 0.0));
+}
+
+measure_kpm_dos::measure_kpm_dos(configuration_t& in, random_generator& rnd, int nmoments, int nrandom, std::vector<std::vector<double>>& moments_history):
+    config(in), rnd_(rnd), nmoments_(nmoments), nrandom_(nrandom), 
+    bounds_(spectrum_bounds(in)),
+    kernel_(chebyshev::jackson_kernel(nmoments)),
+    _moments_history(moments_history)
+{ 
+    _moments_history.resize(nmoments_);
+};
+
+void measure_kpm_dos::accumulate(double sign) 
+{
+    auto x = chebyshev::rescale(config.hamilt_, bounds_);
+    auto moments = chebyshev::kpm_moments(x, nmoments_, nrandom_, rnd_);
+    for (int m=0; m<nmoments_; ++m) { _moments_history[m].push_back(moments[m]*kernel_[m]); };
+    _Z++;
+}
+
+void measure_kpm_dos::collect_results(boost::mpi::communicator const &c)
+{
+    int sum_Z;
+    boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
+    for (size_t i=0; i<_moments_history.size(); ++i) gather_history(c, _moments_history[i]);
+}
+
+} // end of namespace FK
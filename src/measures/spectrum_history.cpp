@@ -22,12 +22,7 @@ void measure_spectrum_history::collect_results(boost::mpi::communicator const &c
 {
     int sum_Z;
     boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
-    std::vector<double> current_history;
-    for (size_t i=0; i<_spectrum_history.size(); ++i) {
-        current_history.resize(_spectrum_history[i].size()*c.size());
-        boost::mpi::gather(c, _spectrum_history[i].data(), _spectrum_history[i].size(), current_history, 0);
-        _spectrum_history[i].swap(current_history);
-        };
+    for (size_t i=0; i<_spectrum_history.size(); ++i) gather_history(c, _spectrum_history[i]);
 }
 
 
@@ -0,0 +1,60 @@
+#include <boost/mpi/collectives.hpp>
+
+#include "fk_mc/measures/typical_dos.hpp"
+#include "fk_mc/measures/kpm_dos.hpp"
+
+namespace fk {
+
+measure_typical_dos::measure_typical_dos(configuration_t& in, random_generator& rnd, int nmoments, int nsites, std::vector<double> wgrid, 
+                                         std::vector<std::vector<double>>& log_dos_history, std::vector<std::vector<double>>& dos_history):
+    config(in), rnd_(rnd), nmoments_(nmoments), 
+    nsites_(std::min(nsites, in.lattice_.get_msize())),
+    wgrid_(wgrid),
+    bounds_(measure_kpm_dos::spectrum_bounds(in)),
+    kernel_(chebyshev::jackson_kernel(nmoments)),
+    _log_dos_history(log_dos_history),
+    _dos_history(dos_history)
+{ 
+    _log_dos_history.resize(wgrid_.size());
+    _dos_history.resize(wgrid_.size());
+};
+
+void measure_typical_dos::accumulate(double sign) 
+{
+    int msize = config.lattice_.get_msize();
+    // random sites without repetitions
+    std::vector<int> sites(msize);
+    std::iota(sites.begin(), sites.end(), 0);
+    for (int i=0; i<nsites_; ++i) std::swap(sites[i], sites[std::uniform_int_distribution<>(i, msize - 1)(rnd_)]);
+
+    Eigen::MatrixXd r = Eigen::MatrixXd::Zero(msize, nsites_);
+    for (int i=0; i<nsites_; ++i) r(sites[i], i) = 1.0;
+    auto x = chebyshev::rescale(config.hamilt_, bounds_);
+    Eigen::MatrixXd local_moments = chebyshev::kpm_local_moments(x, nmoments_, r);
+
+    std::vector<double> log_dos(wgrid_.size(), 0.0), dos(wgrid_.size(), 0.0), moments(nmoments_);
+    for (int i=0; i<nsites_; ++i) { 
+        for (int m=0; m<nmoments_; ++m) moments[m] = local_moments(m,i) * kernel_[m];
+        auto dos_i = chebyshev::kpm_dos(moments, bounds_, wgrid_);
+        for (size_t w=0; w<wgrid_.size(); ++w) { 
+            // the damped local dos is non-negative up to roundoff errors
+            log_dos[w] += std::log(std::max(dos_i[w], std::numeric_limits<double>::min())) / nsites_;
+            dos[w] += dos_i[w] / nsites_;
+            }
+        }
+    for (size_t w=0; w<wgrid_.size(); ++w) { 
+        _log_dos_history[w].push_back(log_dos[w]);
+        _dos_history[w].push_back(dos[w]);
+        }
+    _Z++;
+}
+
+void measure_typical_dos::collect_results(boost::mpi::communicator const &c)
+{
+    int sum_Z;
+    boost::mpi::reduce(c, _Z, sum_Z, std::plus<int>(), 0);
+    for (auto history : {&_log_dos_history, &_dos_history})  
+        for (size_t i=0; i<history->size(); ++i) gather_history(c, (*history)[i]);
+}
+
+} // end of namespace FK
@@ -3,22 +3,28 @@
 namespace fk {
 namespace chebyshev { 
 
-typename move_flip::mc_weight_type move_flip::attempt()
+void move_flip::propose()
 {
+    beta = config.params_.beta;
     config.calc_chebyshev(cheb_);
-    if (config.get_nf() == 0 || config.get_nf() == config.lattice_.get_msize()) return 0; // this move won't work when the configuration is completely full or empty
+    valid_ = !(config.get_nf() == 0 || config.get_nf() == config.lattice_.get_msize()); // this move won't work when the configuration is completely full or empty
+    if (!valid_) return; 
     std::uniform_int_distribution<> distr(0, config.lattice_.get_msize() - 1); 
+    ff_energy_ = config.calc_ff_energy();
     new_config = config;
-    size_t m_size = config.lattice_.get_msize();
-    size_t from = distr(RND); while (new_config.f_config_(from)==0) from = distr(RND);
-    size_t to = distr(RND); while (new_config.f_config_(to)==1) to = distr(RND);
+    from_ = distr(RND); while (new_config.f_config_(from_)==0) from_ = distr(RND);
+    to_ = distr(RND); while (new_config.f_config_(to_)==1) to_ = distr(RND);
 
-    new_config.f_config_(from) = 0;
-    new_config.f_config_(to) = 1;
+    new_config.f_config_(from_) = 0;
+    new_config.f_config_(to_) = 1;
+}
 
-    new_config.calc_hamiltonian();
+typename move_flip::mc_weight_type move_flip::evaluate()
+{
+    if (!valid_) return 0;
+    new_config.update_hamiltonian({from_, to_});
     new_config.calc_chebyshev(cheb_);
-    double ff_diff = new_config.calc_ff_energy() - config.calc_ff_energy();
+    double ff_diff = new_config.calc_ff_energy() - ff_energy_;
     auto ratio = std::exp(new_config.cheb_data_.logZ - config.cheb_data_.logZ - beta * ff_diff);
     return ratio;
 }
@@ -35,42 +41,83 @@ void move_flip::reject()
 }
 
 // move_randomize
-typename move_randomize::mc_weight_type move_randomize::attempt()
+void move_randomize::propose()
 {
+    beta = config.params_.beta;
     config.calc_chebyshev(cheb_);
+    ff_energy_ = config.calc_ff_energy();
     new_config = config;
     //new_config.randomize_f(RND, config.get_nf());
     new_config.randomize_f(RND);
+}
+
+typename move_randomize::mc_weight_type move_randomize::evaluate()
+{
     new_config.calc_hamiltonian();
     new_config.calc_chebyshev(cheb_);
 
     auto log_ratio = new_config.cheb_data_.logZ - config.cheb_data_.logZ;
-    double ff_diff = new_config.calc_ff_energy() - config.calc_ff_energy();
+    double ff_diff = new_config.calc_ff_energy() - ff_energy_;
     if (beta*config.params_.mu_f*(new_config.get_nf()-config.get_nf()) - ff_diff > 2.7182818 - log_ratio) { return 1;}
     else if (beta*config.params_.mu_f*(new_config.get_nf()-config.get_nf()) - ff_diff + log_ratio < 0) {return 0;}
     else return std::exp(log_ratio)*exp(beta*(config.params_.mu_f*(new_config.get_nf()-config.get_nf()) - ff_diff)); 
 }
 
 // move_addremove
-typename move_addremove::mc_weight_type move_addremove::attempt()
+void move_addremove::propose()
 {
+    beta = config.params_.beta;
+    exp_beta_mu_f = exp(beta*config.params_.mu_f);
     std::uniform_int_distribution<> distr(0, config.lattice_.get_msize() - 1); 
     config.calc_chebyshev(cheb_);
+    ff_energy_ = config.calc_ff_energy();
     new_config = config;
-    size_t m_size = config.lattice_.get_msize();
-    size_t to = distr(RND);
-    new_config.f_config_(to) = 1 - config.f_config_(to);
+    to_ = distr(RND);
+    new_config.f_config_(to_) = 1 - config.f_config_(to_);
+}
 
-    new_config.calc_hamiltonian();
+typename move_addremove::mc_weight_type move_addremove::evaluate()
+{
+    new_config.update_hamiltonian({to_});
     new_config.calc_chebyshev(cheb_);
-    double ff_diff = new_config.calc_ff_energy() - config.calc_ff_energy();
+    double ff_diff = new_config.calc_ff_energy() - ff_energy_;
 
     //FKDEBUG(new_config.cheb_data_.logZ << " " << config.cheb_data_.logZ);
     auto ratio = std::exp(new_config.cheb_data_.logZ - config.cheb_data_.logZ );
-    auto out = (new_config.f_config_(to)?ratio*exp_beta_mu_f:ratio/exp_beta_mu_f) * std::exp(-beta * ff_diff);
+    auto out = (new_config.f_config_(to_)?ratio*exp_beta_mu_f:ratio/exp_beta_mu_f) * std::exp(-beta * ff_diff);
     return out;
 }
 
+// move_hop
+void move_hop::propose()
+{
+    beta = config.params_.beta;
+    config.calc_chebyshev(cheb_);
+    valid_ = config.get_nf() > 0;
+    if (!valid_) return;
+    std::uniform_int_distribution<> distr(0, config.lattice_.get_msize() - 1); 
+    from_ = distr(RND); while (config.f_config_(from_)==0) from_ = distr(RND);
+    auto const& nn = neighbors_[from_];
+    valid_ = !nn.empty();
+    if (!valid_) return;
+    to_ = nn[std::uniform_int_distribution<>(0, nn.size() - 1)(RND)];
+    valid_ = !config.f_config_(to_);
+    if (!valid_) return;
+    proposal_ratio_ = double(nn.size()) / neighbors_[to_].size();
+    ff_energy_ = config.calc_ff_energy();
+    new_config = config;
+    new_config.f_config_(from_) = 0;
+    new_config.f_config_(to_) = 1;
+}
+
+typename move_hop::mc_weight_type move_hop::evaluate()
+{
+    if (!valid_) return 0;
+    new_config.update_hamiltonian({from_, to_});
+    new_config.calc_chebyshev(cheb_);
+    double ff_diff = new_config.calc_ff_energy() - ff_energy_;
+    return std::exp(new_config.cheb_data_.logZ - config.cheb_data_.logZ - beta * ff_diff) * proposal_ratio_;
+}
 
 } // end of namespace chebyshev
 } // end of namespace fk
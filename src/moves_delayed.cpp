@@ -0,0 +1,110 @@
+#include "moves_delayed.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace fk {
+
+move_delayed::move_delayed(configuration_t& current_config, const chebyshev::chebyshev_eval* cheb, random_generator &RND_, kind_t kind, int patch_radius):
+    config(current_config), new_config(current_config), cheb_(cheb), RND(RND_), kind_(kind), 
+    patches_(current_config.lattice_.get_msize()), stats_(std::make_shared<delayed_stats>())
+{
+    // breadth-first search over the hoppings
+    auto const& hopping = config.lattice_.hopping_m();
+    int msize = config.lattice_.get_msize();
+    for (int i=0; i<msize; ++i) {
+        std::vector<int> dist(msize, -1);
+        std::vector<int> front = {i};
+        dist[i] = 0;
+        for (int r=0; r<patch_radius && !front.empty(); ++r) {
+            std::vector<int> next;
+            for (int j : front) 
+                for (lattice_base::sparse_m::InnerIterator it(hopping, j); it; ++it) 
+                    if (dist[it.row()] < 0) { dist[it.row()] = r + 1; next.push_back(it.row()); }
+            front.swap(next);
+            }
+        for (int j=0; j<msize; ++j) if (dist[j] >= 0) patches_[i].push_back(j);
+        }
+}
+
+double move_delayed::patch_logz_(configuration_t const& c, std::vector<int> const& sites) const
+{
+    auto const& hopping = c.lattice_.hopping_m();
+    auto const& p = c.params();
+    int n = sites.size();
+    dense_m h(n, n);
+    for (int a=0; a<n; ++a) {
+        for (int b=0; b<n; ++b) h(a,b) = hopping.coeff(sites[a], sites[b]);
+        h(a,a) += -p.mu_c + p.U*c.f_config_(sites[a]);
+        }
+    Eigen::SelfAdjointEigenSolver<dense_m> s(h, Eigen::EigenvaluesOnly);
+    double logz = 0.0;
+    for (int a=0; a<n; ++a) { 
+        double e = s.eigenvalues()(a);
+        logz += std::max(-p.beta*e, 0.0) + std::log1p(std::exp(-p.beta*std::abs(e)));
+        }
+    return logz;
+}
+
+void move_delayed::propose()
+{
+    config.calc_logz(cheb_);
+    ff_energy_ = config.calc_ff_energy();
+    new_config = config;
+    std::uniform_int_distribution<> distr(0, config.lattice_.get_msize() - 1); 
+    if (kind_ == add_remove) { 
+        size_t to = distr(RND);
+        new_config.f_config_(to) = 1 - config.f_config_(to);
+        patch_ = patches_[to];
+        changed_ = {to};
+        }
+    else { 
+        valid_ = !(config.get_nf() == 0 || config.get_nf() == config.lattice_.get_msize()); // no flips for a completely full or empty configuration
+        if (!valid_) return;
+        size_t from = distr(RND); while (config.f_config_(from)==0) from = distr(RND);
+        size_t to = distr(RND); while (config.f_config_(to)==1) to = distr(RND);
+        new_config.f_config_(from) = 0;
+        new_config.f_config_(to) = 1;
+        changed_ = {from, to};
+        patch_.clear();
+        std::set_union(patches_[from].begin(), patches_[from].end(), patches_[to].begin(), patches_[to].end(), std::back_inserter(patch_));
+        }
+    u_stage1_ = std::uniform_real_distribution<>(0, 1)(RND);
+}
+
+typename move_delayed::mc_weight_type move_delayed::evaluate()
+{
+    stage1_ = false;
+    if (!valid_) return 0;
+    double beta = config.params_.beta;
+    new_config.update_hamiltonian(changed_);
+    double log_local = beta*(config.params_.mu_f*(double(new_config.get_nf()) - double(config.get_nf())) 
+                       - new_config.calc_ff_energy() + ff_energy_);
+
+    // stage 1 : surrogate
+    double log_surrogate = patch_logz_(new_config, patch_) - patch_logz_(config, patch_) + log_local;
+    if (log_surrogate < 0 && u_stage1_ >= std::exp(log_surrogate)) return 0;
+    stage1_ = true;
+
+    // stage 2 : full weight, divided by the surrogate one
+    double log_ratio = new_config.calc_logz(cheb_) - config.calc_logz(cheb_) + log_local;
+    return std::exp(log_ratio - log_surrogate);
+}
+
+typename move_delayed::mc_weight_type move_delayed::accept() 
+{
+    config = new_config; 
+    stats_->nattempt++;
+    stats_->nstage1++;
+    stats_->naccept++;
+    return 1.0; 
+}
+
+void move_delayed::reject() 
+{
+    if (!valid_) return;
+    stats_->nattempt++;
+    if (stage1_) stats_->nstage1++;
+}
+
+} // end of namespace fk
@@ -0,0 +1,95 @@
+#include "moves_mtm.hpp"
+
+namespace fk {
+
+namespace {
+/// log(sum_i exp(x_i)) for the first n elements
+double log_sum_exp(std::vector<double> const& x, int n) 
+{
+    double m = *std::max_element(x.begin(), x.begin() + n);
+    if (m == -std::numeric_limits<double>::infinity()) return m;
+    double s = 0.0;
+    for (int i=0; i<n; ++i) s+= std::exp(x[i] - m);
+    return m + std::log(s);
+}
+}
+
+move_mtm::move_mtm(double beta, configuration_t& current_config, const chebyshev::chebyshev_eval* cheb, random_generator &RND_, 
+                   alps::thread_pool &pool, kind_t kind, int ntries):
+    beta(beta), config(current_config), cheb_(cheb), RND(RND_), pool_(pool), kind_(kind), ntries_(std::max(ntries,1)),
+    trials_(ntries_, current_config), refs_(ntries_, current_config), trial_logw_(ntries_), ref_logw_(ntries_)
+{
+    // the trials are updated from their own hamiltonians later on
+    for (auto &c : trials_) c.calc_hamiltonian();
+    for (auto &c : refs_) c.calc_hamiltonian();
+}
+
+double move_mtm::log_weight_(configuration_t& c) const
+{
+    return c.calc_logz(cheb_) + c.params_.beta*(c.params_.mu_f*c.get_nf() - c.calc_ff_energy());
+}
+
+void move_mtm::propose_(configuration_t const& src, configuration_t& c)
+{
+    std::uniform_int_distribution<> distr(0, src.lattice_.get_msize() - 1); 
+    if (!(c.params_ == src.params_) || c.params_.W != src.params_.W) c.set_params(src.params_);
+    configuration_t::int_array_t f = src.f_config_;
+    if (kind_ == add_remove) { 
+        size_t to = distr(RND);
+        f(to) = 1 - src.f_config_(to);
+        }
+    else { 
+        size_t from = distr(RND); while (src.f_config_(from)==0) from = distr(RND);
+        size_t to = distr(RND); while (src.f_config_(to)==1) to = distr(RND);
+        f(from) = 0;
+        f(to) = 1;
+        }
+    // c keeps the hamiltonian of its previous trial - only the sites, where it differs from the new one, are updated
+    std::vector<size_t> sites;
+    for (int i=0; i<f.size(); ++i) if (f(i) != c.f_config_(i)) sites.push_back(i);
+    c.f_config_ = f;
+    c.update_hamiltonian(sites);
+}
+
+void move_mtm::eval_(std::vector<configuration_t>& configs, std::vector<double>& log_weights, int n)
+{
+    pool_.parallel_for(n, [&](size_t i) { log_weights[i] = log_weight_(configs[i]); });
+}
+
+typename move_mtm::mc_weight_type move_mtm::attempt()
+{
+    size_t nf = config.get_nf();
+    if (kind_ == flip && (nf == 0 || nf == config.lattice_.get_msize())) return 0; // no flips for a completely full or empty configuration
+    double logw0 = log_weight_(config);
+
+    // proposals are drawn sequentially, so that the chain does not depend on the number of threads
+    for (int i=0; i<ntries_; ++i) propose_(config, trials_[i]);
+    eval_(trials_, trial_logw_, ntries_);
+
+    // select a trial with the probability ~ its weight
+    for (auto &l : trial_logw_) l-= logw0;
+    double log_sum_trials = log_sum_exp(trial_logw_, ntries_);
+    std::vector<double> probs(ntries_);
+    for (int i=0; i<ntries_; ++i) probs[i] = std::exp(trial_logw_[i] - log_sum_trials);
+    selected_ = std::discrete_distribution<>(probs.begin(), probs.end())(RND);
+
+    // reference trials from the selected one, the last reference is the current configuration
+    for (int i=0; i<ntries_-1; ++i) propose_(trials_[selected_], refs_[i]);
+    eval_(refs_, ref_logw_, ntries_-1);
+    for (int i=0; i<ntries_-1; ++i) ref_logw_[i]-= logw0;
+    ref_logw_[ntries_-1] = 0.0;
+
+    return std::exp(log_sum_trials - log_sum_exp(ref_logw_, ntries_));
+}
+
+typename move_mtm::mc_weight_type move_mtm::accept() 
+{
+    config = trials_[selected_]; 
+    return 1.0; 
+}
+
+void move_mtm::reject() 
+{
+}
+
+} // end of namespace fk
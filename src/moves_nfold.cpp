@@ -0,0 +1,75 @@
+#include "moves_nfold.hpp"
+
+namespace fk {
+
+double rank_one_logz_diff(Eigen::ArrayXd const& lambda, Eigen::ArrayXd const& z2, double rho, double beta)
+{
+    // log(1 + exp(-beta*e)) without overflows
+    auto log1p_exp = [beta](double e) { return std::max(-beta*e, 0.0) + std::log1p(std::exp(-beta*std::abs(e))); };
+    int n = lambda.size();
+    if (!n || rho == 0.0) return 0.0;
+    double scale = std::max(std::abs(lambda(0)), std::abs(lambda(n-1))) + std::abs(rho);
+    double tol = 1e-12 * scale;
+
+    // poles of the secular equation : groups of degenerate eigenvalues with a nonzero weight
+    std::vector<double> d, w;
+    for (int k=0; k<n;) {
+        double wg = 0.0, d0 = lambda(k);
+        for (; k<n && lambda(k) - d0 < tol; ++k) wg+=z2(k);
+        if (wg > 1e-14) { d.push_back(d0); w.push_back(wg); }
+        }
+    int m = d.size();
+    double wsum = std::accumulate(w.begin(), w.end(), 0.0);
+
+    auto f = [&](double x, double& df) {
+        double v = 1.0; df = 0.0;
+        for (int j=0; j<m; ++j) { double r = 1.0 / (d[j] - x); v += rho*w[j]*r; df += rho*w[j]*r*r; }
+        return v;
+        };
+
+    double out = 0.0;
+    for (int g=0; g<m; ++g) {
+        // each pole moves within (d_g, d_g+1) for rho > 0 and within (d_g-1, d_g) for rho < 0
+        double a, b;
+        if (rho > 0) { a = d[g]; b = (g+1 < m) ? d[g+1] : d[g] + rho*wsum; }
+        else { a = (g > 0) ? d[g-1] : d[g] + rho*wsum; b = d[g]; }
+        // safeguarded Newton, f is monotonous on (a,b) : increasing for rho > 0, decreasing for rho < 0
+        double x = (a + b) / 2., df;
+        for (int it=0; it<200 && b - a > 1e-15 * scale; ++it) {
+            double v = f(x, df);
+            if (v == 0.0) break;
+            if ((v < 0) == (rho > 0)) a = x; else b = x;
+            double xn = x - v/df;
+            x = (xn > a && xn < b) ? xn : (a + b) / 2.;
+            }
+        out += log1p_exp(x) - log1p_exp(d[g]);
+        }
+    return out;
+}
+
+double nfold_addremove::residence_time()
+{
+    config.calc_ed(true);
+    auto const& p = config.params();
+    size_t msize = config.lattice_.get_msize();
+    auto const& spectrum = config.ed_data_.cached_spectrum;
+    auto const& evecs = config.ed_data_.cached_evecs;
+    rates_.resize(msize);
+    pool_.parallel_for(msize, [&](size_t i) {
+        int sign = config.f_config_(i) ? -1 : 1;
+        Eigen::ArrayXd z2 = evecs.row(i).transpose().array().square();
+        double log_ratio = rank_one_logz_diff(spectrum, z2, sign * p.U, p.beta) + p.beta * (sign * p.mu_f - config.calc_ff_energy_diff(i));
+        rates_[i] = std::min(1.0, std::exp(log_ratio));
+        });
+    double total = std::accumulate(rates_.begin(), rates_.end(), 0.0);
+    return total > 0 ? msize / total : std::numeric_limits<double>::infinity();
+}
+
+void nfold_addremove::advance()
+{
+    size_t i = std::discrete_distribution<>(rates_.begin(), rates_.end())(RND);
+    config.f_config_(i) = 1 - config.f_config_(i);
+    config.update_hamiltonian({i});
+}
+
+} // end of namespace fk
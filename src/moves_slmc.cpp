@@ -0,0 +1,125 @@
+#include "moves_slmc.hpp"
+
+#include <Eigen/QR>
+
+namespace fk {
+
+move_slmc::move_slmc(configuration_t& current_config, const chebyshev::chebyshev_eval* cheb, random_generator &RND_, int nshells, int ntrain):
+    config(current_config), new_config(current_config), cheb_(cheb), RND(RND_),
+    shells_(current_config.lattice_.neighbor_shells(std::max(nshells, 1))), ntrain_(std::max(ntrain, 1)),
+    model_(std::make_shared<slmc_model>())
+{
+    model_->coefs = Eigen::VectorXd::Zero(2 + shells_.size());
+}
+
+double move_slmc::log_weight_(configuration_t& c) const
+{
+    auto const& p = c.params();
+    return c.calc_logz(cheb_) + p.beta*(p.mu_f*c.get_nf() - c.calc_ff_energy());
+}
+
+Eigen::VectorXd move_slmc::features_(configuration_t const& c) const
+{
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(2 + shells_.size());
+    x(0) = 1.0;
+    x(1) = c.get_nf();
+    for (size_t l=0; l<shells_.size(); ++l)
+        for (size_t i=0; i<shells_[l].size(); ++i) {
+            if (!c.f_config_(i)) continue;
+            for (size_t j : shells_[l][i]) if (j > i) x(2+l)+=c.f_config_(j);
+            }
+    return x;
+}
+
+double move_slmc::log_pair_weight_(configuration_t const& c) const
+{
+    double out = 0.0;
+    for (size_t l=0; l<shells_.size(); ++l) {
+        double K = model_->coefs(2+l) / 4.;
+        int ss = 0;
+        for (size_t i=0; i<shells_[l].size(); ++i)
+            for (size_t j : shells_[l][i])
+                if (j > i) ss += (2*c.f_config_(i) - 1) * (2*c.f_config_(j) - 1);
+        out += K * ss;
+        }
+    return out;
+}
+
+void move_slmc::fit_()
+{
+    slmc_model& m = *model_;
+    int n = m.features.size(), nf = m.coefs.size();
+    Eigen::MatrixXd a(n, nf);
+    Eigen::VectorXd b(n);
+    for (int k=0; k<n; ++k) { a.row(k) = m.features[k].transpose(); b(k) = m.log_weights[k]; }
+    m.coefs = a.colPivHouseholderQr().solve(b);
+    m.fit_error = std::sqrt((a*m.coefs - b).squaredNorm() / n);
+    m.trained = true;
+    m.features.clear();
+    m.log_weights.clear();
+}
+
+void move_slmc::propose()
+{
+    slmc_model& m = *model_;
+    if (!m.trained) {
+        m.features.push_back(features_(config));
+        m.log_weights.push_back(log_weight_(config));
+        if (m.features.size() >= ntrain_) fit_();
+        }
+    log_weight_current_ = log_weight_(config);
+    new_config = config;
+    size_t msize = config.lattice_.get_msize();
+    std::uniform_int_distribution<> distr(0, msize - 1);
+    cluster_ = m.trained;
+    if (!cluster_) {
+        size_t to = distr(RND);
+        new_config.f_config_(to) = 1 - config.f_config_(to);
+        return;
+        }
+
+    // Wolff cluster : a neighbor joins with the probability 1 - exp(-2|K_l|), if the bond is satisfied (K_l s_i s_j > 0)
+    std::vector<char> in_cluster(msize, 0);
+    std::vector<size_t> stack = {size_t(distr(RND))};
+    in_cluster[stack[0]] = 1;
+    std::uniform_real_distribution<> u(0, 1);
+    cluster_size_ = 0;
+    while (!stack.empty()) {
+        size_t i = stack.back();
+        stack.pop_back();
+        cluster_size_++;
+        int si = 2*config.f_config_(i) - 1;
+        for (size_t l=0; l<shells_.size(); ++l) {
+            double K = m.coefs(2+l) / 4.;
+            double p_bond = 1.0 - std::exp(-2.*std::abs(K));
+            for (size_t j : shells_[l][i]) {
+                if (in_cluster[j] || K * si * (2*config.f_config_(j) - 1) <= 0) continue;
+                if (u(RND) < p_bond) { in_cluster[j] = 1; stack.push_back(j); }
+                }
+            }
+        }
+    for (size_t i=0; i<msize; ++i) if (in_cluster[i]) new_config.f_config_(i) = 1 - config.f_config_(i);
+    log_pair_diff_ = log_pair_weight_(new_config) - log_pair_weight_(config);
+}
+
+typename move_slmc::mc_weight_type move_slmc::evaluate()
+{
+    new_config.calc_hamiltonian();
+    double log_ratio = log_weight_(new_config) - log_weight_current_;
+    if (cluster_) log_ratio -= log_pair_diff_;
+    return std::exp(log_ratio);
+}
+
+typename move_slmc::mc_weight_type move_slmc::accept()
+{
+    config = new_config;
+    if (cluster_) { model_->ncluster++; model_->naccept++; model_->cluster_sites += cluster_size_; }
+    return 1.0;
+}
+
+void move_slmc::reject()
+{
+    if (cluster_) { model_->ncluster++; model_->cluster_sites += cluster_size_; }
+}
+
+} // end of namespace fk
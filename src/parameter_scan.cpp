@@ -0,0 +1,69 @@
+#include "parameter_scan.hpp"
+
+#include <sstream>
+#include <functional>
+#include <algorithm>
+
+namespace fk {
+
+std::vector<double> scan_values(std::string const& s)
+{
+    std::vector<double> out;
+    if (s.empty()) return out;
+    if (s.find(':') != std::string::npos) {
+        std::istringstream in(s);
+        double a, b;
+        int n;
+        char c1, c2;
+        if (!(in >> a >> c1 >> b >> c2 >> n) || c1 != ':' || c2 != ':' || n < 1) throw std::logic_error("scan : can not parse the range " + s);
+        for (int k=0; k<n; ++k) out.push_back(n > 1 ? a + (b - a) * k / (n - 1) : a);
+        return out;
+        }
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) out.push_back(std::stod(item));
+    return out;
+}
+
+std::vector<config_params> scan_points(config_params const& base, std::map<std::string, std::vector<double>> const& values,
+                                       std::vector<std::string> const& order, bool snake, bool half_filling)
+{
+    auto member = [](config_params& cp, std::string const& name) -> double& {
+        if (name == "U") return cp.U;
+        if (name == "beta") return cp.beta;
+        if (name == "mu_c") return cp.mu_c;
+        if (name == "mu_f") return cp.mu_f;
+        throw std::logic_error("scan : can not scan " + name);
+        };
+    // the scanned parameters from the outermost to the innermost loop
+    std::vector<std::string> names;
+    for (auto const& name : order) {
+        auto it = values.find(name);
+        if (it != values.end() && !it->second.empty()) names.push_back(name);
+        }
+    for (auto const& v : values)
+        if (!v.second.empty() && std::find(names.begin(), names.end(), v.first) == names.end())
+            throw std::logic_error("scan : " + v.first + " is not in the scan order");
+
+    std::vector<config_params> out;
+    // direction of each loop, reversed after every pass with snake
+    std::vector<bool> reverse(names.size(), false);
+    config_params cp = base;
+    std::function<void(size_t)> walk = [&](size_t level) {
+        if (level == names.size()) {
+            out.push_back(cp);
+            if (half_filling) out.back().mu_c = out.back().mu_f = cp.U / 2;
+            return;
+            }
+        std::vector<double> const& v = values.at(names[level]);
+        for (size_t i=0; i<v.size(); ++i) {
+            member(cp, names[level]) = v[reverse[level] ? v.size() - 1 - i : i];
+            walk(level + 1);
+            }
+        if (snake) reverse[level] = !reverse[level];
+        };
+    walk(0);
+    return out;
+}
+
+} // end of namespace fk
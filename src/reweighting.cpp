@@ -0,0 +1,156 @@
+#include "reweighting.hpp"
+#include "jackknife.hpp"
+
+namespace fk {
+
+namespace {
+/// log(sum_i exp(x_i))
+double log_sum_exp(std::vector<double> const& x)
+{
+    double m = *std::max_element(x.begin(), x.end());
+    if (m == -std::numeric_limits<double>::infinity()) return m;
+    double s = 0.0;
+    for (double v : x) s+= std::exp(v - m);
+    return m + std::log(s);
+}
+}
+
+reweight_run::reweight_run(double beta, double mu_f, std::vector<std::vector<double>> spectrum_history, std::vector<double> nf0,
+                           std::vector<double> nfpi, std::vector<double> const& energies, std::vector<double> const& c_energies):
+    beta(beta), mu_f(mu_f), spectrum_history(std::move(spectrum_history)), nf0(std::move(nf0)), nfpi(std::move(nfpi)), ff_energies(size(), 0.0)
+{
+    if (energies.size() == size() && c_energies.size() == size())
+        for (size_t s=0; s<size(); ++s) ff_energies[s] = energies[s] - c_energies[s] + mu_f*this->nf0[s];
+}
+
+double reweight_run::log_weight(size_t s, double beta, double mu_f) const
+{
+    double logz = 0.0;
+    for (size_t i=0; i<volume(); ++i) {
+        double e = spectrum_history[i][s];
+        logz += std::max(-beta*e, 0.0) + std::log1p(std::exp(-beta*std::abs(e)));
+        }
+    return logz + beta*(mu_f*nf0[s] - ff_energies[s]);
+}
+
+reweighting::reweighting(std::vector<reweight_run> runs, double tol, int maxiter):
+    runs_(std::move(runs)),
+    log_z_(runs_.size(), 0.0)
+{
+    if (runs_.empty()) throw std::logic_error("reweighting : no runs");
+    for (auto const& r : runs_)
+        if (r.volume() != runs_[0].volume()) throw std::logic_error("reweighting : runs on different lattices");
+    solve_(tol, maxiter);
+}
+
+void reweighting::solve_(double tol, int maxiter)
+{
+    size_t nruns = runs_.size();
+    // log weights of all samples in all ensembles
+    std::vector<std::vector<double>> lw(nruns);
+    for (size_t k=0; k<nruns; ++k) lw[k] = log_weights(runs_[k].beta, runs_[k].mu_f);
+    size_t nsamples = lw[0].size();
+    std::vector<double> tmp(nruns), tmp_s(nsamples);
+    log_denom_.resize(nsamples);
+
+    for (int it=0; it<maxiter; ++it) {
+        for (size_t s=0; s<nsamples; ++s) {
+            for (size_t r=0; r<nruns; ++r) tmp[r] = std::log(double(runs_[r].size())) + lw[r][s] - log_z_[r];
+            log_denom_[s] = log_sum_exp(tmp);
+            }
+        // a single run needs no iterations
+        if (nruns == 1) break;
+        std::vector<double> log_z_new(nruns);
+        for (size_t k=0; k<nruns; ++k) {
+            for (size_t s=0; s<nsamples; ++s) tmp_s[s] = lw[k][s] - log_denom_[s];
+            log_z_new[k] = log_sum_exp(tmp_s);
+            }
+        double diff = 0.0;
+        for (size_t k=0; k<nruns; ++k) {
+            log_z_new[k]-= log_z_new[0];
+            diff = std::max(diff, std::abs(log_z_new[k] - log_z_[k]));
+            }
+        log_z_.swap(log_z_new);
+        if (diff < tol) break;
+        }
+}
+
+std::vector<double> reweighting::log_weights(double beta, double mu_f) const
+{
+    std::vector<double> out;
+    for (auto const& r : runs_)
+        for (size_t s=0; s<r.size(); ++s) out.push_back(r.log_weight(s, beta, mu_f));
+    return out;
+}
+
+reweight_point reweighting::evaluate(double beta, double mu_f, std::vector<double> const& wgrid, double offset, size_t bin) const
+{
+    std::vector<double> lw = log_weights(beta, mu_f);
+    size_t nsamples = lw.size();
+    for (size_t s=0; s<nsamples; ++s) lw[s]-= log_denom_[s];
+    double lw_max = *std::max_element(lw.begin(), lw.end());
+    size_t volume = runs_[0].volume();
+
+    // weighted series : w, w*E, w*E^2, w*d2E, w*nf0, w*nf0^2, w*nf0^4, w*nfpi, w*nfpi^2, w*nfpi^4
+    enum { w_, e_, e2_, d2e_, n0_, n02_, n04_, npi_, npi2_, npi4_, nseries_ };
+    std::vector<std::vector<double>> series(nseries_, std::vector<double>(nsamples));
+    std::vector<std::vector<double>> dos_series(wgrid.size(), std::vector<double>(nsamples));
+    double sum_w = 0.0, sum_w2 = 0.0;
+    size_t s = 0;
+    for (auto const& r : runs_)
+        for (size_t j=0; j<r.size(); ++j, ++s) {
+            double w = std::exp(lw[s] - lw_max);
+            sum_w+=w;
+            sum_w2+=w*w;
+            double e_c = 0.0, d2e = 0.0;
+            for (size_t i=0; i<volume; ++i) {
+                double e = r.spectrum_history[i][j];
+                e_c += e / (1.0 + std::exp(beta*e));
+                d2e += e*e / (1.0 + std::cosh(beta*e)) / 2.0;
+                }
+            double energy = e_c - mu_f*r.nf0[j] + r.ff_energies[j];
+            double n0 = r.nf0[j], npi = r.nfpi[j];
+            series[w_][s] = w;
+            series[e_][s] = w*energy;
+            series[e2_][s] = w*energy*energy;
+            series[d2e_][s] = w*d2e;
+            series[n0_][s] = w*n0;
+            series[n02_][s] = w*n0*n0;
+            series[n04_][s] = w*n0*n0*n0*n0;
+            series[npi_][s] = w*npi;
+            series[npi2_][s] = w*npi*npi;
+            series[npi4_][s] = w*npi*npi*npi*npi;
+            for (size_t k=0; k<wgrid.size(); ++k) {
+                double d = 0.0;
+                for (size_t i=0; i<volume; ++i) d += offset / (std::pow(wgrid[k] - r.spectrum_history[i][j], 2) + offset*offset);
+                dos_series[k][s] = w*d / M_PI / volume;
+                }
+            }
+
+    typedef std::function<double(std::vector<double>)> f_t;
+    auto ratio = [](int a) { return f_t([a](std::vector<double> const& x) { return x[a] / x[w_]; }); };
+    auto binder = [](int a2, int a4) { return f_t([a2, a4](std::vector<double> const& x) {
+        double m2 = x[a2] / x[w_], m4 = x[a4] / x[w_]; return 1. - m4/3./m2/m2; }); };
+    f_t cv_f = [beta, volume](std::vector<double> const& x) {
+        double e = x[e_] / x[w_], e2 = x[e2_] / x[w_], d2e = x[d2e_] / x[w_];
+        return beta*beta*(e2 - d2e - e*e)/volume; };
+
+    reweight_point out;
+    out.beta = beta;
+    out.mu_f = mu_f;
+    out.nsamples = nsamples;
+    out.ess = sum_w*sum_w / sum_w2;
+    out.energy = jackknife::jack(ratio(e_), series, bin);
+    out.cv = jackknife::jack(cv_f, series, bin);
+    out.nf0 = jackknife::jack(ratio(n0_), series, bin);
+    out.nfpi = jackknife::jack(ratio(npi_), series, bin);
+    out.binder_0 = jackknife::jack(binder(n02_, n04_), series, bin);
+    out.binder_pi = jackknife::jack(binder(npi2_, npi4_), series, bin);
+    for (size_t k=0; k<wgrid.size(); ++k) {
+        std::vector<std::vector<double>> d = {series[w_], dos_series[k]};
+        out.dos.push_back(jackknife::jack(f_t([](std::vector<double> const& x) { return x[1] / x[0]; }), d, bin));
+        }
+    return out;
+}
+
+} // end of namespace fk
@@ -0,0 +1,83 @@
+#include "fk_mc/thread_pool.hpp"
+
+namespace alps {
+
+thread_pool::thread_pool(int nthreads)
+{
+    for (int i = 1; i < nthreads; ++i) workers_.emplace_back([this]() { worker_loop(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &w : workers_) w.join();
+}
+
+void thread_pool::worker_loop()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) return; // stop requested
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+bool thread_pool::run_pending()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+    }
+    task();
+    return true;
+}
+
+void thread_pool::parallel_for(size_t n, std::function<void(size_t)> const &f)
+{
+    if (workers_.empty() || n < 2) {
+        for (size_t i = 0; i < n; ++i) f(i);
+        return;
+    }
+
+    // completion state of this loop, lives until all tasks are done
+    size_t remaining = n;
+    std::exception_ptr error;
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < n; ++i) {
+            tasks_.emplace_back([&, i]() {
+                std::exception_ptr e;
+                try { f(i); }
+                catch (...) { e = std::current_exception(); }
+                std::lock_guard<std::mutex> done_lock(done_mutex);
+                if (e && !error) error = e;
+                if (--remaining == 0) done_cv.notify_all();
+            });
+        }
+    }
+    cv_.notify_all();
+
+    while (run_pending()) {};
+
+    std::unique_lock<std::mutex> done_lock(done_mutex);
+    done_cv.wait(done_lock, [&]() { return remaining == 0; });
+    if (error) std::rethrow_exception(error);
+}
+
+} // end of namespace alps
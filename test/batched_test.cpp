@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "batched.hpp"
+#include "exact_enumeration.hpp"
+#include <boost/mpi/environment.hpp>
+
+using namespace fk;
+
+// the spectra of a batch of matrices
+TEST(batched, eigenvalues)
+{
+    int n = 7, nbatch = 5;
+    random_generator rnd(32167);
+    std::uniform_real_distribution<> u(-1, 1);
+    std::vector<Eigen::MatrixXd> m(nbatch);
+    std::vector<double> a(n*n*nbatch), evals;
+    for (int b=0; b<nbatch; ++b) {
+        Eigen::MatrixXd x(n, n);
+        for (int i=0; i<n; ++i) for (int j=0; j<n; ++j) x(i,j) = u(rnd);
+        m[b] = x + x.transpose();
+        // a diagonal matrix in the batch needs no reflections
+        if (b == 2) m[b] = m[b].diagonal().asDiagonal();
+        for (int i=0; i<n; ++i) for (int j=0; j<n; ++j) a[(i*n + j)*nbatch + b] = m[b](i,j);
+        }
+    batched_eigenvalues(a, n, nbatch, evals);
+    for (int b=0; b<nbatch; ++b) {
+        Eigen::VectorXd exact = Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>(m[b], Eigen::EigenvaluesOnly).eigenvalues();
+        for (int i=0; i<n; ++i) EXPECT_NEAR(evals[i*nbatch + b], exact(i), 1e-12);
+        }
+}
+
+// the chains sample the exact distribution of f-configurations and don't depend on the batch size
+TEST(batched, chains)
+{
+    size_t L = 4;
+    double U = 2.0, mu_c = 1.0, mu_f = 0.7, beta = 2.0;
+    std::vector<double> W = {0.0, 0.3};
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    config_params p({beta, U, mu_c, mu_f, W});
+
+    auto exact = exact_distribution(lattice, p);
+
+    int nchains = 8, nsteps = 20000;
+    batched_chains<hypercubic_lattice<1>> chains(lattice, p, nchains, 32167, 0, 1.0, 1.0, false);
+    chains.randomize(L/2);
+    std::vector<double> h(1<<L, 0.0);
+    for (int s=0; s<nsteps; ++s) {
+        chains.step();
+        for (int b=0; b<nchains; ++b) h[config_index(chains.f_config(b))]+=1.0/nsteps/nchains;
+        }
+    for (int k=0; k<(1<<L); ++k) EXPECT_NEAR(h[k], exact[k], 5e-3);
+
+    // chain 3 of a batch of 4 is the chain 0 of the batch with streams from 3
+    batched_chains<hypercubic_lattice<1>> c4(lattice, p, 4, 11, 0, 1.0, 1.0, false), c1(lattice, p, 1, 11, 3, 1.0, 1.0, false);
+    c4.randomize(L/2);
+    c1.randomize(L/2);
+    c4.run(10, 20, 4, 0);
+    c1.run(10, 20, 4, 0);
+    EXPECT_TRUE((c4.f_config(3) == c1.f_config(0)).all());
+    EXPECT_EQ(c1.observables()[0].energies.size(), 20);
+    for (int s=0; s<20; ++s) EXPECT_NEAR(c4.observables()[3].energies[s], c1.observables()[0].energies[s], 1e-10);
+
+    // a run, stopped by max_time, measures all chains after complete sweeps
+    batched_chains<hypercubic_lattice<1>> ct(lattice, p, 4, 11, 0, 1.0, 1.0, false);
+    ct.randomize(L/2);
+    ct.run(0, 100000000, 4, 1);
+    size_t nmeasures = ct.observables()[0].energies.size();
+    EXPECT_GT(nmeasures, 0);
+    EXPECT_LT(nmeasures, 100000000);
+    for (int b=1; b<4; ++b) EXPECT_EQ(ct.observables()[b].energies.size(), nmeasures);
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
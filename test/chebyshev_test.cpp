@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "fk_mc.hpp"
+
+#include "lattice/hypercubic.hpp"
+#include "measures/energy.hpp"
+#include "measures/energy_cheb.hpp"
+#include "measures/kpm_dos.hpp"
+#include "measures/typical_dos.hpp"
+#include "measures/spectral_function.hpp"
+
+using namespace fk;
+
+typedef hypercubic_lattice<2> lattice_t;
+
+/// A 2d configuration with random f-electrons
+configuration_t make_config(const lattice_t& lattice, double U, double beta, int seed)
+{
+    double mu = U/2;
+    configuration_t config(lattice, beta, U, mu, mu);
+    random_generator rnd(seed);
+    config.randomize_f(rnd, lattice.get_msize()/2);
+    config.calc_hamiltonian();
+    return config;
+}
+
+void test_energy(double U, double beta)
+{
+    boost::mpi::communicator comm;
+    int L = 8;
+    lattice_t lattice(L);
+    lattice.fill(1.0);
+    configuration_t config = make_config(lattice, U, beta, 32167);
+
+    int cheb_size = 64;
+    chebyshev::chebyshev_eval cheb(cheb_size, 2*cheb_size);
+
+    std::vector<double> energies, d2energies, c_energies;
+    std::vector<double> energies_cheb, d2energies_cheb, c_energies_cheb;
+    measure_energy m_ed(beta, config, energies, d2energies, c_energies);
+    measure_energy_cheb m_cheb(beta, config, cheb, energies_cheb, d2energies_cheb, c_energies_cheb);
+    m_ed.accumulate(1.0);
+    m_cheb.accumulate(1.0);
+
+    std::cout << "E (ed) = " << energies[0] << ", E (cheb) = " << energies_cheb[0] << std::endl;
+    std::cout << "d2E (ed) = " << d2energies[0] << ", d2E (cheb) = " << d2energies_cheb[0] << std::endl;
+    EXPECT_NEAR(energies[0], energies_cheb[0], 1e-3 * lattice.get_msize());
+    EXPECT_NEAR(c_energies[0], c_energies_cheb[0], 1e-3 * lattice.get_msize());
+    EXPECT_NEAR(d2energies[0], d2energies_cheb[0], 1e-2 * lattice.get_msize());
+}
+
+TEST(chebyshev, energy0) { test_energy(1.0, 1.0); }
+TEST(chebyshev, energy1) { test_energy(4.0, 5.0); }
+
+TEST(chebyshev, kpm_moments)
+{
+    lattice_t lattice(6);
+    lattice.fill(1.0);
+    configuration_t config = make_config(lattice, 2.0, 1.0, 32167);
+    config.calc_ed(false);
+    const auto& spectrum = config.ed_data().cached_spectrum;
+
+    random_generator rnd(1);
+    int nmoments = 32;
+    auto bounds = measure_kpm_dos::spectrum_bounds(config);
+    EXPECT_LT(bounds.b - bounds.a, spectrum.minCoeff());
+    EXPECT_GT(bounds.b + bounds.a, spectrum.maxCoeff());
+
+    auto x = chebyshev::rescale(config.hamilt_, bounds);
+    auto moments = chebyshev::kpm_moments(x, nmoments, 0, rnd);
+    for (int m=0; m<nmoments; ++m) { 
+        double mu = 0.0;
+        for (int i=0; i<spectrum.size(); ++i) mu += chebyshev::chebyshev_t((spectrum[i] - bounds.b)/bounds.a, m) / spectrum.size();
+        EXPECT_NEAR(mu, moments[m], 1e-10);
+        }
+
+    // normalization of the damped dos
+    auto kernel = chebyshev::jackson_kernel(nmoments);
+    for (int m=0; m<nmoments; ++m) moments[m]*=kernel[m];
+    int npts = 4000;
+    std::vector<double> grid(npts);
+    for (int i=0; i<npts; ++i) grid[i] = bounds.b - bounds.a + 2.*bounds.a*(i+0.5)/npts;
+    auto dos = chebyshev::kpm_dos(moments, bounds, grid);
+    double norm = std::accumulate(dos.begin(), dos.end(), 0.0) * 2.*bounds.a / npts;
+    EXPECT_NEAR(norm, 1.0, 1e-2);
+}
+
+// For U = 0 plane waves are eigenstates : <k|x|k> = (e_k - b)/a
+TEST(chebyshev, spectral_function)
+{
+    boost::mpi::communicator comm;
+    lattice_t lattice(6);
+    lattice.fill(1.0);
+    configuration_t config(lattice, 1.0, 0.0, 0.3, 0.0);
+    config.calc_hamiltonian();
+
+    int nmoments = 8;
+    auto kpoints = lattice.get_all_bzpoints();
+    std::vector<std::vector<double>> moments_history;
+    measure_spectral_function<lattice_t> m(config, lattice, kpoints, nmoments, moments_history);
+    m.accumulate(1.0);
+    auto kernel = chebyshev::jackson_kernel(nmoments);
+    auto bounds = m.bounds();
+
+    for (size_t k=0; k<kpoints.size(); k++) { 
+        std::array<double, 2> kval = kpoints[k];
+        double e_k = -2.0*(cos(kval[0]) + cos(kval[1])) - 0.3;
+        EXPECT_NEAR(moments_history[k*nmoments][0], 1.0, 1e-10);
+        EXPECT_NEAR(moments_history[k*nmoments + 1][0] / kernel[1], (e_k - bounds.b)/bounds.a, 1e-10);
+        }
+}
+
+// the local dos on all sites is the Jackson-damped dos from the weights of the eigenvectors, rho_i(w) = sum_n |<i|n>|^2 delta(w - e_n)
+TEST(chebyshev, typical_dos)
+{
+    lattice_t lattice(4);
+    lattice.fill(1.0);
+    configuration_t config = make_config(lattice, 2.0, 1.0, 32167);
+    config.calc_ed(true);
+    const auto& spectrum = config.ed_data().cached_spectrum;
+    const auto& evecs = config.ed_data().cached_evecs;
+
+    random_generator rnd(1);
+    int nmoments = 32, msize = lattice.get_msize();
+    std::vector<double> grid;
+    for (double w = -3.0; w <= 3.0; w += 0.5) grid.push_back(w);
+    std::vector<std::vector<double>> log_dos_history, dos_history;
+    measure_typical_dos m(config, rnd, nmoments, msize, grid, log_dos_history, dos_history);
+    m.accumulate(1.0);
+    auto kernel = chebyshev::jackson_kernel(nmoments);
+    auto bounds = m.bounds_;
+
+    std::vector<double> log_dos(grid.size(), 0.0), dos(grid.size(), 0.0), moments(nmoments);
+    for (int i=0; i<msize; ++i) { 
+        for (int k=0; k<nmoments; ++k) { 
+            moments[k] = 0.0;
+            for (int n=0; n<spectrum.size(); ++n) moments[k] += evecs(i,n)*evecs(i,n) * chebyshev::chebyshev_t((spectrum[n] - bounds.b)/bounds.a, k);
+            moments[k]*=kernel[k];
+            }
+        auto dos_i = chebyshev::kpm_dos(moments, bounds, grid);
+        for (size_t w=0; w<grid.size(); ++w) { 
+            log_dos[w] += std::log(dos_i[w]) / msize;
+            dos[w] += dos_i[w] / msize;
+            }
+        }
+    ASSERT_EQ(dos_history.size(), grid.size());
+    for (size_t w=0; w<grid.size(); ++w) { 
+        ASSERT_EQ(dos_history[w].size(), 1);
+        EXPECT_NEAR(dos_history[w][0], dos[w], 1e-10);
+        EXPECT_NEAR(log_dos_history[w][0], log_dos[w], 1e-8);
+        // the typical dos is below the average one
+        EXPECT_LE(log_dos[w], std::log(dos[w]) + 1e-12);
+        }
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
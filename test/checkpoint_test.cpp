@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include <boost/mpi/environment.hpp>
+#include <cstdio>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+parameters_t checkpoint_params(double beta = 2.0)
+{
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = beta;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 8;
+    p["nsweeps"] = 1000;
+    p["ntherm_sweeps"] = 20;
+    p["sweep_len"] = 4;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["measure_recycled"] = true;
+    p["auto_therm"] = true;
+    p["convergence_interval"] = 8;
+    return p;
+}
+
+void sweep(mc_t& mc, int n) { for (int s=0; s<n; ++s) { mc.update(); mc.measure(); } }
+
+// a chain, continued from a checkpoint, is the same as the uninterrupted one
+TEST(checkpoint, resume)
+{
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    std::string file = "checkpoint_test.chk";
+    int n1 = 40, n2 = 30;
+
+    mc_t ref(checkpoint_params());
+    ref.initialize(lattice);
+    sweep(ref, n1 + n2);
+
+    mc_t first(checkpoint_params());
+    first.initialize(lattice);
+    sweep(first, n1);
+    first.save_checkpoint(file);
+
+    mc_t second(checkpoint_params());
+    second.initialize(lattice);
+    second.load_checkpoint(file);
+    sweep(second, n2);
+
+    EXPECT_TRUE((ref.config().f_config_ == second.config().f_config_).all());
+    EXPECT_EQ(ref.thermalization_sweeps(), second.thermalization_sweeps());
+    ASSERT_EQ(ref.observables.energies.size(), second.observables.energies.size());
+    for (size_t i=0; i<ref.observables.energies.size(); ++i) EXPECT_DOUBLE_EQ(ref.observables.energies[i], second.observables.energies[i]);
+    EXPECT_EQ(ref.observables.nf0, second.observables.nf0);
+    for (size_t i=0; i<ref.observables.spectrum.size(); ++i) EXPECT_NEAR(ref.observables.spectrum[i], second.observables.spectrum[i], 1e-12);
+    for (size_t i=0; i<ref.observables.recycled_fcorrel.size(); ++i)
+        EXPECT_NEAR(ref.observables.recycled_fcorrel[i], second.observables.recycled_fcorrel[i], 1e-12);
+    for (size_t i=0; i<ref.move_stats().size(); ++i) EXPECT_EQ(ref.move_stats()[i].nattempt, second.move_stats()[i].nattempt);
+    for (size_t i=0; i<ref.monitors().size(); ++i) EXPECT_DOUBLE_EQ(ref.monitors()[i].binning.mean(), second.monitors()[i].binning.mean());
+
+    // a checkpoint of a different model is refused
+    mc_t other(checkpoint_params(3.0));
+    other.initialize(lattice);
+    EXPECT_THROW(other.load_checkpoint(file), std::logic_error);
+    std::remove(file.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include "measures/recycled.hpp"
+#include "prog/data_save.hpp"
+#include <boost/mpi/environment.hpp>
+#include <cstdio>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+// the histories of the ranks are concatenated on the root, also with different numbers of samples
+TEST(collect, gather_history)
+{
+    boost::mpi::communicator comm;
+    std::vector<double> h(comm.rank() + 1, double(comm.rank()));
+    gather_history(comm, h);
+    if (comm.rank()) return;
+    int n = comm.size();
+    ASSERT_EQ(h.size(), n*(n+1)/2);
+    for (int r=0, i=0; r<n; ++r) for (int k=0; k<=r; ++k, ++i) EXPECT_EQ(h[i], r);
+}
+
+parameters_t collect_params()
+{
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 2.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 8;
+    p["sweep_len"] = 4;
+    p["ntherm_sweeps"] = 4;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["measure_history"] = false;
+    return p;
+}
+
+// the ranks do the expensive measures at different intervals
+TEST(collect, expensive_skip)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    parameters_t p = collect_params();
+    p["measure_kpm_dos"] = true;
+    p["kpm_moments"] = 16;
+    p["expensive_skip"] = comm.rank() + 1;
+    mc_t mc(p, comm.rank());
+    mc.initialize(lattice);
+    int n = 12;
+    for (int s=0; s<4 + n; ++s) { mc.update(); mc.measure(); }
+    mc.collect_results(comm);
+
+    if (comm.rank()) return;
+    size_t total = 0;
+    for (int r=0; r<comm.size(); ++r) total += (n + r) / (r + 1);
+    EXPECT_EQ(mc.observables.kpm_moments_history[0].size(), total);
+    EXPECT_EQ(mc.observables.energies.size(), n*comm.size());
+}
+
+// the ranks stop after different numbers of sweeps (auto_therm, target_rel_error, max_time)
+TEST(collect, different_counts)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    parameters_t p = collect_params();
+    p["measure_history"] = true;
+    p["measure_recycled"] = true;
+    mc_t mc(p, comm.rank());
+    mc.initialize(lattice);
+    int n = 10 + 3*comm.rank();
+    for (int s=0; s<4 + n; ++s) { mc.update(); mc.measure(); }
+    typedef measure_recycled<hypercubic_lattice<2>> m_t;
+    std::vector<double> local = mc.observables.recycled_history[m_t::nf0];
+    mc.collect_results(comm);
+
+    if (comm.rank()) return;
+    size_t total = 0;
+    for (int r=0; r<comm.size(); ++r) total += 10 + 3*r;
+    observables_t const& obs = mc.observables;
+    EXPECT_EQ(obs.energies.size(), total);
+    EXPECT_EQ(obs.nf0.size(), total);
+    EXPECT_EQ(obs.focc_history[0].size(), total);
+    ASSERT_EQ(obs.recycled_history.size(), m_t::nvalues);
+    for (auto const& h : obs.recycled_history) EXPECT_EQ(h.size(), total);
+    // the history of the root comes first
+    for (size_t i=0; i<local.size(); ++i) EXPECT_EQ(obs.recycled_history[m_t::nf0][i], local[i]);
+}
+
+// the statistics of the moves are summed over the ranks on the root and saved
+TEST(collect, move_stats)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    mc_t mc(collect_params(), comm.rank());
+    mc.initialize(lattice);
+    for (int s=0; s<4 + 10*(comm.rank() + 1); ++s) { mc.update(); mc.measure(); }
+    std::vector<alps::move_statistics> local = mc.move_stats(), total = mc.collect_move_stats(comm);
+    ASSERT_EQ(total.size(), local.size());
+
+    std::vector<long> nattempt, naccept;
+    std::vector<double> time;
+    for (auto const& s : local) { nattempt.push_back(s.nattempt); naccept.push_back(s.naccept); time.push_back(s.time); }
+    std::vector<std::vector<long>> all_nattempt, all_naccept;
+    std::vector<std::vector<double>> all_time;
+    boost::mpi::gather(comm, nattempt, all_nattempt, 0);
+    boost::mpi::gather(comm, naccept, all_naccept, 0);
+    boost::mpi::gather(comm, time, all_time, 0);
+    if (comm.rank()) return;
+    for (size_t i=0; i<local.size(); ++i) {
+        long nattempt_sum = 0, naccept_sum = 0;
+        double time_sum = 0.0;
+        for (int r=0; r<comm.size(); ++r) { 
+            nattempt_sum += all_nattempt[r][i]; 
+            naccept_sum += all_naccept[r][i]; 
+            time_sum += all_time[r][i]; 
+            }
+        EXPECT_EQ(total[i].nattempt, nattempt_sum);
+        EXPECT_EQ(total[i].naccept, naccept_sum);
+        EXPECT_NEAR(total[i].time, time_sum, 1e-12);
+        EXPECT_GT(total[i].nattempt, local[i].nattempt);
+        }
+
+    // the reduced statistics are written to "/moves/<name>" of the output file
+    std::string file = "collect_test.h5";
+    parameters_t p = collect_params();
+    p["output"] = file;
+    save_move_stats(mc, total, p);
+    {
+    alps::hdf5::archive ar(file, "r");
+    for (size_t i=0; i<total.size(); ++i) {
+        std::string top = "/moves/" + mc.move_names()[i];
+        long nattempt, naccept;
+        double time, weight;
+        alps::hdf5::load(ar, top + "/nattempt", nattempt);
+        alps::hdf5::load(ar, top + "/naccept", naccept);
+        alps::hdf5::load(ar, top + "/time", time);
+        alps::hdf5::load(ar, top + "/weight", weight);
+        EXPECT_EQ(nattempt, total[i].nattempt);
+        EXPECT_EQ(naccept, total[i].naccept);
+        EXPECT_DOUBLE_EQ(time, total[i].time);
+        EXPECT_DOUBLE_EQ(weight, mc.move_weights()[i]);
+        }
+    }
+    std::remove(file.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
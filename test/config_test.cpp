@@ -71,6 +71,76 @@ TEST(config, ff_energy)
     ASSERT_NEAR(e_ff, e_ff_comp, 1e-15);
 }
 
+// incremental ff-energy on a 2d lattice
+TEST(config, ff_energy_diff)
+{
+    size_t L = 8;
+    std::vector<double> W = { 0.3, 1, 0.5, 0.2 };
+    hypercubic_lattice<2> lattice(L);
+    lattice.fill(-1.0);
+    random_generator rnd(32167);
+
+    // the fully occupied lattice : 4, 8 and 12 sites in the shells of the square lattice
+    configuration_t full(lattice, 1.0, 1.0, 0.5, 0.5, W);
+    full.f_config_.setConstant(1);
+    full.calc_hamiltonian();
+    EXPECT_NEAR(full.calc_ff_energy(), L*L*(W[0] + 4*W[1] + 8*W[2] + 12*W[3]), 1e-10);
+
+    configuration_t config(lattice, 1.0, 1.0, 0.5, 0.5, W);
+    config.randomize_f(rnd, L*L/2);
+    config.calc_hamiltonian();
+    std::uniform_int_distribution<> distr(0, L*L - 1);
+    for (int n=0; n<50; ++n) {
+        std::vector<size_t> sites = { size_t(distr(rnd)) };
+        size_t j = distr(rnd);
+        if (j != sites[0]) sites.push_back(j);
+        double e0 = config.calc_ff_energy();
+        double de = config.calc_ff_energy_diff(sites);
+        if (sites.size() == 1) { EXPECT_NEAR(de, config.calc_ff_energy_diff(sites[0]), 1e-12); }
+        for (size_t i : sites) config.f_config_(i) = 1 - config.f_config_(i);
+        // the cache is updated incrementally
+        config.update_hamiltonian(sites);
+        EXPECT_NEAR(config.calc_ff_energy() - e0, de, 1e-10);
+        configuration_t c2(config);
+        c2.calc_hamiltonian();
+        EXPECT_NEAR(c2.calc_ff_energy(), config.calc_ff_energy(), 1e-10);
+        }
+}
+
+// logZ at another temperature from the cached spectrum, and the change of parameters
+TEST(config, set_params)
+{
+    size_t L = 6;
+    hypercubic_lattice<2> lattice(L);
+    lattice.fill(-1.0);
+    random_generator rnd(32167);
+
+    configuration_t config(lattice, 2.0, 1.5, 0.75, 0.75);
+    config.randomize_f(rnd, L*L/2);
+    config.calc_hamiltonian();
+    configuration_t config2(lattice, 5.0, 1.5, 0.75, 0.75);
+    config2.f_config_ = config.f_config_;
+    config2.calc_hamiltonian();
+
+    EXPECT_NEAR(config.logz_at(5.0), config2.calc_logz(), 1e-10);
+    config.set_params(config2.params());
+    EXPECT_NEAR(config.calc_logz(), config2.calc_logz(), 1e-10);
+    EXPECT_NEAR(config.ed_data().cached_fermi.sum(), config2.ed_data().cached_fermi.sum(), 1e-10);
+
+    // a ladder in U rebuilds the hamiltonian of the live configuration at every step
+    for (double U : {2.5, 1.0, 3.0}) { 
+        config_params cp = config.params();
+        cp.U = U;
+        cp.mu_c = U/2;
+        config.set_params(cp);
+        configuration_t config3(lattice, cp.beta, cp.U, cp.mu_c, cp.mu_f);
+        config3.f_config_ = config.f_config_;
+        config3.calc_hamiltonian();
+        EXPECT_TRUE(configuration_t::dense_m(config3.hamilt_).isApprox(configuration_t::dense_m(config.hamilt_)));
+        EXPECT_NEAR(config.calc_logz(), config3.calc_logz(), 1e-10);
+        }
+}
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "convergence.hpp"
+#include <numeric>
+
+using namespace fk;
+
+// binning of an AR(1) series x_i = a x_{i-1} + noise, with tau_int = (1+a)/(1-a)/2
+TEST(convergence, binning)
+{
+    random_generator rnd(32167);
+    std::normal_distribution<> g(0, 1);
+    double a = 0.8, x = 0.0;
+    alps::online_binning b;
+    std::vector<double> xs;
+    int n = 1<<20;
+    for (int i=0; i<n; ++i) { x = a*x + g(rnd); b.add(x); xs.push_back(x); }
+
+    EXPECT_EQ(b.count(), n);
+    double mean = std::accumulate(xs.begin(), xs.end(), 0.0) / n;
+    EXPECT_NEAR(b.mean(), mean, 1e-10);
+    double var = 0;
+    for (double v : xs) var += (v - mean)*(v - mean);
+    var /= (n-1);
+    EXPECT_NEAR(b.level_error(0), std::sqrt(var / n), 1e-10);
+
+    double tau = 0.5*(1+a)/(1-a);
+    EXPECT_NEAR(b.tau(), tau, 0.2*tau);
+    EXPECT_NEAR(b.error(), std::sqrt(var*(1+2*tau)/n), 0.1*b.error());
+
+    // the windowed estimate from a part of the series
+    EXPECT_NEAR(alps::integrated_autocorrelation(std::vector<double>(xs.begin(), xs.begin() + 8192)), tau, 0.2*tau);
+    EXPECT_NEAR(alps::integrated_autocorrelation(std::vector<double>(8192, 1.0)), 0.5, 1e-12);
+}
+
+// the truncation point of a series with an initial transient
+TEST(convergence, mser)
+{
+    random_generator rnd(7);
+    std::normal_distribution<> g(0, 0.1);
+    std::vector<double> x;
+    for (int i=0; i<1000; ++i) x.push_back((i < 200 ? 5.0*(1.0 - i/200.) : 0.0) + g(rnd));
+    size_t d = alps::mser_truncation(x);
+    EXPECT_GE(d, 150);
+    EXPECT_LE(d, 250);
+
+    // still relaxing
+    std::vector<double> y;
+    for (int i=0; i<1000; ++i) y.push_back(i/100. + g(rnd));
+    EXPECT_EQ(alps::mser_truncation(y), y.size());
+    // too short
+    EXPECT_EQ(alps::mser_truncation(std::vector<double>(50, 1.0)), 50);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
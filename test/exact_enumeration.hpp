@@ -0,0 +1,110 @@
+#ifndef __FK_MC_TEST_EXACT_ENUMERATION_HPP_
+#define __FK_MC_TEST_EXACT_ENUMERATION_HPP_
+
+#include "configuration.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <numeric>
+#include <tuple>
+
+namespace fk {
+
+/// Index of an f-configuration in the enumeration, k = sum_i n_i 2^i
+inline int config_index(configuration_t::int_array_t const& f)
+{
+    int k = 0;
+    for (int i=0; i<f.size(); ++i) k+= f(i)<<i;
+    return k;
+}
+
+/// All 2^N f-configurations of a small lattice with their hamiltonians, configuration k has n_i = (k >> i) & 1
+inline std::vector<configuration_t> all_configurations(lattice_base const& lattice, config_params const& p)
+{
+    size_t V = lattice.get_msize();
+    std::vector<configuration_t> configs;
+    for (int k=0; k<(1<<V); ++k) {
+        configuration_t c(lattice, p.beta, p.U, p.mu_c, p.mu_f, p.W);
+        for (size_t i=0; i<V; ++i) c.f_config_(i) = (k>>i)&1;
+        c.calc_hamiltonian();
+        configs.push_back(c);
+        }
+    return configs;
+}
+
+/// log of the weight of a configuration, logZ_c + beta*mu_f*nf - beta*E_ff
+inline double log_weight(configuration_t& c)
+{
+    auto const& p = c.params();
+    return c.calc_logz() + p.beta*(p.mu_f*c.get_nf() - c.calc_ff_energy());
+}
+
+/// log of the partition function, summed over all f-configurations
+inline double exact_log_z(lattice_base const& lattice, config_params const& p)
+{
+    std::vector<double> lw;
+    for (auto& c : all_configurations(lattice, p)) lw.push_back(log_weight(c));
+    double lw_max = *std::max_element(lw.begin(), lw.end()), s = 0.0;
+    for (double x : lw) s += std::exp(x - lw_max);
+    return lw_max + std::log(s);
+}
+
+/// Exact probabilities of all f-configurations. With nf >= 0 only the configurations with nf f-electrons are taken.
+inline std::vector<double> exact_distribution(lattice_base const& lattice, config_params const& p, int nf = -1)
+{
+    auto configs = all_configurations(lattice, p);
+    std::vector<double> lw(configs.size());
+    for (size_t k=0; k<configs.size(); ++k) lw[k] = log_weight(configs[k]);
+    double lw_max = *std::max_element(lw.begin(), lw.end()), Z = 0.0;
+    std::vector<double> prob(configs.size(), 0.0);
+    for (size_t k=0; k<configs.size(); ++k) {
+        if (nf >= 0 && configs[k].get_nf() != size_t(nf)) continue;
+        prob[k] = std::exp(lw[k] - lw_max);
+        Z+=prob[k];
+        }
+    for (auto& x : prob) x /= Z;
+    return prob;
+}
+
+/// Mean and error of the mean of the batch means of a series (or of the values, if every value is a batch mean)
+inline std::pair<double, double> batch_mean_error(std::vector<double> const& x, int nbatches)
+{
+    int len = x.size() / nbatches;
+    std::vector<double> b(nbatches, 0.0);
+    for (int i=0; i<nbatches*len; ++i) b[i / len]+=x[i] / len;
+    double mean = std::accumulate(b.begin(), b.end(), 0.0) / nbatches, var = 0.0;
+    for (double y : b) var+=(y - mean)*(y - mean);
+    return std::make_pair(mean, std::sqrt(var / nbatches / (nbatches - 1)));
+}
+
+/// Frequencies of the f-configurations, visited by a chain, and their errors from nbatches batches of the steps
+struct histogram_t {
+    std::vector<double> p, err;
+    int nsteps;
+};
+
+/// Histogram of the f-configurations, visited by nsteps Metropolis steps of a move
+template <typename Move>
+histogram_t sample_histogram(Move& move, int nsteps, int nbatches = 20)
+{
+    std::uniform_real_distribution<> u(0, 1);
+    int n = 1<<move.config.lattice_.get_msize(), len = nsteps / nbatches;
+    std::vector<std::vector<double>> batches(n, std::vector<double>(nbatches, 0.0));
+    for (int s=0; s<nbatches*len; ++s) {
+        if (move.attempt() > u(move.RND)) move.accept(); else move.reject();
+        batches[config_index(move.config.f_config_)][s / len]+=1.0/len;
+        }
+    histogram_t h = { std::vector<double>(n), std::vector<double>(n), nbatches*len };
+    for (int k=0; k<n; ++k) std::tie(h.p[k], h.err[k]) = batch_mean_error(batches[k], nbatches);
+    return h;
+}
+
+/** Check a sampled histogram against the exact distribution within nsigma errors. 
+ *  The configurations, that are too rare to be seen in the batches, are allowed to be missed. */
+inline void expect_distribution(histogram_t const& h, std::vector<double> const& exact, double nsigma = 5.0)
+{
+    for (size_t k=0; k<exact.size(); ++k) EXPECT_NEAR(h.p[k], exact[k], nsigma*h.err[k] + 3.0/h.nsteps);
+}
+
+} // end of namespace fk
+
+#endif // endif :: #ifndef __FK_MC_TEST_EXACT_ENUMERATION_HPP_
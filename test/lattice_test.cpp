@@ -47,6 +47,33 @@ TEST(lattice, bzpoints)
     for (auto x : bzpts) std::cout << x << " "; std::cout << std::endl;
 }
 
+TEST(lattice, bzpath)
+{
+    hypercubic_lattice<2> l4(4);
+    auto path = l4.get_high_symmetry_path();
+    // (0,0) -> (pi,0) -> (pi,pi) -> (0,0)
+    std::vector<std::array<int, 2>> expected = {{{0,0}}, {{1,0}}, {{2,0}}, {{2,1}}, {{2,2}}, {{1,1}}, {{0,0}}};
+    ASSERT_EQ(path.size(), expected.size());
+    for (size_t i=0; i<path.size(); i++) { 
+        std::cout << path[i] << std::endl;
+        EXPECT_EQ(l4.index_to_pos(path[i].ind_), expected[i]);
+        }
+}
+
+TEST(lattice, neighbor_shells)
+{
+    hypercubic_lattice<2> l4(4);
+    l4.fill(1.0);
+    auto shells = l4.neighbor_shells(2);
+    for (size_t i=0; i<l4.get_msize(); i++) { 
+        auto nn = l4.neighbor_index(i);
+        std::sort(nn.begin(), nn.end());
+        EXPECT_EQ(shells[0][i], nn);
+        // (1,1) and (2,0) type neighbors
+        EXPECT_EQ(shells[1][i].size(), 6);
+        }
+}
+
 TEST(lattice, fft)
 {
     Eigen::ArrayXcd a1(l1.get_msize()); 
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include "moves_delayed.hpp"
+#include <boost/mpi/environment.hpp>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+parameters_t mc_params()
+{
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 2.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 8;
+    p["sweep_len"] = 4;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["measure_history"] = false;
+    return p;
+}
+
+void sweep(mc_t& mc, int n) { for (int s=0; s<n; ++s) { mc.update(); mc.measure(); } }
+
+// the sweep length and the interval of the expensive measures follow the autocorrelation times of the monitors
+TEST(mc_metropolis, adapt_intervals)
+{
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    parameters_t p = mc_params();
+    p["ntherm_sweeps"] = 256;
+    p["adapt_sweep_len"] = true;
+    p["expensive_skip"] = 0;
+    p["measure_kpm_dos"] = true;
+    p["kpm_moments"] = 16;
+    mc_t mc(p);
+    mc.initialize(lattice);
+    sweep(mc, 256);
+
+    ASSERT_FALSE(mc.monitors().empty());
+    double tau_min = mc.monitors()[0].tau_therm, tau_max = tau_min;
+    for (auto const& m : mc.monitors()) {
+        EXPECT_GE(m.tau_therm, 0.5 - 1e-12);
+        tau_min = std::min(tau_min, m.tau_therm);
+        tau_max = std::max(tau_max, m.tau_therm);
+        }
+    long len = std::max(1L, std::lround(4 * 2.0 * tau_min));
+    long skip = std::max(1L, long(std::ceil(2.0 * tau_max * 4 / len)));
+    EXPECT_EQ(mc.sweep_len(), len);
+    ASSERT_EQ(mc.measure_skips().count("kpm_dos"), 1);
+    EXPECT_EQ(mc.measure_skips().at("kpm_dos"), skip);
+
+    // the cheap measures are done every sweep, the expensive ones every skip sweeps, starting with the first one
+    int n = 50;
+    sweep(mc, n);
+    EXPECT_EQ(mc.observables.energies.size(), n);
+    EXPECT_EQ(mc.observables.kpm_moments_history[0].size(), (n + skip - 1) / skip);
+
+    // a fixed interval overrides the autocorrelation times
+    p["expensive_skip"] = 3;
+    p["adapt_sweep_len"] = false;
+    mc_t fixed(p);
+    fixed.initialize(lattice);
+    sweep(fixed, 256 + n);
+    EXPECT_EQ(fixed.sweep_len(), 4);
+    EXPECT_EQ(fixed.measure_skips().at("kpm_dos"), 3);
+    EXPECT_EQ(fixed.observables.kpm_moments_history[0].size(), (n + 2) / 3);
+}
+
+// the speculative update draws the same random numbers and commits the same moves, as the sequential one
+TEST(mc_metropolis, speculative)
+{
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    parameters_t p = mc_params();
+    p["mc_hop"] = 0.5;
+    p["W"] = std::vector<double>({0.0, 0.3});
+    p["sweep_len"] = 16;
+    p["ntherm_sweeps"] = 0;
+
+    std::vector<std::unique_ptr<mc_t>> runs;
+    for (auto const& spec : std::vector<std::pair<int,int>>({{0,1}, {4,1}, {4,3}})) {
+        p["nspeculative"] = spec.first;
+        p["nthreads"] = spec.second;
+        runs.emplace_back(new mc_t(p));
+        runs.back()->initialize(lattice);
+        sweep(*runs.back(), 100);
+        }
+
+    mc_t const& ref = *runs[0];
+    ASSERT_EQ(ref.move_stats().size(), 3);
+    for (size_t r=1; r<runs.size(); ++r) {
+        mc_t const& mc = *runs[r];
+        EXPECT_TRUE((mc.config().f_config_ == ref.config().f_config_).all());
+        ASSERT_EQ(mc.observables.energies.size(), ref.observables.energies.size());
+        for (size_t s=0; s<ref.observables.energies.size(); ++s) EXPECT_EQ(mc.observables.energies[s], ref.observables.energies[s]);
+        for (size_t i=0; i<ref.move_stats().size(); ++i) {
+            EXPECT_EQ(mc.move_stats()[i].nattempt, ref.move_stats()[i].nattempt);
+            EXPECT_EQ(mc.move_stats()[i].naccept, ref.move_stats()[i].naccept);
+            }
+        }
+    // all moves were accepted at least once
+    for (auto const& s : ref.move_stats()) EXPECT_GT(s.naccept, 0);
+}
+
+/// A move, that is never accepted
+struct move_never {
+    double attempt() { return 0.0; }
+    double accept() { return 1.0; }
+    void reject() {}
+};
+
+// a move, that always fails, keeps exactly the minimal weight, the others share the rest
+TEST(mc_metropolis, adapt_move_weights)
+{
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    parameters_t p = mc_params();
+    p["ntherm_sweeps"] = 64;
+    p["adapt_moves"] = true;
+    p["adapt_interval"] = 4;
+    p["adapt_min_weight"] = 0.1;
+    mc_t mc(p);
+    mc.initialize(lattice);
+    mc.add_move(move_never(), "never", 1.0);
+    sweep(mc, 64);
+
+    auto const& w = mc.move_weights();
+    ASSERT_EQ(w.size(), 3);
+    EXPECT_EQ(mc.move_stats()[2].naccept, 0);
+    EXPECT_GT(mc.move_stats()[2].nattempt, 0);
+    EXPECT_NEAR(w[2], 0.1, 1e-12);
+    EXPECT_NEAR(std::accumulate(w.begin(), w.end(), 0.0), 1.0, 1e-12);
+    for (double x : w) EXPECT_GE(x, 0.1 - 1e-12);
+    // the weights are frozen after the thermalization
+    std::vector<double> w_therm(w);
+    sweep(mc, 16);
+    EXPECT_EQ(mc.move_weights(), w_therm);
+}
+
+// the delayed acceptance counters only see the proposals, that the chain uses, also with the speculative update
+TEST(mc_metropolis, speculative_delayed_stats)
+{
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    parameters_t p = mc_params();
+    p["ntherm_sweeps"] = 0;
+    p["mc_flip"] = 0.0;
+    p["mc_delayed_add_remove"] = 1.0;
+    p["delayed_radius"] = 1;
+    p["nspeculative"] = 4;
+    p["nthreads"] = 2;
+    mc_t mc(p);
+    mc.initialize(lattice);
+    sweep(mc, 50);
+
+    auto it = std::find(mc.move_names().begin(), mc.move_names().end(), "delayed_add_remove");
+    ASSERT_TRUE(it != mc.move_names().end());
+    auto const& s = mc.move_stats()[it - mc.move_names().begin()];
+    auto const& stats = mc.extract_move<move_delayed>("delayed_add_remove").stats();
+    EXPECT_GT(s.naccept, 0);
+    EXPECT_EQ(stats.nattempt, s.nattempt);
+    EXPECT_EQ(stats.naccept, s.naccept);
+    EXPECT_LE(stats.nstage1, stats.nattempt);
+    EXPECT_GE(stats.nstage1, stats.naccept);
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
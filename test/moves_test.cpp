@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include "moves.hpp"
+#include "moves_mtm.hpp"
+#include "moves_delayed.hpp"
+#include "moves_slmc.hpp"
+#include "moves_nfold.hpp"
+#include "measures/recycled.hpp"
+#include "exact_enumeration.hpp"
+
+using namespace fk;
+
+// multiple-try moves sample the exact distribution of f-configurations, independently of the number of threads
+TEST(moves, mtm)
+{
+    size_t L = 4;
+    config_params p({2.0, 2.0, 1.0, 0.7, {}});
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    auto exact = exact_distribution(lattice, p);
+
+    std::vector<histogram_t> hist;
+    for (int nthreads : {1, 3}) {
+        configuration_t config(lattice, p.beta, p.U, p.mu_c, p.mu_f);
+        config.calc_hamiltonian();
+        random_generator rnd(32167);
+        alps::thread_pool pool(nthreads);
+        move_mtm move(p.beta, config, nullptr, rnd, pool, move_mtm::add_remove, 4);
+        hist.push_back(sample_histogram(move, 50000));
+        // the trials are updated locally - the same as the full hamiltonian
+        configuration_t c2(move.proposed());
+        c2.calc_hamiltonian();
+        EXPECT_TRUE(configuration_t::dense_m(c2.hamilt_).isApprox(configuration_t::dense_m(move.proposed().hamilt_)));
+        }
+    expect_distribution(hist[0], exact);
+    for (int k=0; k<(1<<L); ++k) EXPECT_EQ(hist[0].p[k], hist[1].p[k]);
+}
+
+TEST(moves, delayed)
+{
+    size_t L = 6;
+    config_params p({2.0, 2.0, 1.0, 0.7, {}});
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    auto exact = exact_distribution(lattice, p);
+
+    configuration_t config(lattice, p.beta, p.U, p.mu_c, p.mu_f);
+    config.calc_hamiltonian();
+    random_generator rnd(32167);
+    // the patch of radius 1 is smaller than the lattice, so that the surrogate differs from the exact weight
+    move_delayed move(config, nullptr, rnd, move_delayed::add_remove, 1);
+    expect_distribution(sample_histogram(move, 200000), exact);
+    EXPECT_EQ(move.stats().nattempt, 200000);
+    EXPECT_LT(move.stats().stage1_rate(), 1.0);
+}
+
+TEST(moves, slmc)
+{
+    size_t L = 6;
+    config_params p({4.0, 2.0, 1.0, 1.0, {}});
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    auto exact = exact_distribution(lattice, p);
+
+    configuration_t config(lattice, p.beta, p.U, p.mu_c, p.mu_f);
+    config.calc_hamiltonian();
+    random_generator rnd(32167);
+    move_slmc move(config, nullptr, rnd, 2, 500);
+    expect_distribution(sample_histogram(move, 200000), exact);
+    EXPECT_GT(move.model().mean_cluster_size(), 1.0);
+}
+
+TEST(moves, hop)
+{
+    size_t L = 6, nf = 3;
+    config_params p({2.0, 2.0, 1.0, 1.0, {0.0, 0.3}});
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    // exact weights at fixed nf
+    auto exact = exact_distribution(lattice, p, nf);
+
+    configuration_t config(lattice, p.beta, p.U, p.mu_c, p.mu_f, p.W);
+    random_generator rnd(32167);
+    config.randomize_f(rnd, nf);
+    config.calc_hamiltonian();
+    move_hop move(p.beta, config, rnd);
+    expect_distribution(sample_histogram(move, 100000), exact);
+
+    // the local update of the hamiltonian is the same as the full one
+    configuration_t c2(config);
+    c2.calc_hamiltonian();
+    EXPECT_TRUE(configuration_t::dense_m(c2.hamilt_).isApprox(configuration_t::dense_m(config.hamilt_)));
+}
+
+TEST(moves, nfold)
+{
+    size_t L = 6;
+    config_params p({4.0, 2.0, 1.0, 0.7, {0.0, 0.3}});
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    auto exact = exact_distribution(lattice, p);
+
+    configuration_t config(lattice, p.beta, p.U, p.mu_c, p.mu_f, p.W);
+    config.calc_hamiltonian();
+    random_generator rnd(32167);
+    alps::thread_pool pool(2);
+    nfold_addremove nfold(config, rnd, pool);
+    // histogram, weighted with the residence times
+    int nsteps = 60000;
+    std::vector<double> h(1<<L, 0.0);
+    double total = 0.0;
+    for (int s=0; s<nsteps; ++s) {
+        double t = nfold.residence_time();
+        h[config_index(config.f_config_)]+=t;
+        total+=t;
+        nfold.advance();
+        }
+    for (int k=0; k<(1<<L); ++k) EXPECT_NEAR(h[k]/total, exact[k], 5e-3);
+}
+
+// waste-recycling estimators converge to the exact averages
+TEST(moves, recycled)
+{
+    size_t L = 6;
+    config_params p({2.0, 2.0, 1.0, 0.7, {}});
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+
+    // exact averages of the energy, nf and 1/N sum_i n_i n_{i+r}
+    auto configs = all_configurations(lattice, p);
+    auto prob = exact_distribution(lattice, p);
+    double e_exact = 0, nf_exact = 0;
+    std::vector<double> c_exact(L, 0.0);
+    for (int k=0; k<(1<<L); ++k) {
+        configuration_t& c = configs[k];
+        c.calc_ed(false);
+        double e = (c.ed_data().cached_spectrum * c.ed_data().cached_fermi).sum() - p.mu_f*c.get_nf();
+        e_exact+=prob[k]*e;
+        nf_exact+=prob[k]*c.get_nf();
+        for (int r=0; r<L; ++r)
+            for (int i=0; i<L; ++i) c_exact[r]+=prob[k]*c.f_config_(i)*c.f_config_((i+r)%L)/L;
+        }
+
+    configuration_t config(lattice, p.beta, p.U, p.mu_c, p.mu_f);
+    config.calc_hamiltonian();
+    random_generator rnd(32167);
+    alps::move_wrap move(move_addremove(p.beta, config, rnd));
+    observables_t obs;
+    measure_recycled<hypercubic_lattice<1>> measure(config, lattice, true, obs.recycled_history, obs.recycled_spectrum, obs.recycled_fcorrel);
+    std::uniform_real_distribution<> u(0, 1);
+    int nsweeps = 4000, sweep_len = 8, nbatches = 20, len = nsweeps / nbatches;
+    // the batch means of C(r) from the running average
+    std::vector<std::vector<double>> c_batches(L);
+    std::vector<double> c_prev(L, 0.0);
+    for (int s=1; s<=nsweeps; ++s) {
+        for (int m=0; m<sweep_len; ++m) {
+            double w = move.attempt();
+            measure.recycle(move, std::min(1.0, w));
+            if (w > u(rnd)) move.accept(); else move.reject();
+            }
+        measure.accumulate(1.0);
+        if (s % len) continue;
+        for (int r=0; r<L; ++r) c_batches[r].push_back((s*obs.recycled_fcorrel[r] - (s-len)*c_prev[r]) / len);
+        c_prev = obs.recycled_fcorrel;
+        }
+    typedef measure_recycled<hypercubic_lattice<1>> m_t;
+    for (auto x : {std::make_pair(m_t::energy, e_exact), std::make_pair(m_t::nf0, nf_exact)}) {
+        auto m = batch_mean_error(obs.recycled_history[x.first], nbatches);
+        EXPECT_NEAR(m.first, x.second, 5*m.second);
+        }
+    for (int r=0; r<L; ++r) {
+        auto m = batch_mean_error(c_batches[r], nbatches);
+        EXPECT_NEAR(m.first, c_exact[r], 5*m.second);
+        EXPECT_NEAR(m.first, obs.recycled_fcorrel[r], 1e-10);
+        }
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include "parameter_scan.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace fk;
+
+TEST(scan, values)
+{
+    std::vector<double> list = scan_values("1,2.5,4");
+    ASSERT_EQ(list.size(), 3);
+    EXPECT_DOUBLE_EQ(list[1], 2.5);
+    std::vector<double> range = scan_values("0.5:1.5:5");
+    ASSERT_EQ(range.size(), 5);
+    EXPECT_DOUBLE_EQ(range[0], 0.5);
+    EXPECT_DOUBLE_EQ(range[2], 1.0);
+    EXPECT_DOUBLE_EQ(range[4], 1.5);
+    EXPECT_TRUE(scan_values("").empty());
+    EXPECT_THROW(scan_values("1:2"), std::logic_error);
+}
+
+// the snake order changes one parameter by one step between the subsequent points
+TEST(scan, snake)
+{
+    config_params base({10.0, 1.0, 0.5, 0.5, {}});
+    std::vector<double> betas = {1.0, 2.0, 4.0}, us = {1.0, 2.0}, mus = {0.0, 0.1, 0.2};
+    auto points = scan_points(base, {{"beta", betas}, {"U", us}, {"mu_f", mus}}, {"beta", "U", "mu_c", "mu_f"});
+    ASSERT_EQ(points.size(), betas.size() * us.size() * mus.size());
+    EXPECT_DOUBLE_EQ(points[0].beta, 1.0);
+    EXPECT_DOUBLE_EQ(points[0].U, 1.0);
+    EXPECT_DOUBLE_EQ(points[0].mu_f, 0.0);
+    EXPECT_DOUBLE_EQ(points[3].mu_f, 0.2);
+    auto step = [](std::vector<double> const& v, double a, double b) {
+        return std::abs(std::find(v.begin(), v.end(), a) - std::find(v.begin(), v.end(), b));
+        };
+    for (size_t k=1; k<points.size(); ++k) {
+        config_params const& a = points[k-1];
+        config_params const& b = points[k];
+        EXPECT_DOUBLE_EQ(a.mu_c, 0.5);
+        EXPECT_EQ(step(betas, a.beta, b.beta) + step(us, a.U, b.U) + step(mus, a.mu_f, b.mu_f), 1);
+        }
+
+    // without the snake order the inner loop restarts, at half filling the chemical potentials follow U
+    auto plain = scan_points(base, {{"U", us}, {"mu_f", mus}}, {"U", "mu_f"}, false, true);
+    EXPECT_DOUBLE_EQ(plain[3].mu_f, 1.0);
+    EXPECT_DOUBLE_EQ(plain[3].mu_c, 1.0);
+    EXPECT_DOUBLE_EQ(plain[3].beta, 10.0);
+    EXPECT_THROW(scan_points(base, {{"U", us}}, {"beta"}), std::logic_error);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
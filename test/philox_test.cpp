@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include "common.hpp"
+
+using namespace fk;
+
+// known answers from the Random123 distribution
+TEST(philox, kat)
+{
+    typedef random_generator::counter_type ctr_t;
+    typedef random_generator::key_type key_t;
+    EXPECT_EQ(random_generator::bijection(ctr_t{{0, 0, 0, 0}}, key_t{{0, 0}}),
+              (ctr_t{{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}));
+    EXPECT_EQ(random_generator::bijection(ctr_t{{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}}, key_t{{0xffffffff, 0xffffffff}}),
+              (ctr_t{{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}}));
+    EXPECT_EQ(random_generator::bijection(ctr_t{{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}}, key_t{{0xa4093822, 0x299f31d0}}),
+              (ctr_t{{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}));
+
+    random_generator r;
+    EXPECT_EQ(r(), 0x6627e8d5);
+}
+
+// skip-ahead and independent streams
+TEST(philox, streams)
+{
+    random_generator r1(32167), r2(32167), r3(32167, 1);
+    std::vector<uint32_t> x(1003);
+    for (auto &v : x) v = r1();
+    for (size_t n : {0, 1, 4, 7, 1000}) {
+        random_generator r(32167);
+        r.discard(n);
+        EXPECT_EQ(r(), x[n]);
+        }
+    r2.discard(5); r2.discard(3);
+    EXPECT_EQ(r2(), x[8]);
+
+    int same = 0;
+    for (size_t i=0; i<x.size(); ++i) same += (r3() == x[i]);
+    EXPECT_LT(same, 3);
+
+    // the std distributions work with the generator
+    std::uniform_real_distribution<> u(0, 1);
+    double s = 0;
+    for (int i=0; i<100000; ++i) s += u(r1);
+    EXPECT_NEAR(s / 100000, 0.5, 5e-3);
+}
+
+// the state is saved and restored
+TEST(philox, serialization)
+{
+    random_generator r(7, 3);
+    r.discard(13);
+    std::stringstream ss;
+    {
+        boost::archive::text_oarchive oa(ss);
+        oa << r;
+    }
+    random_generator r2;
+    {
+        boost::archive::text_iarchive ia(ss);
+        ia >> r2;
+    }
+    EXPECT_TRUE(r == r2);
+    EXPECT_EQ(r(), r2());
+
+    std::stringstream ss2;
+    ss2 << r;
+    random_generator r3;
+    ss2 >> r3;
+    EXPECT_TRUE(r == r3);
+    EXPECT_EQ(r(), r3());
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "population_annealing.hpp"
+#include "exact_enumeration.hpp"
+#include <boost/mpi/environment.hpp>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+// the free energy from the resampling weights, annealed from beta = 0, is the exact one
+TEST(population_annealing, log_z)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(3);
+    lattice.fill(-1.0);
+    double beta = 2.0, U = 2.0, mu = 1.0;
+
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = beta;
+    p["U"] = U;
+    p["mu_c"] = mu;
+    p["mu_f"] = mu;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["sweep_len"] = 9;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["measure_history"] = false;
+    p["pa_beta_start"] = 0.0;
+    p["pa_nsteps"] = 16;
+    p["pa_replicas"] = 512 / comm.size();
+    p["pa_sweeps"] = 2;
+
+    mc_t mc(p, comm.rank());
+    mc.initialize(lattice);
+    population_annealing<mc_t> pa(mc, comm);
+    pa.run(0);
+
+    double log_z = exact_log_z(lattice, config_params({beta, U, mu, mu, {}}));
+    if (!comm.rank()) std::cout << "log Z (annealing) = " << pa.log_z().back() << ", log Z (exact) = " << log_z << std::endl;
+    ASSERT_EQ(pa.nslots(), 17);
+    EXPECT_DOUBLE_EQ(pa.betas().back(), beta);
+    EXPECT_NEAR(pa.log_z()[0], exact_log_z(lattice, config_params({0.0, U, mu, mu, {}})), 1e-10);
+    EXPECT_NEAR(pa.log_z().back(), log_z, 0.05);
+    // the chain is back at the target parameters
+    EXPECT_DOUBLE_EQ(mc.config().params().beta, beta);
+    // every replica is measured once per step
+    observables_t obs = pa.collect_observables(pa.nslots() - 1);
+    if (!comm.rank()) { EXPECT_EQ(obs.nf0.size(), 512 / comm.size() * comm.size()); }
+}
+
+// a run, stopped by max_time, keeps the steps, completed by all replicas
+TEST(population_annealing, max_time)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(3);
+    lattice.fill(-1.0);
+
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 2.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["sweep_len"] = 9;
+    p["show_output"] = false;
+    p["measure_history"] = false;
+    p["pa_beta_start"] = 0.0;
+    // far more steps, than fit in a second
+    p["pa_nsteps"] = 20000;
+    p["pa_replicas"] = 64;
+    p["pa_sweeps"] = 2;
+
+    mc_t mc(p, comm.rank());
+    mc.initialize(lattice);
+    population_annealing<mc_t> pa(mc, comm);
+    pa.run(1);
+
+    ASSERT_GT(pa.nslots(), 1);
+    ASSERT_LT(pa.nslots(), 20001);
+    EXPECT_EQ(pa.betas().size(), pa.nslots());
+    EXPECT_EQ(pa.log_z().size(), pa.nslots());
+    EXPECT_LT(pa.betas().back(), 2.0);
+    EXPECT_DOUBLE_EQ(mc.config().params().beta, 2.0);
+    observables_t obs = pa.collect_observables(pa.nslots() - 1);
+    if (!comm.rank()) { EXPECT_EQ(obs.nf0.size(), 64 * comm.size()); }
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "replica_exchange.hpp"
+#include <boost/mpi/environment.hpp>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+/// Access to the exchanges without the sweeps in between
+struct replica_exchange_test : replica_exchange<mc_t> {
+    replica_exchange_test(mc_t& mc, boost::mpi::communicator const& comm) : replica_exchange<mc_t>(mc, comm) {}
+    using replica_exchange<mc_t>::exchange_;
+    using replica_exchange<mc_t>::stash_;
+};
+
+/// log of the weight of a configuration at given beta and mu_f from its ED spectrum
+double log_weight(configuration_t const& config, double beta, double mu_f)
+{
+    configuration_t c(config.lattice_, beta, config.params().U, config.params().mu_c, mu_f);
+    c.f_config_ = config.f_config_;
+    c.calc_hamiltonian();
+    c.calc_ed(false);
+    double logz = 0.0;
+    for (int i=0; i<c.ed_data().cached_spectrum.size(); ++i) logz += std::log1p(std::exp(-beta*c.ed_data().cached_spectrum[i]));
+    return logz + beta*mu_f*c.get_nf();
+}
+
+/** Two replicas with fixed configurations exchange their slots. From the state, where the rank 0 holds slot 0, 
+ * the exchange is accepted with min(1, r), back with min(1, 1/r), with the detailed-balance ratio 
+ * r = pi_0(f_1) pi_1(f_0) / (pi_0(f_0) pi_1(f_1)). The stationary acceptance rate is 2 min(1,r) min(1,1/r) / (min(1,r) + min(1,1/r)). */
+void test_exchange(std::string parameter, double pmin, double pmax)
+{
+    boost::mpi::communicator comm;
+    if (comm.size() != 2) { std::cerr << "replica_exchange_test should run on 2 ranks" << std::endl; return; }
+    hypercubic_lattice<2> lattice(3);
+    lattice.fill(-1.0);
+
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 1.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 2 + 4*comm.rank();
+    p["show_output"] = false;
+    p["parallel_tempering"] = true;
+    p["pt_parameter"] = parameter;
+    p["pt_min"] = pmin;
+    p["pt_max"] = pmax;
+
+    mc_t mc(p, comm.rank());
+    mc.initialize(lattice);
+    replica_exchange_test re(mc, comm);
+    ASSERT_EQ(re.slot(), comm.rank());
+
+    // log weights of each configuration in both slots
+    std::array<double, 2> lw = {{ log_weight(mc.config(), re.slot_params(0).beta, re.slot_params(0).mu_f), 
+                                  log_weight(mc.config(), re.slot_params(1).beta, re.slot_params(1).mu_f) }};
+    std::vector<std::array<double, 2>> all_lw;
+    boost::mpi::all_gather(comm, lw, all_lw);
+    double log_r = all_lw[1][0] + all_lw[0][1] - all_lw[0][0] - all_lw[1][1];
+    if (parameter == "mu_f") {
+        // only the f-electron term changes : r = exp(beta (mu_1 - mu_0)(nf_0 - nf_1))
+        std::vector<size_t> nf;
+        boost::mpi::all_gather(comm, mc.config().get_nf(), nf);
+        EXPECT_NEAR(log_r, p["beta"].as<double>() * (pmax - pmin) * (double(nf[0]) - double(nf[1])), 1e-10);
+        }
+
+    int nexchanges = 40000;
+    for (int i=0; i<nexchanges; ++i) re.exchange_();
+    // the configurations stay on the ranks, the parameters follow the slots
+    EXPECT_DOUBLE_EQ(mc.config().params().beta, re.slot_params(re.slot()).beta);
+    EXPECT_DOUBLE_EQ(mc.config().params().mu_f, re.slot_params(re.slot()).mu_f);
+    EXPECT_NEAR(mc.log_weight_at(re.slot_params(re.slot())), lw[re.slot()], 1e-8);
+
+    double a = std::min(1.0, std::exp(log_r)), b = std::min(1.0, std::exp(-log_r));
+    double rate = 2.*a*b / (a + b);
+    // every other exchange is between the slots 0 and 1
+    double error = std::sqrt(rate * (1. - rate) / (nexchanges / 2));
+    if (!comm.rank()) std::cout << parameter << " : log r = " << log_r << ", exchange rate = " << re.exchange_rate(0) << ", expected " << rate << std::endl;
+    EXPECT_GT(rate, 0.05);
+    EXPECT_LT(rate, 0.95);
+    EXPECT_NEAR(re.exchange_rate(0), rate, 4*error);
+}
+
+TEST(replica_exchange, beta) { test_exchange("beta", 1.0, 4.0); }
+TEST(replica_exchange, mu_f) { test_exchange("mu_f", 0.8, 1.0); }
+
+// A run, stopped by max_time, ends on all ranks after the same exchange
+TEST(replica_exchange, max_time)
+{
+    boost::mpi::communicator comm;
+    if (comm.size() != 2) { std::cerr << "replica_exchange_test should run on 2 ranks" << std::endl; return; }
+    hypercubic_lattice<2> lattice(3);
+    lattice.fill(-1.0);
+
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 1.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167 + comm.rank();
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 4;
+    p["show_output"] = false;
+    p["parallel_tempering"] = true;
+    p["pt_parameter"] = "beta";
+    p["pt_min"] = 1.0;
+    p["pt_max"] = 2.0;
+    p["pt_interval"] = 3;
+    p["ntherm_sweeps"] = 0;
+    // far more sweeps, than fit in a second ; rank 1 is slower, the decision of rank 0 holds
+    p["nsweeps"] = 200000;
+    p["sweep_len"] = comm.rank() ? 256 : 64;
+
+    mc_t mc(p, comm.rank());
+    mc.initialize(lattice);
+    replica_exchange_test re(mc, comm);
+    re.run(1);
+
+    // the slot of the rank holds its measurements in mc.observables, the other ones are stashed
+    long nmeasures = mc.observables.nf0.size() + re.stash_[1 - re.slot()].nf0.size();
+    std::vector<long> all;
+    boost::mpi::all_gather(comm, nmeasures, all);
+    EXPECT_EQ(all[0], all[1]);
+    EXPECT_GT(nmeasures, 0);
+    EXPECT_EQ(nmeasures % 3, 0);
+    EXPECT_LT(nmeasures, 200000);
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
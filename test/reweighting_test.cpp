@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "configuration.hpp"
+#include "reweighting.hpp"
+#include "exact_enumeration.hpp"
+
+using namespace fk;
+
+size_t L = 6;
+double U = 2.0, mu_c = 1.0;
+
+// exact average energy and nf at given beta and mu_f
+std::pair<double, double> exact_averages(hypercubic_lattice<1> const& lattice, double beta, double mu_f)
+{
+    config_params p({beta, U, mu_c, mu_f, {}});
+    auto configs = all_configurations(lattice, p);
+    auto prob = exact_distribution(lattice, p);
+    double e_av = 0, nf_av = 0;
+    for (size_t k=0; k<configs.size(); ++k) {
+        configuration_t& c = configs[k];
+        c.calc_ed(false);
+        double e = (c.ed_data().cached_spectrum * c.ed_data().cached_fermi).sum() - mu_f*c.get_nf();
+        e_av+=prob[k]*e; nf_av+=prob[k]*c.get_nf();
+        }
+    return std::make_pair(e_av, nf_av);
+}
+
+// independent samples from the exact distribution at beta and mu_f
+reweight_run sample_run(hypercubic_lattice<1> const& lattice, double beta, double mu_f, int nsamples, random_generator& rnd)
+{
+    config_params p({beta, U, mu_c, mu_f, {}});
+    auto configs = all_configurations(lattice, p);
+    for (auto& c : configs) c.calc_ed(false);
+    auto prob = exact_distribution(lattice, p);
+    std::discrete_distribution<> d(prob.begin(), prob.end());
+    std::vector<std::vector<double>> spectrum_history(L);
+    std::vector<double> nf0, nfpi;
+    for (int s=0; s<nsamples; ++s) {
+        auto const& c = configs[d(rnd)];
+        for (int i=0; i<L; ++i) spectrum_history[i].push_back(c.ed_data().cached_spectrum(i));
+        nf0.push_back(c.get_nf());
+        nfpi.push_back(std::abs(lattice.FFT_pi(c.f_config_)));
+        }
+    return reweight_run(beta, mu_f, spectrum_history, nf0, nfpi);
+}
+
+// reweighting of a single run to a nearby point
+TEST(reweighting, single)
+{
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    random_generator rnd(32167);
+    reweighting rw({sample_run(lattice, 2.0, 0.7, 20000, rnd)});
+
+    // the run itself has unit weights
+    auto p0 = rw.evaluate(2.0, 0.7, {}, 0.05, 4);
+    EXPECT_NEAR(p0.ess, 20000, 1e-6);
+
+    for (auto bm : {std::make_pair(2.2, 0.7), std::make_pair(2.0, 0.8)}) {
+        auto exact = exact_averages(lattice, bm.first, bm.second);
+        auto p = rw.evaluate(bm.first, bm.second, {0.0}, 0.05, 4);
+        EXPECT_NEAR(std::get<binning::_MEAN>(p.energy), exact.first, 4*std::get<binning::_SQERROR>(p.energy));
+        EXPECT_NEAR(std::get<binning::_MEAN>(p.nf0), exact.second, 4*std::get<binning::_SQERROR>(p.nf0));
+        EXPECT_LT(p.ess, 20000);
+        EXPECT_EQ(p.dos.size(), 1);
+        }
+}
+
+// the multi-histogram equations recover the ratio of the partition functions of two runs
+TEST(reweighting, multi)
+{
+    hypercubic_lattice<1> lattice(L);
+    lattice.fill(-1.0);
+    random_generator rnd(32167);
+    double beta0 = 2.0, beta1 = 2.6, mu_f = 0.7;
+    reweighting rw({sample_run(lattice, beta0, mu_f, 10000, rnd), sample_run(lattice, beta1, mu_f, 10000, rnd)});
+
+    double log_z0 = exact_log_z(lattice, config_params({beta0, U, mu_c, mu_f, {}}));
+    double log_z1 = exact_log_z(lattice, config_params({beta1, U, mu_c, mu_f, {}}));
+    EXPECT_NEAR(rw.log_z()[1], log_z1 - log_z0, 2e-2);
+
+    double beta = 2.3;
+    auto exact = exact_averages(lattice, beta, mu_f);
+    auto p = rw.evaluate(beta, mu_f, {}, 0.05, 4);
+    EXPECT_NEAR(std::get<binning::_MEAN>(p.energy), exact.first, 4*std::get<binning::_SQERROR>(p.energy));
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include "shared_thermalization.hpp"
+#include <boost/mpi/environment.hpp>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+parameters_t shared_params(int ndecorrelation)
+{
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 1.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 8;
+    p["ntherm_sweeps"] = 30;
+    p["sweep_len"] = 16;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["shared_therm"] = true;
+    p["shared_therm_ranks"] = 1;
+    p["shared_decorrelation"] = ndecorrelation;
+    return p;
+}
+
+std::vector<int> f_vector(mc_t const& mc)
+{
+    auto const& f = mc.config().f_config_;
+    return std::vector<int>(f.data(), f.data() + f.size());
+}
+
+// without decorrelation the ranks measure from the configuration of the source, with their own random streams
+TEST(shared_thermalization, broadcast)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    mc_t mc(shared_params(0), comm.rank());
+    mc.initialize(lattice);
+    shared_thermalization<mc_t> shared(mc, comm);
+    EXPECT_EQ(shared.source(), comm.rank() == 0);
+    shared.run();
+    EXPECT_EQ(mc.thermalization_sweeps(), comm.rank() ? 0 : 30);
+    EXPECT_DOUBLE_EQ(shared.overlap(), 1.0);
+
+    std::vector<std::vector<int>> f_all;
+    boost::mpi::gather(comm, f_vector(mc), f_all, 0);
+    int n = 20;
+    for (int s=0; s<n; ++s) { mc.update(); mc.measure(); }
+    EXPECT_EQ(mc.observables.energies.size(), size_t(n));
+    std::vector<std::vector<double>> e_all;
+    boost::mpi::gather(comm, mc.observables.energies, e_all, 0);
+    if (comm.rank()) return;
+    for (int r=1; r<comm.size(); ++r) {
+        EXPECT_EQ(f_all[r], f_all[0]);
+        EXPECT_NE(e_all[r], e_all[0]);
+        }
+    // the starting configuration is kept, which the diagnostic reports
+    EXPECT_FALSE(shared.decorrelated());
+}
+
+// the decorrelation sweeps start from the broadcast configuration and remove the memory of it
+TEST(shared_thermalization, decorrelation)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    int ndecorrelation = 100;
+    mc_t mc(shared_params(ndecorrelation), comm.rank());
+    mc.initialize(lattice);
+    shared_thermalization<mc_t> shared(mc, comm);
+    shared.run();
+
+    std::vector<int> f0 = f_vector(mc);
+    boost::mpi::broadcast(comm, f0, 0);
+    if (comm.rank()) {
+        EXPECT_EQ(mc.thermalization_sweeps(), ndecorrelation);
+        EXPECT_LT(shared.overlap(), 1.0);
+        // the same chain, started from the source configuration by hand
+        mc_t ref(shared_params(ndecorrelation), comm.rank());
+        ref.initialize(lattice);
+        ref.set_f_config(Eigen::Map<configuration_t::int_array_t>(f0.data(), f0.size()));
+        ref.set_thermalization_sweeps(ndecorrelation);
+        while (!ref.thermalized()) { ref.update(); ref.measure(); }
+        EXPECT_EQ(f_vector(ref), f_vector(mc));
+        }
+    else EXPECT_TRUE(shared.decorrelated());
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
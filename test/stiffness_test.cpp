@@ -4,6 +4,7 @@
 
 #include "lattice/hypercubic.hpp"
 #include "measures/stiffness.hpp"
+#include "measures/stiffness_kpm.hpp"
 
 inline void print_section (const std::string& str) { std::cout << std::string(str.size(),'-') << "\n" << str << std::endl; }
 
@@ -62,6 +63,36 @@ TEST(stiffness, test01) { test_stiffness(2.0, 1000.0, {0,1,0,1,1,0,1,0,0,1,0,0,1
 TEST(stiffness, test02) { test_stiffness(6.0, 1000.0, {0,1,0,1,1,0,1,0,0,1,0,0,1,0,1,0,1,1,1,0,1,1,0,1,1}, 0.00260831); };
 TEST(stiffness, test10) { test_stiffness(0.37, 1000.0, {0,1,0,0,0,0,1,1,0,1,1,0,0,1,1,0,1,1,0,1,1,0,1,0,0,0,1,1,0,1,1,1,1,1,0,1,1,0,1,1,1,1,0,0,0,1,0,1,1}, 1.26046); }
 
+// KPM conductivity with exact traces vs exact diagonalization
+TEST(stiffness, kpm)
+{
+    boost::mpi::communicator comm;
+    typedef hypercubic_lattice<2> lattice_t;
+    int L = 8;
+    double U = 4.0, beta = 5.0;
+    lattice_t lattice(L);
+    lattice.fill(1.0);
+    configuration_t config(lattice, beta, U, U/2, U/2);
+    random_generator rnd(5);
+    config.randomize_f(rnd, lattice.get_msize()/2);
+    config.calc_hamiltonian();
+
+    std::vector<double> wgrid = {1.0, 2.0};
+    std::vector<double> stiffness_ed, stiffness_kpm;
+    std::vector<std::vector<double>> cond_ed, cond_kpm;
+    measure_stiffness<lattice_t> m_ed(config, lattice, stiffness_ed, cond_ed, wgrid, 0.1);
+    measure_stiffness_kpm<lattice_t> m_kpm(config, lattice, rnd, 256, 0, stiffness_kpm, cond_kpm, wgrid, 0.1);
+    m_ed.accumulate(1.0);
+    m_kpm.accumulate(1.0);
+
+    for (int w=0; w<wgrid.size(); ++w) { 
+        std::cout << "w*cond(" << wgrid[w] << ") : " << cond_ed[w][0] << " (ed) " << cond_kpm[w][0] << " (kpm)" << std::endl;
+        EXPECT_NEAR(cond_ed[w][0], cond_kpm[w][0], 0.05*std::abs(cond_ed[w][0]));
+        }
+    std::cout << "stiffness : " << stiffness_ed[0] << " (ed) " << stiffness_kpm[0] << " (kpm)" << std::endl;
+    EXPECT_NEAR(stiffness_ed[0], stiffness_kpm[0], 1e-2);
+}
+
 int main(int argc, char* argv[])
 {
     boost::mpi::environment env(argc, argv);
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include "threaded_chains.hpp"
+#include <boost/mpi/environment.hpp>
+#include <alps/mc/stop_callback.hpp>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+double target = 0.02;
+
+parameters_t target_params()
+{
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 2.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 8;
+    p["nsweeps"] = 100000;
+    p["ntherm_sweeps"] = 20;
+    p["sweep_len"] = 4;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["target_rel_error"] = target;
+    p["convergence_interval"] = 16;
+    return p;
+}
+
+// (target / error)^2 of every monitor of a chain
+std::vector<double> progress(mc_t const& mc)
+{
+    std::vector<double> x;
+    for (auto const& m : mc.monitors()) x.push_back(std::pow(target / m.rel_error(), 2));
+    return x;
+}
+
+// the chains stop together, once the combined errors are below the target, and before any of them gets there alone
+void check_combined(boost::mpi::communicator const& comm, std::vector<mc_t const*> const& chains)
+{
+    size_t n = chains[0]->monitors().size();
+    ASSERT_GT(n, 0u);
+    std::vector<double> local(n, 0.0), total(n);
+    for (auto mc : chains) {
+        std::vector<double> x = progress(*mc);
+        EXPECT_LT(*std::min_element(x.begin(), x.end()), 1.0);
+        for (size_t i=0; i<n; ++i) local[i] += x[i];
+        }
+    boost::mpi::all_reduce(comm, local.data(), n, total.data(), std::plus<double>());
+    EXPECT_GE(*std::min_element(total.begin(), total.end()), 1.0);
+
+    long count = chains[0]->monitors()[0].binning.count();
+    for (auto mc : chains) EXPECT_EQ(mc->monitors()[0].binning.count(), count);
+    EXPECT_LT(count, 100000);
+    std::vector<long> counts;
+    boost::mpi::all_gather(comm, count, counts);
+    for (long c : counts) EXPECT_EQ(c, count);
+}
+
+TEST(target_error, ranks)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    mc_t mc(target_params(), comm.rank());
+    mc.initialize(lattice);
+    mc.run(alps::stop_callback(0), comm);
+    check_combined(comm, {&mc});
+    EXPECT_GE(mc.fraction_completed(), 1.0);
+}
+
+TEST(target_error, threaded_chains)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    int nchains = 2;
+    threaded_chains<mc_t> chains(target_params(), nchains, comm);
+    chains.initialize(lattice);
+    chains.run(0);
+    check_combined(comm, {&chains.chain(0), &chains.chain(1)});
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include "lattice/hypercubic.hpp"
+#include "fk_mc.hpp"
+#include "threaded_chains.hpp"
+#include "measures/recycled.hpp"
+#include <boost/mpi/environment.hpp>
+
+using namespace fk;
+
+typedef fk_mc<hypercubic_lattice<2>> mc_t;
+
+parameters_t threaded_params()
+{
+    parameters_t p;
+    mc_t::define_parameters(p);
+    p["beta"] = 2.0;
+    p["U"] = 2.0;
+    p["mu_c"] = 1.0;
+    p["mu_f"] = 1.0;
+    p["seed"] = 32167;
+    p["SEED"] = p["seed"];
+    p["Nf_start"] = 8;
+    p["nsweeps"] = 60;
+    p["ntherm_sweeps"] = 10;
+    p["sweep_len"] = 4;
+    p["mc_flip"] = 0.5;
+    p["show_output"] = false;
+    p["measure_history"] = true;
+    p["measure_recycled"] = true;
+    return p;
+}
+
+// chain t of a rank is the same as a single chain with the stream t
+TEST(threaded_chains, streams)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    int nchains = 3;
+    threaded_chains<mc_t> chains(threaded_params(), nchains, comm);
+    chains.initialize(lattice);
+    chains.run(0);
+
+    ASSERT_EQ(chains.nchains(), nchains);
+    for (int t=0; t<nchains; ++t) {
+        mc_t single(threaded_params(), comm.rank()*nchains + t);
+        single.initialize(lattice);
+        single.run(alps::stop_callback(0));
+        mc_t const& mc = chains.chain(t);
+        EXPECT_TRUE((mc.config().f_config_ == single.config().f_config_).all());
+        ASSERT_EQ(mc.observables.energies.size(), single.observables.energies.size());
+        for (size_t s=0; s<single.observables.energies.size(); ++s) EXPECT_EQ(mc.observables.energies[s], single.observables.energies[s]);
+        EXPECT_EQ(mc.observables.nf0, single.observables.nf0);
+        EXPECT_EQ(mc.observables.spectrum, single.observables.spectrum);
+        for (size_t i=0; i<single.move_stats().size(); ++i) EXPECT_EQ(mc.move_stats()[i].naccept, single.move_stats()[i].naccept);
+        }
+    // the chains are independent
+    EXPECT_NE(chains.chain(0).observables.energies, chains.chain(1).observables.energies);
+}
+
+// the histories are concatenated, the running averages are weighted with the number of measurements of every chain
+TEST(threaded_chains, collect_observables)
+{
+    boost::mpi::communicator comm;
+    hypercubic_lattice<2> lattice(4);
+    lattice.fill(-1.0);
+    int nchains = 3;
+    threaded_chains<mc_t> chains(threaded_params(), nchains, comm);
+    chains.initialize(lattice);
+    for (int t=0; t<nchains; ++t)
+        for (int s=0; s<10 + 5 + 10*t; ++s) { chains.chain(t).update(); chains.chain(t).measure(); }
+
+    std::vector<double> observables_t::* averages[] = { &observables_t::spectrum, &observables_t::recycled_spectrum, &observables_t::recycled_fcorrel };
+    std::vector<std::vector<double>> expected;
+    for (auto avg : averages) expected.emplace_back((chains.chain(0).observables.*avg).size(), 0.0);
+    size_t nmeasures = 0;
+    for (int t=0; t<nchains; ++t) {
+        observables_t const& obs = chains.chain(t).observables;
+        EXPECT_EQ(obs.nf0.size(), size_t(5 + 10*t));
+        nmeasures += obs.nf0.size();
+        for (size_t k=0; k<expected.size(); ++k)
+            for (size_t i=0; i<expected[k].size(); ++i) expected[k][i] += double(obs.nf0.size()) * (obs.*averages[k])[i];
+        }
+    std::vector<double> energies;
+    for (int t=0; t<nchains; ++t)
+        energies.insert(energies.end(), chains.chain(t).observables.energies.begin(), chains.chain(t).observables.energies.end());
+
+    observables_t obs = chains.collect_observables();
+    if (comm.rank()) return;
+    EXPECT_EQ(obs.nf0.size(), nmeasures);
+    EXPECT_EQ(obs.energies, energies);
+    for (size_t k=0; k<expected.size(); ++k) {
+        ASSERT_FALSE(expected[k].empty());
+        ASSERT_EQ((obs.*averages[k]).size(), expected[k].size());
+        for (size_t i=0; i<expected[k].size(); ++i) EXPECT_NEAR((obs.*averages[k])[i], expected[k][i] / nmeasures, 1e-12);
+        }
+}
+
+int main(int argc, char* argv[])
+{
+    boost::mpi::environment env(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}